@@ -0,0 +1,131 @@
+// Communications packet decode microbenchmark
+// reports heap allocations and time per decoded packet, for good packets, for the receive path
+// from the parser through the IPC message, and for the malformed packets of a noisy link,
+// thrown as exceptions or returned as results
+
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <atomic>
+#include <chrono>
+#include <vector>
+#include "Comms.h"
+#include "Messages.h"
+
+using namespace std;
+using namespace inv_example;
+
+// ================================================================================
+// Allocation counter
+// every global new in the process is counted
+// ================================================================================
+static atomic<unsigned long long> g_allocs{ 0 };
+
+void* operator new(size_t size)
+{
+    g_allocs.fetch_add(1, memory_order_relaxed);
+    void* p = malloc(size ? size : 1);
+    if (p == nullptr) throw bad_alloc();
+    return p;
+}
+
+void operator delete(void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+
+
+// ================================================================================
+// Benchmark runner
+// ================================================================================
+const unsigned int ITERATIONS = 1000000;
+volatile double g_sink;         // keeps the decoded values alive
+
+template <typename F>
+void run(const char* name, F decode)
+{
+    decode();       // warm up
+    unsigned long long allocs0 = g_allocs.load();
+    auto t0 = chrono::steady_clock::now();
+    for (unsigned int i = 0; i < ITERATIONS; ++i) {
+        decode();
+    }
+    auto t1 = chrono::steady_clock::now();
+    unsigned long long allocs = g_allocs.load() - allocs0;
+    double ns = chrono::duration<double, nano>(t1 - t0).count();
+
+    printf("%-40s %10.3f allocs/decode %10.1f ns/decode\n", name, static_cast<double>(allocs) / ITERATIONS, ns / ITERATIONS);
+}
+
+
+// ================================================================================
+// Decode paths
+// ================================================================================
+int main(int argc, char* argv[])
+{
+    InvFastClock::calibrate();      // time of arrival stamps as in the application
+
+    // reference packets
+    CartDataPacket cart(-123.45, 3.1415926);
+    PendDataPacket pend(12.5, -0.75);
+    vector<uint8_t> cart_raw(cart.get_raw(), cart.get_raw() + cart.get_len());
+    vector<uint8_t> pend_raw(pend.get_raw(), pend.get_raw() + pend.get_len());
+    InvTimestamp toa;
+
+    // decode straight from a received byte view
+    run("CartDataPacket from byte view", [&] { g_sink = CartDataPacket(cart_raw.data(), cart_raw.size(), toa).get_pos(); });
+    run("PendDataPacket from byte view", [&] { g_sink = PendDataPacket(pend_raw.data(), pend_raw.size(), toa).get_pos(); });
+
+    // decode from the bytes held by an IPC message
+    IpcMsg cart_msg(IpcMsgId::MSG_CART_DATA, cart_raw.data(), cart_raw.size());
+    IpcMsg pend_msg(IpcMsgId::MSG_PEND_DATA, pend_raw.data(), pend_raw.size());
+    run("CartDataPacket from IpcMsg", [&] { g_sink = CartDataPacket(cart_msg.GetData(), cart_msg.GetLen(), toa).get_pos(); });
+    run("PendDataPacket from IpcMsg", [&] { g_sink = PendDataPacket(pend_msg.GetData(), pend_msg.GetLen(), toa).get_pos(); });
+
+    // parse a receive buffer and decode the frame in place
+    InvCommParser parser;
+    vector<uint8_t> stream(cart_raw);
+    stream.insert(stream.end(), pend_raw.begin(), pend_raw.end());
+    run("parse + decode Cart and Pend frames", [&] {
+        parser.next(stream.data(), stream.size(), toa);
+        CommFrame frame;
+        while (parser.get_next_packet(frame)) {
+            if (frame.data[1] == PacketId::CART_DATA) g_sink = CartDataPacket(frame).get_pos();
+            else g_sink = PendDataPacket(frame).get_pos();
+        }
+    });
+
+    // the receive path: parse, make the message for the main loop, decode it there
+    run("parse + make_frame_msg + decode", [&] {
+        parser.next(stream.data(), stream.size(), toa);
+        CommFrame frame;
+        while (parser.get_next_packet(frame)) {
+            IpcMsg msg = make_frame_msg(frame);
+            if (msg.GetId() == IpcMsgId::MSG_CART_DATA) g_sink = CartDataPacket(msg.GetData(), msg.GetLen(), toa).get_pos();
+            else g_sink = PendDataPacket(msg.GetData(), msg.GetLen(), toa).get_pos();
+        }
+    });
+
+    // malformed packets, as a noisy link delivers them: wrong type, short, bad length byte
+    vector<vector<uint8_t>> bad = { pend_raw, vector<uint8_t>(cart_raw.begin(), cart_raw.end() - 3), cart_raw };
+    bad[2][2] = 7;
+    size_t n = 0;
+    run("malformed CartDataPacket, throw + catch", [&] {
+        const vector<uint8_t>& raw = bad[n++ % bad.size()];
+        try {
+            g_sink = CartDataPacket(raw.data(), raw.size(), toa).get_pos();
+        }
+        catch (const InvError& e) {
+            g_sink = e.get_code();
+        }
+    });
+    run("malformed CartDataPacket, decode_packet", [&] {
+        const vector<uint8_t>& raw = bad[n++ % bad.size()];
+        auto packet = decode_packet<CartDataPacket>(raw.data(), raw.size(), toa);
+        g_sink = packet ? packet->get_pos() : packet.error().get_code();
+    });
+    run("good CartDataPacket, decode_packet", [&] {
+        auto packet = decode_packet<CartDataPacket>(cart_raw.data(), cart_raw.size(), toa);
+        g_sink = packet ? packet->get_pos() : packet.error().get_code();
+    });
+
+    return 0;
+}
@@ -0,0 +1,466 @@
+// Microbenchmark suite for the comms, IPC and model code
+// usage: InvBench [--benchmark_filter=regex] [--benchmark_format=json] [--benchmark_out=file.json --benchmark_out_format=json]
+// built on Google Benchmark; the JSON output is the record kept between releases, compare two runs
+// with the compare.py script that comes with Google Benchmark
+//
+// the timer benchmarks wait for real ticks and report their jitter as counters, in us
+
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <benchmark/benchmark.h>
+#include "Comms.h"
+#include "Messages.h"
+#include "Ipc.h"
+#include "Latency.h"
+#include "Model.h"
+#include "Fleet.h"
+
+using namespace std;
+using namespace inv_example;
+
+// ================================================================================
+// Reference packets
+// ================================================================================
+template <typename P> P make_packet(void);
+template <> CartForceCmdPacket make_packet(void) { return CartForceCmdPacket(-123.45); }
+template <> CartDataPacket make_packet(void) { return CartDataPacket(-123.45, 3.1415926); }
+template <> PendDataPacket make_packet(void) { return PendDataPacket(12.5, -0.75); }
+
+static vector<uint8_t> packet_bytes(const CommPacketBase& packet)
+{
+    return vector<uint8_t>(packet.get_raw(), packet.get_raw() + packet.get_len());
+}
+
+// a receive stream of cart and pendulum data frames, as the links deliver them
+static vector<uint8_t> make_stream(size_t len)
+{
+    vector<uint8_t> cart = packet_bytes(make_packet<CartDataPacket>());
+    vector<uint8_t> pend = packet_bytes(make_packet<PendDataPacket>());
+    vector<uint8_t> stream;
+    while (stream.size() < len) {
+        stream.insert(stream.end(), cart.begin(), cart.end());
+        stream.insert(stream.end(), pend.begin(), pend.end());
+    }
+    stream.resize(len);
+    return stream;
+}
+
+// the same stream with about one byte in every_n replaced, from a fixed seed so runs compare
+static vector<uint8_t> corrupt_stream(vector<uint8_t> stream, unsigned int every_n)
+{
+    uint32_t seed = 12345;
+    for (auto& b : stream) {
+        seed = seed * 1664525u + 1013904223u;
+        if ((seed >> 8) % every_n == 0) b = static_cast<uint8_t>(seed >> 24);
+    }
+    return stream;
+}
+
+const size_t STREAM_LEN = 64 * 1024;        // bytes parsed per iteration
+const size_t RX_CHUNK_LEN = 64;             // bytes per read from the link
+
+
+// ================================================================================
+// Packet encode and decode
+// ================================================================================
+template <typename P>
+static void BM_PacketEncode(benchmark::State& state)
+{
+    double v = 1.0;
+    for (auto _ : state) {
+        typename P::Fields fields;
+        fields.fill(v);
+        P packet(fields);
+        benchmark::DoNotOptimize(packet.get_raw()[InvCommParser::m_HEADER_LEN]);
+        v += 0.25;
+    }
+}
+BENCHMARK_TEMPLATE(BM_PacketEncode, CartForceCmdPacket);
+BENCHMARK_TEMPLATE(BM_PacketEncode, CartDataPacket);
+BENCHMARK_TEMPLATE(BM_PacketEncode, PendDataPacket);
+
+template <typename P>
+static void BM_PacketDecode(benchmark::State& state)
+{
+    vector<uint8_t> raw = packet_bytes(make_packet<P>());
+    InvTimestamp toa;
+    for (auto _ : state) {
+        auto packet = decode_packet<P>(raw.data(), raw.size(), toa);
+        benchmark::DoNotOptimize(packet->get_fields());
+    }
+}
+BENCHMARK_TEMPLATE(BM_PacketDecode, CartForceCmdPacket);
+BENCHMARK_TEMPLATE(BM_PacketDecode, CartDataPacket);
+BENCHMARK_TEMPLATE(BM_PacketDecode, PendDataPacket);
+
+// malformed packets in rotation: wrong type, short, bad length byte
+static void BM_PacketDecodeMalformed(benchmark::State& state)
+{
+    vector<uint8_t> cart = packet_bytes(make_packet<CartDataPacket>());
+    vector<vector<uint8_t>> bad = { packet_bytes(make_packet<PendDataPacket>()), vector<uint8_t>(cart.begin(), cart.end() - 3), cart };
+    bad[2][2] = 7;
+    InvTimestamp toa;
+    size_t n = 0;
+    for (auto _ : state) {
+        const vector<uint8_t>& raw = bad[n++ % bad.size()];
+        auto packet = decode_packet<CartDataPacket>(raw.data(), raw.size(), toa);
+        benchmark::DoNotOptimize(static_cast<bool>(packet));
+    }
+}
+BENCHMARK(BM_PacketDecodeMalformed);
+
+// one field of a batch of recorded frames, stored back to back: the batch codec against a per-field loop
+const size_t FIELD_BATCH = 1024;            // frames per iteration
+
+static vector<uint8_t> frame_batch(const CommPacketBase& packet)
+{
+    vector<uint8_t> raw = packet_bytes(packet), batch;
+    for (size_t n = 0; n < FIELD_BATCH; ++n) batch.insert(batch.end(), raw.begin(), raw.end());
+    return batch;
+}
+
+// range(0): field of the pendulum data packet, 0 = position (I16), 1 = velocity (F64)
+static void BM_FieldDecodeBatch(benchmark::State& state)
+{
+    const CommPacketDef& def = comm_packet_def(PacketId::PEND_DATA);
+    const CommFieldDef& f = def.fields[state.range(0)];
+    const size_t offset = InvCommParser::m_HEADER_LEN + (state.range(0) ? field_size(def.fields[0].type) : 0);
+    const size_t stride = InvCommParser::m_HEADER_LEN + packet_data_len(def);
+    vector<uint8_t> batch = frame_batch(make_packet<PendDataPacket>());
+    vector<double> out(FIELD_BATCH);
+    for (auto _ : state) {
+        decode_field_array(f, batch.data() + offset, stride, out.data(), FIELD_BATCH);
+        benchmark::DoNotOptimize(out.data());
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * FIELD_BATCH);
+}
+BENCHMARK(BM_FieldDecodeBatch)->ArgName("field")->Arg(0)->Arg(1);
+
+static void BM_FieldDecodeSingle(benchmark::State& state)
+{
+    const CommPacketDef& def = comm_packet_def(PacketId::PEND_DATA);
+    const CommFieldDef& f = def.fields[state.range(0)];
+    const size_t offset = InvCommParser::m_HEADER_LEN + (state.range(0) ? field_size(def.fields[0].type) : 0);
+    const size_t stride = InvCommParser::m_HEADER_LEN + packet_data_len(def);
+    vector<uint8_t> batch = frame_batch(make_packet<PendDataPacket>());
+    vector<double> out(FIELD_BATCH);
+    for (auto _ : state) {
+        const uint8_t* p = batch.data() + offset;
+        for (size_t n = 0; n < FIELD_BATCH; ++n, p += stride) {
+            out[n] = f.type == FieldType::I16 ? bytes_to_i16(p, f.max, f.min, f.scale).first : bytes_to_double(p, f.max, f.min, f.scale).first;
+        }
+        benchmark::DoNotOptimize(out.data());
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * FIELD_BATCH);
+}
+BENCHMARK(BM_FieldDecodeSingle)->ArgName("field")->Arg(0)->Arg(1);
+
+static void BM_FieldEncodeBatch(benchmark::State& state)
+{
+    const CommPacketDef& def = comm_packet_def(PacketId::PEND_DATA);
+    const CommFieldDef& f = def.fields[state.range(0)];
+    const size_t offset = InvCommParser::m_HEADER_LEN + (state.range(0) ? field_size(def.fields[0].type) : 0);
+    const size_t stride = InvCommParser::m_HEADER_LEN + packet_data_len(def);
+    vector<uint8_t> batch = frame_batch(make_packet<PendDataPacket>());
+    vector<double> in(FIELD_BATCH);
+    for (size_t n = 0; n < FIELD_BATCH; ++n) in[n] = 0.01 * static_cast<double>(n);
+    for (auto _ : state) {
+        encode_field_array(f, batch.data() + offset, stride, in.data(), FIELD_BATCH);
+        benchmark::DoNotOptimize(batch.data());
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * FIELD_BATCH);
+}
+BENCHMARK(BM_FieldEncodeBatch)->ArgName("field")->Arg(0)->Arg(1);
+
+static void BM_FieldEncodeSingle(benchmark::State& state)
+{
+    const CommPacketDef& def = comm_packet_def(PacketId::PEND_DATA);
+    const CommFieldDef& f = def.fields[state.range(0)];
+    const size_t offset = InvCommParser::m_HEADER_LEN + (state.range(0) ? field_size(def.fields[0].type) : 0);
+    const size_t stride = InvCommParser::m_HEADER_LEN + packet_data_len(def);
+    vector<uint8_t> batch = frame_batch(make_packet<PendDataPacket>());
+    vector<double> in(FIELD_BATCH);
+    for (size_t n = 0; n < FIELD_BATCH; ++n) in[n] = 0.01 * static_cast<double>(n);
+    for (auto _ : state) {
+        uint8_t* p = batch.data() + offset;
+        for (size_t n = 0; n < FIELD_BATCH; ++n, p += stride) {
+            if (f.type == FieldType::I16) convert_to_bytes_i16(p, in[n], f.max, f.min, f.scale);
+            else convert_to_bytes_double(p, in[n], f.max, f.min, f.scale);
+        }
+        benchmark::DoNotOptimize(batch.data());
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * FIELD_BATCH);
+}
+BENCHMARK(BM_FieldEncodeSingle)->ArgName("field")->Arg(0)->Arg(1);
+
+
+// ================================================================================
+// Packet validation
+// ================================================================================
+static void BM_ValidatePacket(benchmark::State& state)
+{
+    vector<uint8_t> raw = packet_bytes(make_packet<CartDataPacket>());
+    if (state.range(0) == 0) raw[2] = 7;        // bad length byte
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(InvCommParser::validate_packet(raw.data(), raw.size()));
+    }
+}
+BENCHMARK(BM_ValidatePacket)->ArgName("valid")->Arg(1)->Arg(0);
+
+
+// ================================================================================
+// Parser throughput
+// the stream is fed in receive-sized chunks and every frame is decoded, as the receive path does
+// ================================================================================
+static void parse_stream(benchmark::State& state, const vector<uint8_t>& stream)
+{
+    InvCommParser parser;
+    InvTimestamp toa;
+    unsigned long long frames = 0;
+    for (auto _ : state) {
+        for (size_t i = 0; i < stream.size(); i += RX_CHUNK_LEN) {
+            parser.next(stream.data() + i, min(RX_CHUNK_LEN, stream.size() - i), toa);
+            CommFrame frame;
+            while (parser.get_next_packet(frame)) {
+                if (frame.data[1] == PacketId::CART_DATA) {
+                    auto packet = decode_packet<CartDataPacket>(frame);
+                    benchmark::DoNotOptimize(static_cast<bool>(packet));
+                }
+                else {
+                    auto packet = decode_packet<PendDataPacket>(frame);
+                    benchmark::DoNotOptimize(static_cast<bool>(packet));
+                }
+                ++frames;
+            }
+        }
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * stream.size()));
+    state.counters["frames/s"] = benchmark::Counter(static_cast<double>(frames), benchmark::Counter::kIsRate);
+    state.counters["discarded"] = static_cast<double>(parser.get_discarded_bytes()) / static_cast<double>(state.iterations());
+}
+
+static void BM_ParserValid(benchmark::State& state)
+{
+    parse_stream(state, make_stream(STREAM_LEN));
+}
+BENCHMARK(BM_ParserValid);
+
+// about one byte in every_n is noise, the parser resynchronises on the next header
+static void BM_ParserCorrupted(benchmark::State& state)
+{
+    parse_stream(state, corrupt_stream(make_stream(STREAM_LEN), static_cast<unsigned int>(state.range(0))));
+}
+BENCHMARK(BM_ParserCorrupted)->ArgName("every_n")->Arg(1000)->Arg(100)->Arg(10);
+
+
+// ================================================================================
+// IPC queue ping-pong
+// round trip of one message to an echo thread and back, the latency of a queue hand-off
+// ================================================================================
+template <typename Q>
+static void queue_ping_pong(benchmark::State& state, Q& ping, Q& pong)
+{
+    std::thread echo([&] {
+        for (;;) {
+            IpcMsg msg = ping.Wait();
+            bool exit = msg.GetId() == IpcMsgId::MSG_EXIT;
+            pong.Send(std::move(msg));
+            if (exit) break;
+        }
+    });
+    for (auto _ : state) {
+        ping.Send(IpcMsg(IpcMsgId::MSG_TICK));
+        benchmark::DoNotOptimize(pong.Wait());
+    }
+    ping.Send(IpcMsg(IpcMsgId::MSG_EXIT));
+    pong.Wait();
+    echo.join();
+}
+
+static void BM_IpcQueuePingPong(benchmark::State& state)
+{
+    IpcQueue<IpcMsg> ping, pong;
+    queue_ping_pong(state, ping, pong);
+}
+BENCHMARK(BM_IpcQueuePingPong)->UseRealTime();
+
+static void BM_IpcSpscQueuePingPong(benchmark::State& state)
+{
+    IpcSpscQueue<IpcMsg, 64> ping, pong;
+    queue_ping_pong(state, ping, pong);
+}
+BENCHMARK(BM_IpcSpscQueuePingPong)->UseRealTime();
+
+
+// ================================================================================
+// IPC queue throughput
+// 1..N producer threads share the iterations, the benchmark thread is the consumer;
+// producers stay at most QUEUE_WINDOW messages ahead so the queue does not grow without bound
+// ================================================================================
+const size_t QUEUE_WINDOW = 1024;
+
+static void BM_IpcQueueThroughput(benchmark::State& state)
+{
+    IpcQueue<IpcMsg> q;
+    const size_t producers = static_cast<size_t>(state.range(0));
+    const size_t total = static_cast<size_t>(state.max_iterations);
+    std::atomic<size_t> sent{ 0 };
+    std::atomic<size_t> taken{ 0 };
+
+    vector<std::thread> threads;
+    for (size_t p = 0; p < producers; ++p) {
+        threads.emplace_back([&, p] {
+            size_t quota = total / producers + (p < total % producers ? 1 : 0);
+            IpcMsg msg(IpcMsgId::MSG_TICK);
+            for (size_t i = 0; i < quota; ++i) {
+                while (sent.load(std::memory_order_relaxed) - taken.load(std::memory_order_relaxed) >= QUEUE_WINDOW) {
+                    ipc_cpu_relax();
+                }
+                sent.fetch_add(1, std::memory_order_relaxed);
+                q.Send(msg);
+            }
+        });
+    }
+    size_t n = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(q.Wait());
+        taken.store(++n, std::memory_order_relaxed);
+    }
+    for (auto& t : threads) t.join();
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations()));
+}
+BENCHMARK(BM_IpcQueueThroughput)->ArgName("producers")->RangeMultiplier(2)->Range(1, 8)->UseRealTime();
+
+
+// ================================================================================
+// Timer period jitter
+// the deviation of each interval from the nominal period, as seen by the thread that takes the tick
+// ================================================================================
+const unsigned int TIMER_PERIOD_MS = 1;
+const int TIMER_TICKS = 500;                // ticks timed per run
+
+static void report_jitter(benchmark::State& state, const InvLatencyHistogram& jitter)
+{
+    InvLatencySummary s = jitter.get_summary();
+    state.counters["jitter_p50_us"] = s.p50 / 1e3;
+    state.counters["jitter_p99_us"] = s.p99 / 1e3;
+    state.counters["jitter_max_us"] = s.max / 1e3;
+}
+
+// IpcTimer messages through a queue, as the main loop takes its control tick
+static void BM_IpcTimerJitter(benchmark::State& state)
+{
+    IpcQueue<IpcMsg> q;
+    IpcTimer<IpcMsg> timer(TIMER_PERIOD_MS, IpcMsg(IpcMsgId::MSG_TICK), q);
+    const int64_t period_ns = static_cast<int64_t>(TIMER_PERIOD_MS) * 1000000;
+    InvLatencyHistogram jitter;
+    q.Wait();
+    int64_t last_ns = ipc_clock_ns();
+    for (auto _ : state) {
+        q.Wait();
+        int64_t now_ns = ipc_clock_ns();
+        jitter.record(std::abs(now_ns - last_ns - period_ns));
+        last_ns = now_ns;
+    }
+    report_jitter(state, jitter);
+}
+BENCHMARK(BM_IpcTimerJitter)->Iterations(TIMER_TICKS)->UseRealTime();
+
+// IpcHighResTimer callbacks, timed in the callback itself
+static std::atomic<uint32_t> g_hrt_ticks{ 0 };
+static void hrt_callback(void)
+{
+    g_hrt_ticks.fetch_add(1, std::memory_order_release);
+    ipc_wake_one(g_hrt_ticks);
+}
+
+static void BM_IpcHighResTimerJitter(benchmark::State& state)
+{
+    IpcHighResTimer timer(TIMER_PERIOD_MS, hrt_callback);
+    for (auto _ : state) {
+        uint32_t ticks = g_hrt_ticks.load(std::memory_order_acquire);
+        while (g_hrt_ticks.load(std::memory_order_acquire) == ticks) {
+            ipc_wait_on_address(g_hrt_ticks, ticks);
+        }
+    }
+    IpcTimerStats stats = timer.get_stats();
+    state.counters["jitter_max_us"] = stats.jitter_max_us;
+    state.counters["late_mean_us"] = stats.late_mean_us;
+    state.counters["late_max_us"] = stats.late_max_us;
+    state.counters["missed"] = static_cast<double>(stats.missed);
+}
+BENCHMARK(BM_IpcHighResTimerJitter)->Iterations(TIMER_TICKS)->UseRealTime();
+
+
+// ================================================================================
+// Model step cost
+// ================================================================================
+static void BM_InvPendModelIterate(benchmark::State& state)
+{
+    InvPendModel model(InvPendModel::States{ 0.0, 0.0, 0.1, 0.0 });
+    for (auto _ : state) {
+        InvPendModel::Outputs y = model.iterate_100hz(InvPendModel::Inputs{ model.feedback(0.2) });
+        benchmark::DoNotOptimize(y);
+    }
+}
+BENCHMARK(BM_InvPendModelIterate);
+
+static void BM_InvPendModelTick(benchmark::State& state)
+{
+    InvPendModel model(InvPendModel::States{ 0.0, 0.0, 0.1, 0.0 });
+    for (auto _ : state) {
+        model.on_tick_100hz(model.feedback(0.2));
+        benchmark::DoNotOptimize(model.get_cart().get_pos());
+    }
+}
+BENCHMARK(BM_InvPendModelTick);
+
+
+// ================================================================================
+// Fleet step throughput
+// plant-steps per second of a fleet on 1..N threads, with the Model.h plant shared by every plant
+// and with coefficients per plant; the command flips every iteration so the states never settle
+// ================================================================================
+const size_t FLEET_PLANTS = 64 * 1024;
+const unsigned int FLEET_TICKS = 100;           // ticks per iteration
+
+static void fleet_step(benchmark::State& state, bool per_plant)
+{
+    InvPendFleet fleet(FLEET_PLANTS, static_cast<unsigned int>(state.range(0)));
+    const InvPendFleet::PlantParams p = InvPendFleet::default_params();
+    for (size_t i = 0; i < FLEET_PLANTS; ++i) {
+        fleet.set_states(i, InvPendModel::States{ 0.0, 0.0, 0.1, 0.0 });
+        if (per_plant) fleet.set_params(i, p);
+    }
+    double cmd = 0.2;
+    for (auto _ : state) {
+        fleet.set_pos_cmd_all(cmd);
+        fleet.step(FLEET_TICKS);
+        benchmark::DoNotOptimize(fleet.get_force(0));
+        cmd = -cmd;
+    }
+    state.counters["plant_steps/s"] = benchmark::Counter(static_cast<double>(state.iterations()) * FLEET_PLANTS * FLEET_TICKS,
+        benchmark::Counter::kIsRate);
+}
+
+static void BM_FleetStepShared(benchmark::State& state)
+{
+    fleet_step(state, false);
+}
+BENCHMARK(BM_FleetStepShared)->ArgName("threads")->RangeMultiplier(2)->Range(1, 8)->UseRealTime();
+
+static void BM_FleetStepPerPlant(benchmark::State& state)
+{
+    fleet_step(state, true);
+}
+BENCHMARK(BM_FleetStepPerPlant)->ArgName("threads")->RangeMultiplier(2)->Range(1, 8)->UseRealTime();
+
+
+BENCHMARK_MAIN();
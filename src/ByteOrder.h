@@ -0,0 +1,97 @@
+// Byte order conversion for network-order data
+// single values and batches, on raw byte pointers
+
+#ifndef __BYTE_ORDER_H__
+#define __BYTE_ORDER_H__
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#if defined(_MSC_VER)
+#include <stdlib.h>
+#endif
+
+namespace inv_example {
+
+// ================================================================================
+// Host byte order, detected at compile time
+// ================================================================================
+#if defined(__BYTE_ORDER__) && defined(__ORDER_BIG_ENDIAN__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+const bool HOST_BIG_ENDIAN = true;
+#elif defined(__BYTE_ORDER__) || defined(_WIN32)
+const bool HOST_BIG_ENDIAN = false;
+#else
+#error "Unable to detect the host byte order"
+#endif
+
+
+// ================================================================================
+// Byte swap, compiles to a single instruction where the compiler has an intrinsic
+// ================================================================================
+inline uint8_t bswap(uint8_t v) { return v; }
+#if defined(_MSC_VER)
+inline uint16_t bswap(uint16_t v) { return _byteswap_ushort(v); }
+inline uint32_t bswap(uint32_t v) { return _byteswap_ulong(v); }
+inline uint64_t bswap(uint64_t v) { return _byteswap_uint64(v); }
+#else
+inline uint16_t bswap(uint16_t v) { return __builtin_bswap16(v); }
+inline uint32_t bswap(uint32_t v) { return __builtin_bswap32(v); }
+inline uint64_t bswap(uint64_t v) { return __builtin_bswap64(v); }
+#endif
+
+
+// ========================================
+// Unsigned integer with the same size as T
+// the bit pattern of T is swapped through this type
+// ========================================
+template <size_t N> struct EndianBits;
+template <> struct EndianBits<1> { typedef uint8_t type; };
+template <> struct EndianBits<2> { typedef uint16_t type; };
+template <> struct EndianBits<4> { typedef uint32_t type; };
+template <> struct EndianBits<8> { typedef uint64_t type; };
+
+
+// ================================================================================
+// Single value codec
+// ================================================================================
+// Store a value at pdest in network order
+// returns pointer to the next byte
+template <typename T>
+inline uint8_t* store_be(uint8_t* pdest, T v)
+{
+    typename EndianBits<sizeof(T)>::type bits;
+    std::memcpy(&bits, &v, sizeof(bits));
+    if (!HOST_BIG_ENDIAN) bits = bswap(bits);      // resolved at compile time
+    std::memcpy(pdest, &bits, sizeof(bits));
+    return pdest + sizeof(bits);
+}
+
+// Load a network-order value from p
+template <typename T>
+inline T load_be(const uint8_t* p)
+{
+    typename EndianBits<sizeof(T)>::type bits;
+    std::memcpy(&bits, p, sizeof(bits));
+    if (!HOST_BIG_ENDIAN) bits = bswap(bits);
+    T v;
+    std::memcpy(&v, &bits, sizeof(bits));
+    return v;
+}
+
+
+// ================================================================================
+// Batch codec
+// strided loads for decode_field_array, used to dump recorded traffic
+// ================================================================================
+// Load n network-order values, one every stride bytes
+// used to read the same field of consecutive packets
+template <typename T>
+inline void load_be_strided(T* dest, const uint8_t* p, size_t stride, size_t n)
+{
+    for (size_t i = 0; i < n; ++i) {
+        dest[i] = load_be<T>(p + i * stride);
+    }
+}
+
+} // namespace inv_example
+#endif // __BYTE_ORDER_H__
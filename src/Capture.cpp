@@ -0,0 +1,241 @@
+// Packet capture and replay implementation
+
+#include <cstring>
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+#include "Capture.h"
+#include "System.h"
+#include "Error.h"
+
+namespace inv_example {
+// ================================================================================
+// Packet capture
+// ================================================================================
+// create the file and start the writer thread
+CommCapture::CommCapture(const std::string& file_name)
+    : m_file(file_name, std::ios::binary | std::ios::trunc),
+    m_write_failed(false)
+{
+    CapFileHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, CAP_FILE_MAGIC, sizeof(header.magic));
+    header.version = CAP_FILE_VERSION;
+    header.byte_order = REC_BYTE_ORDER_MARK;
+    header.start_ns = rec_time_ns(InvTimestamp());
+    header.start_wall_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    m_file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    if (!m_file) {
+        enqueue_error(NewInvError(SYSERR_CAPTURE_OPEN_FAILED));
+        return;                         // not capturing, buffers are discarded
+    }
+
+    m_thread = std::thread(&CommCapture::writer_thread, this);
+}
+
+// stop the writer once the rings are empty
+CommCapture::~CommCapture()
+{
+    if (!is_open()) return;
+    m_stop.store(true, std::memory_order_release);
+    m_thread.join();
+}
+
+// queue a received buffer
+// room for every chunk is reserved before any is queued, so a buffer is captured whole or not at all;
+// the bytes are copied before the call returns, the buffer can be reused at once
+bool CommCapture::capture(CommLink link, const uint8_t* buf, size_t len, const InvTimestamp& toa)
+{
+    if (!is_open()) return false;
+    IpcSpscQueue<Entry, QUEUE_LEN>& ring = m_ring[static_cast<int>(link) % COMM_NUM_LINKS];
+    size_t chunks = (len + CAP_MAX_CHUNK - 1) / CAP_MAX_CHUNK;
+    if (ring.Space() < chunks) {
+        m_dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    Entry entry;
+    std::memset(&entry.header, 0, sizeof(entry.header));
+    entry.header.t_ns = rec_time_ns(toa);
+    entry.header.link = static_cast<uint8_t>(link);
+    while (len > 0) {
+        size_t n = std::min(len, CAP_MAX_CHUNK);
+        entry.header.len = static_cast<uint16_t>(n);
+        std::memcpy(entry.bytes, buf, n);
+        ring.Send(entry);               // reserved above
+        buf += n;
+        len -= n;
+    }
+    return true;
+}
+
+// queue a received buffer, waiting for the writer thread to make room
+void CommCapture::capture_wait(CommLink link, const uint8_t* buf, size_t len, const InvTimestamp& toa)
+{
+    if (!is_open()) return;
+    size_t chunks = (len + CAP_MAX_CHUNK - 1) / CAP_MAX_CHUNK;
+    if (chunks > QUEUE_LEN) {           // can never fit
+        m_dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    while (m_ring[static_cast<int>(link) % COMM_NUM_LINKS].Space() < chunks) std::this_thread::yield();
+    capture(link, buf, len, toa);
+}
+
+// Writer thread
+// takes a batch from each ring, merges them by time of arrival and appends each chunk padded to 8 bytes;
+// the file is flushed once per batch, and the thread sleeps while the rings are empty
+void CommCapture::writer_thread(void)
+{
+    static const char pad[8] = {};
+    std::vector<Entry> batch;
+    batch.reserve(BATCH_LEN * COMM_NUM_LINKS);
+    for (;;) {
+        bool stop = m_stop.load(std::memory_order_acquire);    // before the drain, so nothing queued before the stop is left
+        batch.clear();
+        for (auto& ring : m_ring) {
+            size_t first = batch.size();
+            ring.Drain(batch, BATCH_LEN);
+            std::inplace_merge(batch.begin(), batch.begin() + first, batch.end(), [](const Entry& a, const Entry& b) {
+                return a.header.t_ns < b.header.t_ns;
+            });
+        }
+        if (batch.empty()) {
+            if (stop) break;
+            std::this_thread::sleep_for(std::chrono::milliseconds(WRITER_POLL_MS));
+            continue;
+        }
+        for (auto& entry : batch) {
+            m_file.write(reinterpret_cast<const char*>(&entry.header), sizeof(entry.header));
+            m_file.write(reinterpret_cast<const char*>(entry.bytes), entry.header.len);
+            m_file.write(pad, (8 - entry.header.len % 8) % 8);
+        }
+        m_file.flush();
+        if (!m_file && !m_write_failed) {
+            m_write_failed = true;
+            enqueue_error(NewInvError(SYSERR_CAPTURE_WRITE_FAILED));
+        }
+    }
+    m_file.close();
+}
+
+
+// ================================================================================
+// Capture file reader
+// ================================================================================
+// map the file and check its header
+CaptureReader::CaptureReader(const std::string& file_name)
+    : m_file(file_name),
+    m_header(reinterpret_cast<const CapFileHeader*>(m_file.data())),
+    m_pos(sizeof(CapFileHeader))
+{
+    if (m_file.size() < sizeof(CapFileHeader) || std::memcmp(m_header->magic, CAP_FILE_MAGIC, sizeof(m_header->magic)) != 0 ||
+        m_header->version != CAP_FILE_VERSION || m_header->byte_order != REC_BYTE_ORDER_MARK) {
+        throw NewInvError(SYSERR_CAPTURE_BAD_FILE);
+    }
+}
+
+// the next chunk
+bool CaptureReader::next(CapChunk& chunk)
+{
+    if (m_pos + sizeof(CapChunkHeader) > m_file.size()) return false;
+    const CapChunkHeader* h = reinterpret_cast<const CapChunkHeader*>(m_file.data() + m_pos);
+    size_t end = m_pos + sizeof(CapChunkHeader) + ((h->len + 7u) & ~7u);
+    if (end > m_file.size() || h->len > CAP_MAX_CHUNK || h->link >= COMM_NUM_LINKS) return false;  // incomplete or damaged
+
+    chunk.t_ns = h->t_ns;
+    chunk.link = static_cast<CommLink>(h->link);
+    chunk.data = m_file.data() + m_pos + sizeof(CapChunkHeader);
+    chunk.len = h->len;
+    m_pos = end;
+    return true;
+}
+
+
+// ================================================================================
+// Capture replay
+// ================================================================================
+void CaptureReplay::finish(ReplayStats& stats)
+{
+    stats.frames_per_s = stats.wall_s > 0.0 ? stats.frames / stats.wall_s : 0.0;
+    stats.ns_per_frame = stats.frames > 0 ? stats.wall_s * 1e9 / stats.frames : 0.0;
+}
+
+
+// ================================================================================
+// Capture export
+// ================================================================================
+const size_t CAP_EXPORT_BATCH = 1024;   // frames decoded at once
+
+// column names of the fields of a packet type
+static const char* cap_field_names(PacketId id)
+{
+    switch (id) {
+    case PacketId::FORCE_CMD:   return "ForceCmd";
+    case PacketId::CART_DATA:   return "CartPos,CartVel";
+    case PacketId::LOCK_CMD:    return "Lock";
+    case PacketId::PEND_DATA:   return "PendPosDeg,PendVel";
+    default:                    return "";
+    }
+}
+
+bool cap_export_csv(const std::string& file_name, PacketId id, std::ostream& out)
+{
+    try {
+        CaptureReader reader(file_name);
+        const CommPacketDef& def = comm_packet_def(id);
+        const size_t len = InvCommParser::m_HEADER_LEN + packet_data_len(def);
+        int64_t t0 = 0;
+
+        std::vector<uint8_t> frames;    // frames of the type back to back, len bytes apart
+        std::vector<int64_t> t_ns;
+        std::vector<uint8_t> links;
+        std::vector<double> values[COMM_MAX_FIELDS];
+        frames.reserve(CAP_EXPORT_BATCH * len);
+        for (auto& v : values) v.resize(CAP_EXPORT_BATCH);
+
+        // decode each field of the batch, then write it a frame per line
+        auto flush = [&]() {
+            const size_t n = t_ns.size();
+            size_t offset = InvCommParser::m_HEADER_LEN;
+            for (unsigned int f = 0; f < def.num_fields; ++f) {
+                decode_field_array(def.fields[f], frames.data() + offset, len, values[f].data(), n);
+                offset += field_size(def.fields[f].type);
+            }
+            for (size_t i = 0; i < n; ++i) {
+                out << std::setprecision(4) << (t_ns[i] - t0) / 1e9 << ',' << (links[i] == static_cast<uint8_t>(CommLink::CART) ? "cart" : "pend");
+                out << std::setprecision(6);
+                for (unsigned int f = 0; f < def.num_fields; ++f) out << ',' << values[f][i];
+                out << '\n';
+            }
+            frames.clear();
+            t_ns.clear();
+            links.clear();
+        };
+
+        out << "Time,Link" << (def.num_fields ? "," : "") << cap_field_names(id) << '\n';
+        out << std::fixed;
+        InvCommParser parser[COMM_NUM_LINKS];
+        CapChunk chunk;
+        for (bool first = true; reader.next(chunk); first = false) {
+            if (first) t0 = chunk.t_ns;
+            const int link = static_cast<int>(chunk.link) % COMM_NUM_LINKS;
+            InvCommParser& p = parser[link];
+            p.next(chunk.data, chunk.len, rec_timestamp(chunk.t_ns));
+            CommFrame frame;
+            while (p.get_next_packet(frame)) {
+                if (frame.data[1] != id || frame.len != len) continue;
+                frames.insert(frames.end(), frame.data, frame.data + len);
+                t_ns.push_back(rec_time_ns(frame.toa));
+                links.push_back(static_cast<uint8_t>(link));
+                if (t_ns.size() == CAP_EXPORT_BATCH) flush();
+            }
+        }
+        flush();
+        return true;
+    }
+    catch (const InvError&) {
+        return false;
+    }
+}
+
+} // namespace inv_example
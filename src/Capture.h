@@ -0,0 +1,208 @@
+// Packet capture and replay definitions
+
+#ifndef __CAPTURE_H__
+#define __CAPTURE_H__
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include "Ipc.h"
+#include "Comms.h"
+#include "Messages.h"
+#include "Recorder.h"
+#include "Timestamp.h"
+
+namespace inv_example {
+// ================================================================================
+// Capture file format
+// every buffer received on the serial links, as received, with its time of arrival
+//   file header
+//   chunk header, then len bytes padded to 8
+//   ... more chunks in order of arrival
+// ================================================================================
+const char CAP_FILE_MAGIC[8] = { 'I', 'N', 'V', 'C', 'A', 'P', '1', '\0' };
+const uint32_t CAP_FILE_VERSION = 1;
+const size_t CAP_MAX_CHUNK = 256;                   // longer buffers are split into chunks with the same time
+
+struct CapFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;                // REC_BYTE_ORDER_MARK
+    int64_t start_ns;                   // steady clock at the start of the capture
+    int64_t start_wall_ns;              // system clock at the same moment, ns since 1970
+};
+static_assert(sizeof(CapFileHeader) == 32, "CapFileHeader layout");
+
+struct CapChunkHeader {
+    int64_t t_ns;                       // time of arrival, steady clock, see rec_time_ns
+    uint16_t len;                       // bytes in the chunk
+    uint8_t link;                       // CommLink
+    uint8_t reserved[5];
+};
+static_assert(sizeof(CapChunkHeader) == 16, "CapChunkHeader layout");
+
+
+// ================================================================================
+// Packet capture
+// the receive thread of each link copies each buffer into the lock-free ring of the link, a writer thread
+// polls the rings and appends the chunks to the file in order of arrival; capture() never locks or allocates
+// the rings are large, create the capture on the heap
+// ================================================================================
+class CommCapture
+{
+public: // constructors
+    // create the file; if it can not be created the error is reported and the buffers are discarded
+    explicit CommCapture(const std::string& file_name);
+    CommCapture(const CommCapture&) = delete;
+    ~CommCapture();                     // write the buffers still queued and close the file
+
+public: // methods
+    bool is_open(void) const { return m_thread.joinable(); };
+    // queue a received buffer, false if the ring has no room for all of its chunks and the buffer was dropped;
+    // only called by the receive thread of the link
+    bool capture(CommLink link, const uint8_t* buf, size_t len, const InvTimestamp& toa);
+    // queue a received buffer, waiting for room; for callers that are not real time
+    void capture_wait(CommLink link, const uint8_t* buf, size_t len, const InvTimestamp& toa);
+    unsigned long long get_dropped(void) const { return m_dropped.load(std::memory_order_relaxed); };
+
+public: // constants
+    static const size_t QUEUE_LEN = 4096;       // most chunks of each link waiting for the writer
+    static const size_t BATCH_LEN = 256;        // chunks taken from each ring per pass
+    static const int WRITER_POLL_MS = 10;       // writer sleep when the rings are empty
+
+private: // types
+    struct Entry {
+        CapChunkHeader header;
+        uint8_t bytes[CAP_MAX_CHUNK];
+    };
+
+private: // methods
+    void writer_thread(void);
+
+private: // data
+    IpcSpscQueue<Entry, QUEUE_LEN> m_ring[COMM_NUM_LINKS];
+    std::ofstream m_file;
+    bool m_write_failed;                // reported once
+    std::atomic<bool> m_stop{ false };  // write what is queued and stop
+    std::atomic<unsigned long long> m_dropped{ 0 };
+    std::thread m_thread;
+};
+
+
+// ================================================================================
+// Capture file reader
+// maps the file and steps through its chunks; an incomplete chunk at the end is ignored
+// ================================================================================
+struct CapChunk {
+    int64_t t_ns;
+    CommLink link;
+    const uint8_t* data;
+    size_t len;
+};
+
+class CaptureReader
+{
+public: // constructors
+    explicit CaptureReader(const std::string& file_name);  // throws InvError if it can not be mapped or is not a capture file
+    CaptureReader(const CaptureReader&) = delete;
+
+public: // methods
+    const CapFileHeader& get_header(void) const { return *m_header; };
+    bool next(CapChunk& chunk);         // the next chunk, false at the end of the file
+    void rewind(void) { m_pos = sizeof(CapFileHeader); };
+
+private: // data
+    IpcMappedFile m_file;
+    const CapFileHeader* m_header;
+    size_t m_pos;                       // offset of the next chunk
+};
+
+
+// ================================================================================
+// Capture replay
+// feeds each chunk of a capture through a parser per link, as the receive path does,
+// and passes every frame to the sink as an IpcMsg; at the original speed or as fast as possible
+// ================================================================================
+struct ReplayStats {
+    unsigned long long chunks;
+    unsigned long long bytes;
+    unsigned long long frames;
+    unsigned long long discarded_bytes; // skipped by the parsers while searching for a header
+    double capture_s;                   // time from the first to the last chunk of the capture
+    double wall_s;
+    double frames_per_s;
+    double ns_per_frame;
+};
+
+class CaptureReplay
+{
+public: // constructors
+    explicit CaptureReplay(const std::string& file_name) : m_reader(file_name) {};  // throws InvError if not a capture file
+
+public: // methods
+    // replay the whole capture, calling sink(IpcMsg&&) for every frame;
+    // clock(int64_t t_ns) is called before each chunk with its capture time, for the caller to send the messages
+    // of its virtual clock that are due before the chunk, and once more after the last chunk, just past its time;
+    // in real time each chunk is delivered at its original time after the first;
+    // the parser sees the captured times of arrival, so the frames carry them as they were captured,
+    // and the messages take their latency stamps from the time each chunk is delivered, as a receive thread would;
+    // each message is set to the capture time of the chunk that completed its frame on the virtual clock
+    template<typename F, typename C>
+    ReplayStats run(F sink, C clock, bool real_time)
+    {
+        InvCommParser parser[COMM_NUM_LINKS];
+        ReplayStats stats{ 0, 0, 0, 0, 0.0, 0.0, 0.0, 0.0 };
+        m_reader.rewind();
+        CapChunk chunk;
+        int64_t t0 = 0, t_last = 0;
+        auto wall0 = std::chrono::steady_clock::now();
+        while (m_reader.next(chunk)) {
+            if (stats.chunks++ == 0) t0 = chunk.t_ns;
+            if (real_time) std::this_thread::sleep_until(wall0 + std::chrono::nanoseconds(chunk.t_ns - t0));
+            clock(chunk.t_ns);
+            InvCommParser& p = parser[static_cast<int>(chunk.link) % COMM_NUM_LINKS];
+            const InvTimestamp delivered = InvTimestamp::fast();
+            p.next(chunk.data, chunk.len, rec_timestamp(chunk.t_ns));
+            CommFrame frame;
+            while (p.get_next_packet(frame)) {
+                ++stats.frames;
+                IpcMsg msg = make_frame_msg(frame, delivered);
+                msg.SetClockNs(chunk.t_ns);
+                sink(std::move(msg));
+            }
+            stats.bytes += chunk.len;
+            stats.capture_s = (chunk.t_ns - t0) / 1e9;
+            t_last = chunk.t_ns;
+        }
+        if (stats.chunks > 0) clock(t_last + 1);
+        stats.wall_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - wall0).count();
+        for (auto& p : parser) stats.discarded_bytes += p.get_discarded_bytes();
+        finish(stats);
+        return stats;
+    };
+
+private: // methods
+    static void finish(ReplayStats& stats);     // rates from the counts and the wall time
+
+private: // data
+    CaptureReader m_reader;
+};
+
+
+// ================================================================================
+// Capture export
+// the frames of one packet type in a capture as CSV, one line per frame:
+//   Time,Link,<fields of the packet type>
+// time in s from the first chunk, as the replay counts it; the frames are collected in batches and each field is decoded
+// for the whole batch at once, see decode_field_array
+// ================================================================================
+bool cap_export_csv(const std::string& file_name, PacketId id, std::ostream& out);    // false if the file can not be read
+
+} // namespace inv_example
+
+#endif // __CAPTURE_H__
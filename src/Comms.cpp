@@ -1,263 +1,298 @@
 // Implementation of interface messages
 
 #include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <vector>
 #include "System.h"
-#include "comms.h"
-#include "error.h"
+#include "Comms.h"
+#include "Error.h"
 
 using namespace std;
 namespace inv_example {
 
 // ================================================================================
-// Endian conversion routines
+// Batch field conversion
 // ================================================================================
-// Convert double to a network-order vector of bytes
-// assumes host is little-endian
-// returns pointer to next available data byte
-vector<uint8_t>::iterator convert_to_bytes_double(vector<uint8_t>::iterator pdest, double d, double max, double min, double scale)
+// decode one field from n packets
+void decode_field_array(const CommFieldDef& f, const uint8_t* p, size_t stride, double* out, size_t n)
 {
-    union {
-        double d;
-        uint8_t v[sizeof(double)];
-    } conv;
-
-    d = std::min(d, max);
-    d = std::max(d, min);
-    conv.d = d / scale;             // convert double to raw
-    reverse_copy(conv.v, &conv.v[sizeof(conv.v)], pdest);
-
-    return pdest + sizeof(conv.v);
+    switch (f.type) {
+    case FieldType::F64:    load_be_strided(out, p, stride, n);     break;
+    case FieldType::I16:
+        for (size_t i = 0; i < n; ++i) out[i] = load_be<int16_t>(p + i * stride);
+        break;
+    case FieldType::U8:
+        for (size_t i = 0; i < n; ++i) out[i] = p[i * stride];
+        break;
+    }
+    // scale and limit in a separate pass so both loops vectorize
+    for (size_t i = 0; i < n; ++i) {
+        out[i] = std::max(std::min(out[i] * f.scale, f.max), f.min);
+    }
 }
 
-// Convert signed 16-bit int to a network-order vector of bytes
-// assumes host is little-endian
-// returns pointer to next available data byte
-vector<uint8_t>::iterator convert_to_bytes_i16(vector<uint8_t>::iterator pdest, double d, double max, double min, double scale)
+// encode one field into n packets
+void encode_field_array(const CommFieldDef& f, uint8_t* p, size_t stride, const double* in, size_t n)
 {
-    union {
-        int16_t  d;
-        uint8_t v[sizeof(int16_t)];
-    } conv;
-
-    d = std::min(d, max);
-    d = std::min(d, static_cast<double>(INT16_MAX));
-    d = std::max(d, min);
-    d = std::max(d, static_cast<double>(INT16_MIN));
-    conv.d = static_cast<int16_t>(d / scale);
-    reverse_copy(conv.v, &conv.v[sizeof(conv.v)], pdest);
-
-    return pdest + sizeof(conv.v);
+    switch (f.type) {
+    case FieldType::F64:
+        for (size_t i = 0; i < n; ++i) convert_to_bytes_double(p + i * stride, in[i], f.max, f.min, f.scale);
+        break;
+    case FieldType::I16:
+        for (size_t i = 0; i < n; ++i) convert_to_bytes_i16(p + i * stride, in[i], f.max, f.min, f.scale);
+        break;
+    case FieldType::U8:
+        for (size_t i = 0; i < n; ++i) convert_to_bytes_u8(p + i * stride, in[i], f.max, f.min, f.scale);
+        break;
+    }
 }
 
-// Convert an array of bytes in network order to a double
-// assumes host is little-endian
-// returns decoded double and pointer to the next data byte
-pair<double, vector<uint8_t>::const_iterator> bytes_to_double(vector<uint8_t>::const_iterator p, double max, double min, double scale)
-{
-    union {
-        double d;
-        uint8_t v[sizeof(double)];
-    } conv;
-
-    reverse_copy(p, p + sizeof(conv.v), conv.v);
-    double dout = conv.d * scale;
-    dout = std::min(dout, max);
-    dout = std::max(dout, min);
-    return make_pair(dout, p += sizeof(conv.v));
-}
+// ========================================
+// Batch codec self-check
+// ========================================
+const size_t CODEC_CHECK_PACKETS = 1000;
 
-// Convert an array of bytes in network order to a signed 16-bit int
-// assumes host is little-endian
-// returns decoded int and pointer to the next data byte
-pair<int16_t, vector<uint8_t>::const_iterator> bytes_to_i16(vector<uint8_t>::const_iterator p, double max, double min, double scale)
+bool comm_codec_check(std::ostream& os)
 {
-    union {
-        int16_t d;
-        uint8_t v[sizeof(int16_t)];
-    } conv;
-
-    reverse_copy(p, p + sizeof(conv.v), conv.v);
-    double dout = conv.d * scale;
-    dout = std::min(dout, max);
-    dout = std::max(dout, min);
-    return make_pair(conv.d, p += sizeof(conv.v));      // implicit cast
+    std::mt19937_64 rng(1);             // the same values on every run
+    unsigned long long fields = 0, mismatches = 0;
+    for (const CommPacketDef& def : COMM_PACKET_DEFS) {
+        const size_t len = InvCommParser::m_HEADER_LEN + packet_data_len(def);
+        size_t offset = InvCommParser::m_HEADER_LEN;
+        for (unsigned int i = 0; i < def.num_fields; ++i) {
+            const CommFieldDef& f = def.fields[i];
+            // values over the raw range of the field, a tenth of them beyond its limits
+            const double lo = std::max(f.min, -1e6), hi = std::min(f.max, 1e6);
+            std::uniform_real_distribution<double> dist(lo - 0.05 * (hi - lo), hi + 0.05 * (hi - lo));
+            std::vector<double> in(CODEC_CHECK_PACKETS), batch_out(CODEC_CHECK_PACKETS);
+            for (auto& v : in) v = dist(rng);
+
+            std::vector<uint8_t> batch(len * CODEC_CHECK_PACKETS), single(len * CODEC_CHECK_PACKETS);
+            encode_field_array(f, batch.data() + offset, len, in.data(), in.size());
+            decode_field_array(f, batch.data() + offset, len, batch_out.data(), batch_out.size());
+            for (size_t n = 0; n < CODEC_CHECK_PACKETS; ++n) {
+                uint8_t* p = single.data() + n * len + offset;
+                double out = 0.0;
+                switch (f.type) {
+                case FieldType::F64:
+                    convert_to_bytes_double(p, in[n], f.max, f.min, f.scale);
+                    out = bytes_to_double(p, f.max, f.min, f.scale).first;
+                    break;
+                case FieldType::I16:
+                    convert_to_bytes_i16(p, in[n], f.max, f.min, f.scale);
+                    out = bytes_to_i16(p, f.max, f.min, f.scale).first;
+                    break;
+                case FieldType::U8:
+                    convert_to_bytes_u8(p, in[n], f.max, f.min, f.scale);
+                    out = bytes_to_u8(p, f.max, f.min, f.scale).first;
+                    break;
+                }
+                if (std::memcmp(p, batch.data() + n * len + offset, field_size(f.type)) != 0 || out != batch_out[n]) {
+                    ++mismatches;
+                }
+            }
+            fields += CODEC_CHECK_PACKETS;
+            offset += field_size(f.type);
+        }
+    }
+    bool ok = mismatches == 0;
+    os << "Batch field codec vs per-field codec, " << fields << " fields: " << mismatches << " mismatches"
+        << (ok ? ", ok" : ", FAILED") << std::endl;
+    return ok;
 }
 
+
 // ================================================================================
 // Communication Packet Parser implementation
 // ================================================================================
 // ========================================
 // Lookup table of valid msg length vs msg ID
-// length is for the data portion only
+// generated from COMM_PACKET_DEFS at compile time
 // ========================================
-const map<PacketId, unsigned int> InvCommParser::m_packet_id_table{
-    { PacketId::FORCE_CMD, 8 },
-    { PacketId::CART_DATA, 16 },
-    { PacketId::POLL_CMD, 0 },
-    { PacketId::LOCK_CMD, 1 },
-    { PacketId::KEEPALIVE_CMD, 0 },
-    { PacketId::PEND_DATA, 10 },
-};
-
-// ========================================
-// Look up the message length from the table
-// ========================================
-unsigned int InvCommParser::lookup_data_len(PacketId id)
-{
-    try {
-        return m_packet_id_table.at(id);
-    }
-    catch (out_of_range) {
-        return 0;                     // return zero if ID is not recognized  TODO handle error
-    }
-}
+constexpr CommPacketTable InvCommParser::m_packet_id_table;
 
 // ========================================
 // Check if a string of bytes is a valid message
 // ========================================
-bool InvCommParser::validate_packet(std::vector<uint8_t> packet)
+bool InvCommParser::validate_packet(const uint8_t* packet, size_t len)
 {
-    if (packet.size() < m_HEADER_LEN || packet[0] != m_HEADER) return false;  // no header or bad header
-    PacketId id = static_cast<PacketId>(packet[1]);
-    unsigned int len = packet[2];
-    auto p = m_packet_id_table.find(id);
-    if (p == m_packet_id_table.end()) return false;         // undefined type
-    if (p->second != len) return false;                     // unexpected length
-    if (packet.size() < m_HEADER_LEN + len) return false;   // not all bytes received
+    if (len < m_HEADER_LEN || packet[0] != m_HEADER) return false;    // no header or bad header
+    unsigned int data_len = packet[2];
+    if (m_packet_id_table.data_len[packet[1]] != static_cast<int>(data_len)) return false;  // undefined type or unexpected length
+    if (len < m_HEADER_LEN + data_len) return false;                  // not all bytes received
     return true;
 }
 
 // ========================================
-// Create message template with ID and correct length
+// Parse the next received byte
+// returns true if the byte completed a frame
+// a byte that may start a frame is stamped with the fast clock
 // ========================================
-CommPacketBase::CommPacketBase(PacketId id)
+bool InvCommParser::next(uint8_t b)
 {
-    m_raw.clear();
-    m_raw.push_back(InvCommParser::m_HEADER);
-    m_raw.push_back(static_cast<unsigned int>(id)& 0xff);
-    unsigned int data_len = InvCommParser::lookup_data_len(id);
-    m_raw.push_back(data_len & 0xff);
-    m_raw.insert(m_raw.end(), data_len, 0);     // clear data section
-
-    m_toa = InvTimestamp();                     // timestamp with current time
+    unsigned int frames = m_wr;
+    parse_byte(b, m_state == ParserState::HEADER ? InvTimestamp::fast() : m_frames[m_wr % m_FRAME_RING_LEN].toa);
+    return m_wr != frames;
 }
 
-
 // ========================================
-// Cart Force Cmd
+// Parse a buffer of received bytes
+// frames that start in this buffer are stamped with toa
+// returns the number of frames completed
 // ========================================
-// decode the data from received bytes
-CartForceCmdPacket::CartForceCmdPacket(std::vector<uint8_t> packet, InvTimestamp toa)
-    : CommPacketBase(packet, toa)
+unsigned int InvCommParser::next(const uint8_t* buf, size_t len, InvTimestamp toa)
 {
-    if (!InvCommParser::validate_packet(packet) || get_id() != PacketId::FORCE_CMD) {
-        throw NewInvError(SYSERR_CART_FORCE_MSG_PARSE);
+    unsigned int frames = m_wr;
+    for (const uint8_t* end = buf + len; buf != end; ++buf) {
+        parse_byte(*buf, toa);
     }
-    // parse data members
-    m_force = bytes_to_double(get_data(), m_MAX_FORCE, m_MIN_FORCE, m_SCALE_FORCE).first;
+    return m_wr - frames;
 }
 
-
-// encode a packet from data
-CartForceCmdPacket::CartForceCmdPacket(double force)
-    : m_force(force), CommPacketBase(PacketId::FORCE_CMD)
+// ========================================
+// Get the oldest complete frame
+// the frame data is a view into the parser and is only valid until the next call to next()
+// ========================================
+bool InvCommParser::get_next_packet(CommFrame& frame)
 {
-    convert_to_bytes_double(get_data(), m_force, m_MAX_FORCE, m_MIN_FORCE, m_SCALE_FORCE);
+    if (m_rd == m_wr) return false;     // nothing ready
+    const FrameSlot& slot = m_frames[m_rd % m_FRAME_RING_LEN];
+    frame.data = slot.bytes;
+    frame.len = slot.len;
+    frame.toa = slot.toa;
+    ++m_rd;
+    return true;
 }
 
-
 // ========================================
-// Cart Data Packet
+// Parser state machine
 // ========================================
-// decode the data from received bytes
-CartDataPacket::CartDataPacket(std::vector<uint8_t> packet, InvTimestamp toa)
-    : CommPacketBase(packet, toa)
+void InvCommParser::parse_byte(uint8_t b, const InvTimestamp& toa)
 {
-    if (!InvCommParser::validate_packet(packet) || get_id() != PacketId::CART_DATA) {
-        throw NewInvError(SYSERR_CART_DATA_MSG_PARSE);
+    FrameSlot& slot = m_frames[m_wr % m_FRAME_RING_LEN];
+
+    switch (m_state) {
+    case ParserState::HEADER:
+        if (b == m_HEADER) {
+            start_frame(b, toa);
+        }
+        else {
+            ++m_discarded_bytes;        // noise between frames
+        }
+        break;
+
+    case ParserState::TYPE:
+        if (m_packet_id_table.data_len[b] < 0) {
+            resync(b, toa);             // undefined type
+            break;
+        }
+        slot.bytes[m_pos++] = b;
+        m_data_len = m_packet_id_table.data_len[b];
+        m_state = ParserState::LENGTH;
+        break;
+
+    case ParserState::LENGTH:
+        if (b != m_data_len) {
+            resync(b, toa);             // unexpected length
+            break;
+        }
+        slot.bytes[m_pos++] = b;
+        m_state = ParserState::DATA;
+        break;
+
+    case ParserState::DATA:
+        slot.bytes[m_pos++] = b;
+        break;
     }
-    // parse data members
-    vector<uint8_t>::const_iterator p = get_data();    // point to start of data
-    tie(m_pos, p) = bytes_to_double(p, m_MAX_POS, m_MIN_POS, m_SCALE_POS);
-    tie(m_vel, p) = bytes_to_double(p, m_MAX_VEL, m_MIN_VEL, m_SCALE_VEL);
-}
-
 
-// encode a packet from data
-CartDataPacket::CartDataPacket(double cart_pos, double cart_vel)
-    : m_pos(cart_pos), m_vel(cart_vel), CommPacketBase(PacketId::CART_DATA)
-{
-    auto p = get_data();      // point to start of data
-    p = convert_to_bytes_double(p, m_pos, m_MAX_POS, m_MIN_POS, m_SCALE_POS);
-    p = convert_to_bytes_double(p, m_vel, m_MAX_VEL, m_MIN_VEL, m_SCALE_VEL);
+    // publish the frame as soon as the last data byte is in
+    if (m_state == ParserState::DATA && m_pos == m_HEADER_LEN + m_data_len) {
+        slot.len = m_pos;
+        ++m_wr;
+        m_pos = 0;
+        m_state = ParserState::HEADER;
+    }
 }
 
-
 // ========================================
-// Cart Poll Cmd Packet
+// Header found, start building a frame in the next ring slot
+// overwrites the oldest unread frame if the ring is full
 // ========================================
-// decode the data from received bytes
-CartPollCmdPacket::CartPollCmdPacket(std::vector<uint8_t> packet, InvTimestamp toa)
-    : CommPacketBase(packet, toa)
+void InvCommParser::start_frame(uint8_t b, const InvTimestamp& toa)
 {
-    if (!InvCommParser::validate_packet(packet) || get_id() != PacketId::POLL_CMD) {
-        throw NewInvError(SYSERR_CART_POLL_MSG_PARSE);
+    if (m_wr - m_rd == m_FRAME_RING_LEN) {
+        ++m_rd;                 // reader has fallen behind, keep the newest data
+        ++m_dropped_frames;
     }
-    // no data members
+    FrameSlot& slot = m_frames[m_wr % m_FRAME_RING_LEN];
+    slot.bytes[0] = b;
+    slot.toa = toa;
+    m_pos = 1;
+    m_state = ParserState::TYPE;
 }
 
-
-// encode a packet from data
-CartPollCmdPacket::CartPollCmdPacket()
-    : CommPacketBase(PacketId::POLL_CMD)
+// ========================================
+// Drop a corrupt partial frame
+// the header, and a valid type byte, cannot be the start of a new frame,
+// so only the byte that broke the frame needs to be checked for a header
+// ========================================
+void InvCommParser::resync(uint8_t b, const InvTimestamp& toa)
 {
-    // no data
+    m_discarded_bytes += m_pos;
+    m_pos = 0;
+    m_state = ParserState::HEADER;
+    if (b == m_HEADER) {
+        start_frame(b, toa);
+    }
+    else {
+        ++m_discarded_bytes;
+    }
 }
 
-
 // ========================================
-// Cart Keepalive Cmd Packet
+// View received message bytes
+// the packet is validated by the derived class before any byte is read
 // ========================================
-// decode the data from received bytes
-CartKeepaliveCmdPacket::CartKeepaliveCmdPacket(std::vector<uint8_t> packet, InvTimestamp toa)
-    : CommPacketBase(packet, toa)
+CommPacketBase::CommPacketBase(const uint8_t* packet, size_t, InvTimestamp toa)
+    : m_bytes(packet),
+    m_toa(toa)
 {
-    if (!InvCommParser::validate_packet(packet) || get_id() != PacketId::KEEPALIVE_CMD) {
-        throw NewInvError(SYSERR_CART_KEEPALIVE_MSG_PARSE);
-    }
-    // no data members
 }
 
-
-// encode a packet from data
-CartKeepaliveCmdPacket::CartKeepaliveCmdPacket()
-    : CommPacketBase(PacketId::KEEPALIVE_CMD)
+// ========================================
+// Create message template with ID and correct length
+// ========================================
+CommPacketBase::CommPacketBase(PacketId id)
+    : m_bytes(m_raw),
+    m_toa(InvTimestamp::from_ns(0))             // not received, the clock is not read
 {
-    // no data
+    m_raw[0] = InvCommParser::m_HEADER;
+    m_raw[1] = static_cast<unsigned int>(id) & 0xff;
+    unsigned int data_len = InvCommParser::lookup_data_len(id);
+    m_raw[2] = data_len & 0xff;
+    std::fill(m_raw + InvCommParser::m_HEADER_LEN, m_raw + m_MAX_LEN, 0);   // clear data section
 }
 
-
 // ========================================
-// Pendulum Data Packet
+// Copy a packet
+// only an outgoing packet's own bytes are copied
 // ========================================
-// decode the data from received bytes
-PendDataPacket::PendDataPacket(std::vector<uint8_t> packet, InvTimestamp toa)
-    : CommPacketBase(packet, toa)
+CommPacketBase::CommPacketBase(const CommPacketBase& other)
+    : m_bytes(other.m_bytes == other.m_raw ? m_raw : other.m_bytes),
+    m_toa(other.m_toa)
 {
-    if (!InvCommParser::validate_packet(packet) || get_id() != PacketId::PEND_DATA) {
-        throw NewInvError(SYSERR_PEND_DATA_MSG_PARSE);
-    }
-    // parse data members
-    vector<uint8_t>::const_iterator p = get_data();            // points to start of data
-    tie(m_pos, p) = bytes_to_i16(p, m_MAX_POS, m_MIN_POS, m_SCALE_POS);
+    if (m_bytes == m_raw) std::copy(other.m_raw, other.m_raw + m_MAX_LEN, m_raw);
 }
 
-
-// encode a packet from data
-PendDataPacket::PendDataPacket(double pos)
-    : m_pos(pos), CommPacketBase(PacketId::PEND_DATA)
+CommPacketBase& CommPacketBase::operator=(const CommPacketBase& other)
 {
-    convert_to_bytes_i16(get_data(), m_pos, m_MAX_POS, m_MIN_POS, m_SCALE_POS);
+    m_bytes = other.m_bytes == other.m_raw ? m_raw : other.m_bytes;
+    m_toa = other.m_toa;
+    if (m_bytes == m_raw) std::copy(other.m_raw, other.m_raw + m_MAX_LEN, m_raw);
+    return *this;
 }
 
+
 } // namespace inv_example
@@ -4,9 +4,16 @@
 #define __COMMS__
 
 #include <cstdint>
+#include <cstddef>
+#include <cfloat>
 #include <vector>
-#include <map>
-#include "timestamp.h"
+#include <array>
+#include <algorithm>
+#include <tuple>
+#include <iosfwd>
+#include "Timestamp.h"
+#include "ByteOrder.h"
+#include "System.h"
 
 namespace inv_example {
 
@@ -25,27 +32,174 @@ enum PacketId {                      // message types
     PEND_DATA = 0x20,
 };
 
-class CommPacketBase;
+// ========================================
+// Packet field encodings
+// all fields are sent in network order
+// ========================================
+enum class FieldType {
+    F64,        // IEEE double, 8 bytes
+    I16,        // signed 16-bit int, 2 bytes
+    U8          // unsigned byte
+};
+
+// number of bytes used by a field on the wire
+constexpr unsigned int field_size(FieldType type) { return type == FieldType::F64 ? 8 : type == FieldType::I16 ? 2 : 1; }
+
+// ========================================
+// Packet field definition
+// ========================================
+struct CommFieldDef
+{
+    FieldType type;     // wire encoding
+    double scale;       // raw to engineering units
+    double min;         // lower limit, engineering units
+    double max;         // upper limit, engineering units
+};
+
+// ========================================
+// Packet layout definition
+// ========================================
+const unsigned int COMM_MAX_FIELDS = 2;     // most fields in any packet
+
+struct CommPacketDef
+{
+    PacketId id;                            // message type
+    InvErrorCode parse_err;                 // error reported when a packet of this type cannot be decoded
+    unsigned int num_fields;                // number of data fields
+    CommFieldDef fields[COMM_MAX_FIELDS];   // data fields in wire order
+};
+
+// length of the data portion of a packet
+constexpr unsigned int packet_data_len(const CommPacketDef& def)
+{
+    unsigned int len = 0;
+    for (unsigned int i = 0; i < def.num_fields; ++i) {
+        len += field_size(def.fields[i].type);
+    }
+    return len;
+}
+
+// ========================================
+// Packet schema
+// one entry per packet type, everything else is generated from this table
+// ========================================
+const double PEND_POS_SCALE = 360.0 / 65536.0;     // raw to deg
+const double DEG_TO_RAD = 3.14159265358979323846 / 180.0;
+const double RAD_TO_DEG = 180.0 / 3.14159265358979323846;
+
+constexpr CommPacketDef COMM_PACKET_DEFS[] = {
+    // Cart interface messages
+    { PacketId::FORCE_CMD,      SYSERR_CART_FORCE_MSG_PARSE,        1, {
+        { FieldType::F64,   1.0,    -DBL_MAX,   DBL_MAX },                                      // force, N
+    } },
+    { PacketId::CART_DATA,      SYSERR_CART_DATA_MSG_PARSE,         2, {
+        { FieldType::F64,   1.0,    -DBL_MAX,   DBL_MAX },                                      // position, m
+        { FieldType::F64,   1.0,    -DBL_MAX,   DBL_MAX },                                      // velocity, m/s
+    } },
+    { PacketId::POLL_CMD,       SYSERR_CART_POLL_MSG_PARSE,         0, {} },
+    { PacketId::LOCK_CMD,       SYSERR_CART_LOCK_MSG_PARSE,         1, {
+        { FieldType::U8,    1.0,    0.0,        1.0 },                                          // 1 = lock, 0 = unlock
+    } },
+    { PacketId::KEEPALIVE_CMD,  SYSERR_CART_KEEPALIVE_MSG_PARSE,    0, {} },
+
+    // Pendulum interface messages
+    { PacketId::PEND_DATA,      SYSERR_PEND_DATA_MSG_PARSE,         2, {
+        { FieldType::I16,   PEND_POS_SCALE, INT16_MIN * PEND_POS_SCALE, INT16_MAX * PEND_POS_SCALE },  // position, deg
+        { FieldType::F64,   1.0,    -DBL_MAX,   DBL_MAX },                                      // velocity, rad/s
+    } },
+};
+
+const unsigned int COMM_NUM_PACKET_DEFS = sizeof(COMM_PACKET_DEFS) / sizeof(COMM_PACKET_DEFS[0]);
+
+// ========================================
+// Lookup table indexed by the packet type byte
+// ========================================
+struct CommPacketTable
+{
+    int16_t data_len[256];      // data length, or -1 if the type is undefined
+    uint8_t def_index[256];     // index into COMM_PACKET_DEFS
+};
+
+// build the lookup table from the schema
+constexpr CommPacketTable make_packet_table(void)
+{
+    CommPacketTable table{};
+    for (unsigned int id = 0; id < 256; ++id) {
+        table.data_len[id] = -1;
+    }
+    for (unsigned int i = 0; i < COMM_NUM_PACKET_DEFS; ++i) {
+        table.data_len[COMM_PACKET_DEFS[i].id] = static_cast<int16_t>(packet_data_len(COMM_PACKET_DEFS[i]));
+        table.def_index[COMM_PACKET_DEFS[i].id] = static_cast<uint8_t>(i);
+    }
+    return table;
+}
+
+// ========================================
+// Received frame
+// view of a complete frame held in the parser's frame ring
+// valid until the next call to InvCommParser::next()
+// ========================================
+struct CommFrame
+{
+    const uint8_t* data;    // first byte of the frame (the header)
+    unsigned int len;       // frame length including header, type and length bytes
+    InvTimestamp toa;       // time of arrival of the first byte of the frame
+};
+
+// ========================================
+// Serial links
+// ========================================
+enum class CommLink : uint8_t {
+    CART,                   // cart interface
+    PEND,                   // pendulum interface
+};
+const int COMM_NUM_LINKS = 2;
+
+
 // ========================================
 // Communications packet parser state machine
 // ========================================
 class InvCommParser
 {
 public: // constructors
-    InvCommParser() : m_state(ParserState::HEADER) {};
+    InvCommParser() : m_state(ParserState::HEADER), m_pos(0), m_data_len(0), m_wr(0), m_rd(0), m_discarded_bytes(0), m_dropped_frames(0) {};
 
 public: // methods
-    bool next(uint8_t b);                                 // TODO: // parse the next byte, return true if a msg is ready
-    CommPacketBase get_next_packet(void);                      // TODO: // return the latest valid message
+    bool next(uint8_t b);                                          // parse the next byte, return true if a frame is ready
+    unsigned int next(const uint8_t* buf, size_t len, InvTimestamp toa = InvTimestamp::fast());  // parse a received buffer, return the number of frames completed
+    bool get_next_packet(CommFrame& frame);                        // get the oldest complete frame, return false if there is none
+    unsigned int get_frames_ready(void) const { return m_wr - m_rd; };      // number of complete frames waiting to be read
+    unsigned long long get_discarded_bytes(void) const { return m_discarded_bytes; };  // bytes skipped while searching for a header
+    unsigned long long get_dropped_frames(void) const { return m_dropped_frames; };    // complete frames overwritten before they were read
 
     // static methods for message creation and validation
-    static unsigned int lookup_data_len(PacketId id);          // look up the length of the data part of the message given an ID
-    static bool validate_packet(std::vector<uint8_t> packet);  // return true if packet has a valid format
+    static bool is_defined(PacketId id) { return m_packet_id_table.data_len[id & 0xff] >= 0; };     // return true if the ID is in the schema
+    static unsigned int lookup_data_len(PacketId id) { return is_defined(id) ? m_packet_id_table.data_len[id & 0xff] : 0; };  // look up the length of the data part of the message given an ID, 0 if undefined
+    static bool validate_packet(const uint8_t* packet, size_t len);                  // return true if packet has a valid format
+    static bool validate_packet(const std::vector<uint8_t>& packet) { return validate_packet(packet.data(), packet.size()); };
 
 public: // data
     // Message protocol constants
     static const uint8_t m_HEADER = 0xaa;     // first byte of every msg
     static const int m_HEADER_LEN = 3;        // minimum message size
+    static const unsigned int m_MAX_FRAME_LEN = m_HEADER_LEN + 255;    // length byte limits the data portion
+    static const unsigned int m_FRAME_RING_LEN = 16;                   // number of complete frames buffered, power of 2
+    static constexpr CommPacketTable m_packet_id_table = make_packet_table();   // lookup table of packet length vs msg ID
+
+private: // methods
+    void parse_byte(uint8_t b, const InvTimestamp& toa);    // advance the state machine by one byte
+    void start_frame(uint8_t b, const InvTimestamp& toa);   // header found, claim the next frame slot
+    void resync(uint8_t b, const InvTimestamp& toa);        // discard the partial frame and look for the next header
+
+private: // types
+    // ========================================
+    // Frame ring entry
+    // ========================================
+    struct FrameSlot {
+        uint8_t bytes[m_MAX_FRAME_LEN];     // raw frame bytes
+        unsigned int len;                   // number of valid bytes
+        InvTimestamp toa;                   // time of arrival of the header byte
+    };
 
 private: // data
     // parser data
@@ -55,11 +209,35 @@ private: // data
         LENGTH,
         DATA
     } m_state;
-    static const std::map<PacketId, unsigned int> m_packet_id_table;     // lookup table of packet length vs msg ID
-    std::vector<uint8_t> m_buf; // raw bytes as they are received
-    InvTimestamp m_toa;         // time of arrival of first byte of message
+    FrameSlot m_frames[m_FRAME_RING_LEN];   // ring of received frames, the partial frame is built in place at m_wr
+    unsigned int m_pos;                     // number of bytes received for the partial frame
+    unsigned int m_data_len;                // expected data length of the partial frame
+    unsigned int m_wr;                      // count of frames completed, free-running
+    unsigned int m_rd;                      // count of frames read, free-running
+    unsigned long long m_discarded_bytes;   // bytes dropped during resynchronisation
+    unsigned long long m_dropped_frames;    // frames lost to ring overflow
 };
 
+// ========================================
+// Length of the largest packet data portion in the schema
+// ========================================
+constexpr unsigned int max_packet_data_len(void)
+{
+    unsigned int len = 0;
+    for (unsigned int i = 0; i < COMM_NUM_PACKET_DEFS; ++i) {
+        len = packet_data_len(COMM_PACKET_DEFS[i]) > len ? packet_data_len(COMM_PACKET_DEFS[i]) : len;
+    }
+    return len;
+}
+
+// ========================================
+// Look up the schema entry of a defined packet type
+// ========================================
+constexpr const CommPacketDef& comm_packet_def(PacketId id)
+{
+    return COMM_PACKET_DEFS[InvCommParser::m_packet_id_table.def_index[id & 0xff]];
+}
+
 
 // ================================================================================
 // Communications packet definitions
@@ -69,110 +247,281 @@ private: // data
 // ========================================
 class CommPacketBase
 {
+public: // constants
+    static const unsigned int m_MAX_LEN = InvCommParser::m_HEADER_LEN + max_packet_data_len();    // largest packet in the schema
+
 protected: // constructors
-    // Create a new packet with raw received message bytes and the time when the first byte was received
-    CommPacketBase(std::vector<uint8_t> packet, InvTimestamp toa) : m_raw(packet), m_toa(toa) {};
-    // Create a new outgoing packet template with ID and correct length
+    // View of raw received message bytes and the time when the first byte was received;
+    // nothing is copied, the bytes must outlive the packet
+    CommPacketBase(const uint8_t* packet, size_t len, InvTimestamp toa);
+    // Create a new outgoing packet template with ID and correct length; it has no time of arrival, get_toa is 0
     CommPacketBase(PacketId id);
+    // a copy of an outgoing packet has its own bytes, a copy of a received packet views the same bytes
+    CommPacketBase(const CommPacketBase& other);
+    CommPacketBase& operator=(const CommPacketBase& other);
 
 public: // methods
-    unsigned int get_header(void) { return m_raw[0]; };                 // get the message header
-    PacketId get_id(void) { return static_cast<PacketId>(m_raw[1]); };  // get the message type
-    unsigned int get_data_len(void) { return m_raw[2]; };               // get number of bytes in the data portion
-    std::vector<uint8_t>::iterator get_data(void) { return get_data_len() != 0 ? m_raw.begin() + 3 : m_raw.end(); };   // get pointer to start of data
-    InvTimestamp get_toa(void) { return m_toa; };                       // get the timestamp
+    unsigned int get_header(void) const { return m_bytes[0]; };                 // get the message header
+    PacketId get_id(void) const { return static_cast<PacketId>(m_bytes[1]); };  // get the message type
+    unsigned int get_data_len(void) const { return m_bytes[2]; };               // get number of bytes in the data portion
+    uint8_t* get_data(void) { return m_raw + InvCommParser::m_HEADER_LEN; };   // get pointer to start of data, outgoing packets only
+    const uint8_t* get_data(void) const { return m_bytes + InvCommParser::m_HEADER_LEN; };
+    const uint8_t* get_raw(void) const { return m_bytes; };                     // get the whole packet
+    unsigned int get_len(void) const { return InvCommParser::m_HEADER_LEN + get_data_len(); };    // get the whole packet length
+    InvTimestamp get_toa(void) const { return m_toa; };                         // get the timestamp
 
 private: // data
-    std::vector<uint8_t> m_raw;         // raw message bytes
-    InvTimestamp m_toa;                 // time of arrival of the first byte of the message
+    uint8_t m_raw[m_MAX_LEN];           // message bytes of an outgoing packet
+    const uint8_t* m_bytes;             // the message: m_raw, or the caller's bytes of a received packet
+    InvTimestamp m_toa;                 // time of arrival of the first byte of the message, 0 for an outgoing packet
 };
 
 
 // ========================================
-// Cart Force Cmd Packet
+// Field conversion routines
+// limits are applied in engineering units, the raw value is saturated to the field type
+// ========================================
+// Convert double to network-order bytes
+// returns pointer to next available data byte
+inline uint8_t* convert_to_bytes_double(uint8_t* pdest, double d, double max, double min, double scale)
+{
+    d = std::max(std::min(d, max), min);
+    return store_be(pdest, d / scale);
+}
+
+// Convert signed 16-bit int to network-order bytes
+// returns pointer to next available data byte
+inline uint8_t* convert_to_bytes_i16(uint8_t* pdest, double d, double max, double min, double scale)
+{
+    d = std::max(std::min(d, max), min) / scale;
+    d = std::max(std::min(d, static_cast<double>(INT16_MAX)), static_cast<double>(INT16_MIN));
+    return store_be(pdest, static_cast<int16_t>(d));
+}
+
+// Convert unsigned byte
+// returns pointer to next available data byte
+inline uint8_t* convert_to_bytes_u8(uint8_t* pdest, double d, double max, double min, double scale)
+{
+    d = std::max(std::min(d, max), min) / scale;
+    d = std::max(std::min(d, static_cast<double>(UINT8_MAX)), 0.0);
+    return store_be(pdest, static_cast<uint8_t>(d));
+}
+
+// Convert network-order bytes to a double
+// returns decoded value and pointer to the next data byte
+inline std::pair<double, const uint8_t*> bytes_to_double(const uint8_t* p, double max, double min, double scale)
+{
+    double d = load_be<double>(p) * scale;
+    return std::make_pair(std::max(std::min(d, max), min), p + sizeof(double));
+}
+
+// Convert network-order bytes to a signed 16-bit int
+// returns decoded value and pointer to the next data byte
+inline std::pair<double, const uint8_t*> bytes_to_i16(const uint8_t* p, double max, double min, double scale)
+{
+    double d = load_be<int16_t>(p) * scale;
+    return std::make_pair(std::max(std::min(d, max), min), p + sizeof(int16_t));
+}
+
+// Convert unsigned byte
+// returns decoded value and pointer to the next data byte
+inline std::pair<double, const uint8_t*> bytes_to_u8(const uint8_t* p, double max, double min, double scale)
+{
+    double d = load_be<uint8_t>(p) * scale;
+    return std::make_pair(std::max(std::min(d, max), min), p + sizeof(uint8_t));
+}
+
+
+// ========================================
+// Batch field conversion
+// converts one field of n packets stored back to back, stride bytes apart,
+// used to dump recorded traffic, see cap_export_csv
+// ========================================
+void decode_field_array(const CommFieldDef& f, const uint8_t* p, size_t stride, double* out, size_t n);
+void encode_field_array(const CommFieldDef& f, uint8_t* p, size_t stride, const double* in, size_t n);
+
+// Self-check: every field of every packet type through the batch codec and through the per-field codec,
+// for values in and beyond the field limits; the bytes and the decoded values must be identical
+// prints the number of mismatches, false if there are any
+bool comm_codec_check(std::ostream& os);
+
+
+// ========================================
+// Schema-driven packet
+// decodes and encodes the fields listed in COMM_PACKET_DEFS for the packet type
 // ========================================
-class CartForceCmdPacket : public CommPacketBase
+template <PacketId ID>
+class CommPacket : public CommPacketBase
 {
+public: // constants
+    static constexpr CommPacketDef m_DEF = comm_packet_def(ID);        // layout of this packet type
+    static const unsigned int m_NUM_FIELDS = m_DEF.num_fields;
+
+public: // types
+    typedef std::array<double, m_NUM_FIELDS> Fields;                    // field values in engineering units
+
 public: // constructors
-    CartForceCmdPacket(std::vector<uint8_t> packet, InvTimestamp toa); // decode the data from received bytes
-    CartForceCmdPacket(double force);                                  // encode a packet from data
-    CartForceCmdPacket() = delete;                                     // cannot construct empty message
+    CommPacket(const uint8_t* packet, size_t len, InvTimestamp toa);   // decode the data from received bytes, throws InvError if not valid, see decode_packet
+    CommPacket(const CommFrame& frame) : CommPacket(frame.data, frame.len, frame.toa) {};     // decode a frame from the parser
+    CommPacket(const std::vector<uint8_t>& packet, InvTimestamp toa) : CommPacket(packet.data(), packet.size(), toa) {};
+    explicit CommPacket(const Fields& fields);                          // encode a packet from data
 
-public: // data
-    // packet contents data
-    double m_force;       // cart force, N
+public: // methods
+    const Fields& get_fields(void) const { return m_field; };          // decoded or encoded field values
+    static bool is_valid(const uint8_t* packet, size_t len)            // return true if the bytes are a valid packet of this type
+    {
+        return InvCommParser::validate_packet(packet, len) && packet[1] == ID;
+    };
 
-    // data conversion factors and limits
-    const double m_MAX_FORCE = DBL_MAX;         // N
-    const double m_MIN_FORCE = -DBL_MAX;        // N
-    const double m_SCALE_FORCE = 1.0;           // raw to N
+protected: // data
+    Fields m_field;         // field values in engineering units, after limits are applied
 };
 
+template <PacketId ID>
+constexpr CommPacketDef CommPacket<ID>::m_DEF;
+
+// decode the data from received bytes
+// the fields are decoded straight from the caller's buffer, which the packet keeps a view of
+template <PacketId ID>
+CommPacket<ID>::CommPacket(const uint8_t* packet, size_t len, InvTimestamp toa)
+    : CommPacketBase(packet, len, toa)
+{
+    if (!is_valid(packet, len)) {
+        throw NewInvError(m_DEF.parse_err);
+    }
+    // parse data members
+    const uint8_t* p = packet + InvCommParser::m_HEADER_LEN;   // point to start of data
+    for (unsigned int i = 0; i < m_NUM_FIELDS; ++i) {
+        const CommFieldDef& f = m_DEF.fields[i];
+        switch (f.type) {
+        case FieldType::F64:    std::tie(m_field[i], p) = bytes_to_double(p, f.max, f.min, f.scale);    break;
+        case FieldType::I16:    std::tie(m_field[i], p) = bytes_to_i16(p, f.max, f.min, f.scale);       break;
+        case FieldType::U8:     std::tie(m_field[i], p) = bytes_to_u8(p, f.max, f.min, f.scale);        break;
+        }
+    }
+}
+
+// encode a packet from data
+template <PacketId ID>
+CommPacket<ID>::CommPacket(const Fields& fields)
+    : CommPacketBase(ID)
+{
+    uint8_t* p = get_data();    // point to start of data
+    for (unsigned int i = 0; i < m_NUM_FIELDS; ++i) {
+        const CommFieldDef& f = m_DEF.fields[i];
+        m_field[i] = std::max(std::min(fields[i], f.max), f.min);
+        switch (f.type) {
+        case FieldType::F64:    p = convert_to_bytes_double(p, fields[i], f.max, f.min, f.scale);   break;
+        case FieldType::I16:    p = convert_to_bytes_i16(p, fields[i], f.max, f.min, f.scale);      break;
+        case FieldType::U8:     p = convert_to_bytes_u8(p, fields[i], f.max, f.min, f.scale);       break;
+        }
+    }
+}
+
 
 // ========================================
-// Cart Data Packet
+// Cart Force Cmd Packet
 // ========================================
-class CartDataPacket : public CommPacketBase
+class CartForceCmdPacket : public CommPacket<PacketId::FORCE_CMD>
 {
 public: // constructors
-    CartDataPacket(std::vector<uint8_t> packet, InvTimestamp toa);  // decode the data from received bytes
-    CartDataPacket(double cart_pos, double cart_vel);               // encode a packet from data
-    CartDataPacket() = delete;                                      // cannot construct empty message
+    using CommPacket::CommPacket;                                                                       // decode the data from received bytes
+    CartForceCmdPacket(double force) : CommPacket(Fields{ { force } }) {};                              // encode a packet from data
+    CartForceCmdPacket() = delete;                                                                      // cannot construct empty message
 
-public: // data
-    // message data
-    double m_pos;         // cart position, m
-    double m_vel;         // cart speed, m/s
+public: // methods
+    double get_force(void) const { return m_field[0]; };       // cart force, N
+};
+
+
+// ========================================
+// Cart Data Packet
+// ========================================
+class CartDataPacket : public CommPacket<PacketId::CART_DATA>
+{
+public: // constructors
+    using CommPacket::CommPacket;                                                                       // decode the data from received bytes
+    CartDataPacket(double cart_pos, double cart_vel) : CommPacket(Fields{ { cart_pos, cart_vel } }) {}; // encode a packet from data
+    CartDataPacket() = delete;                                                                          // cannot construct empty message
 
-    // data conversion factors and limits
-    const double m_MAX_POS = DBL_MAX;           // m
-    const double m_MIN_POS = -DBL_MAX;          // m
-    const double m_SCALE_POS = 1.0;             // raw to m
-    const double m_MAX_VEL = DBL_MAX;           // m/s
-    const double m_MIN_VEL = -DBL_MAX;          // m/s
-    const double m_SCALE_VEL = 1.0;             // raw to m/s
+public: // methods
+    double get_pos(void) const { return m_field[0]; };         // cart position, m
+    double get_vel(void) const { return m_field[1]; };         // cart speed, m/s
 };
 
 
 // ========================================
 // Cart Poll Cmd Packet
 // ========================================
-class CartPollCmdPacket : public CommPacketBase
+class CartPollCmdPacket : public CommPacket<PacketId::POLL_CMD>
 {
 public: // constructors
-    CartPollCmdPacket(std::vector<uint8_t> packet, InvTimestamp toa);  // decode the data from received bytes
-    CartPollCmdPacket();                                               // encode a packet from data
+    using CommPacket::CommPacket;                                                                       // decode the data from received bytes
+    CartPollCmdPacket() : CommPacket(Fields{}) {};                                                      // encode a packet from data
+};
+
+
+// ========================================
+// Cart Lock Cmd Packet
+// ========================================
+class CartLockCmdPacket : public CommPacket<PacketId::LOCK_CMD>
+{
+public: // constructors
+    using CommPacket::CommPacket;                                                                       // decode the data from received bytes
+    CartLockCmdPacket(bool lock) : CommPacket(Fields{ { lock ? 1.0 : 0.0 } }) {};                      // encode a packet from data
+    CartLockCmdPacket() = delete;                                                                       // cannot construct empty message
+
+public: // methods
+    bool get_lock(void) const { return m_field[0] != 0.0; };   // true = lock, false = unlock
 };
 
 
 // ========================================
 // Cart Keepalive Cmd Packet
 // ========================================
-class CartKeepaliveCmdPacket : public CommPacketBase
+class CartKeepaliveCmdPacket : public CommPacket<PacketId::KEEPALIVE_CMD>
 {
 public: // constructors
-    CartKeepaliveCmdPacket(std::vector<uint8_t> packet, InvTimestamp toa);  // decode the data from received bytes
-    CartKeepaliveCmdPacket();                                               // encode a packet from data
+    using CommPacket::CommPacket;                                                                       // decode the data from received bytes
+    CartKeepaliveCmdPacket() : CommPacket(Fields{}) {};                                                 // encode a packet from data
 };
 
 
 // ========================================
 // Pendulum Data Packet
 // ========================================
-class PendDataPacket: public CommPacketBase
+class PendDataPacket : public CommPacket<PacketId::PEND_DATA>
 {
 public: // constructors
-    PendDataPacket(std::vector<uint8_t> packet, InvTimestamp toa);  // decode the data from received bytes
-    PendDataPacket(double pos);                                     // encode a packet from data
+    using CommPacket::CommPacket;                                                                       // decode the data from received bytes
+    PendDataPacket(double pos, double vel) : CommPacket(Fields{ { pos, vel } }) {};                     // encode a packet from data
+    PendDataPacket() = delete;                                                                          // cannot construct empty message
 
-public: // data
-    double m_pos;           // pendulum position, deg
-
-    // conversion factor and limits
-    const double m_SCALE_POS = 360.0 / 65536.0;         // raw to deg
-    const double m_MAX_POS = INT16_MAX * m_SCALE_POS;   // deg
-    const double m_MIN_POS = INT16_MIN * m_SCALE_POS;   // deg
+public: // methods
+    double get_pos(void) const { return m_field[0]; };         // pendulum position, deg
+    double get_vel(void) const { return m_field[1]; };         // pendulum velocity, rad/s
 };
 
+
+// ========================================
+// Decode received bytes without throwing
+// a malformed packet is an ordinary event on a noisy link, so it is returned as
+// the parse error of the packet type, e.g. decode_packet<CartDataPacket>(frame);
+// the packet is built in the result and views the caller's bytes, nothing is copied
+// ========================================
+template <typename P>
+InvResult<P> decode_packet(const uint8_t* packet, size_t len, InvTimestamp toa)
+{
+    if (!P::is_valid(packet, len)) return NewInvError(P::m_DEF.parse_err);
+    return InvResult<P>(INV_IN_PLACE, packet, len, toa);
+}
+
+template <typename P>
+InvResult<P> decode_packet(const std::vector<uint8_t>& packet, InvTimestamp toa) { return decode_packet<P>(packet.data(), packet.size(), toa); }
+
+template <typename P>
+InvResult<P> decode_packet(const CommFrame& frame) { return decode_packet<P>(frame.data, frame.len, frame.toa); }
+
+
 } // namespace inv_example
 #endif // __COMMS__
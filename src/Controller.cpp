@@ -0,0 +1,118 @@
+// System controller implementation
+
+#include "Controller.h"
+#include "Error.h"
+
+namespace inv_example {
+// ================================================================================
+// System controller
+// ================================================================================
+// start locked with the cart at the origin
+SysController::SysController(CartSink cart_out)
+    : m_mode(SysMode::LOCKED),
+    m_pos_cmd(0.0),
+    m_x{ 0.0, 0.0, 0.0, 0.0 },
+    m_k{ CTL_K[0], CTL_K[1], CTL_K[2], CTL_K[3] },
+    m_nbar(CTL_NBAR),
+    m_status{ InvTimestamp(), SysMode::LOCKED, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0 },
+    m_cart_out(std::move(cart_out))
+{
+}
+
+// replace the controller gains
+void SysController::set_gains(const double (&k)[MODEL_NUM_STATES], double nbar)
+{
+    for (int i = 0; i < MODEL_NUM_STATES; ++i) m_k[i] = k[i];
+    m_nbar = nbar;
+}
+
+// handle one message received at now
+void SysController::on_msg(const IpcMsg& msg, const InvTimestamp& now)
+{
+    // sensor data and ticks are handled in every mode
+    switch (msg.GetId()) {
+    case IpcMsgId::MSG_CART_DATA:
+    case IpcMsgId::MSG_PEND_DATA:
+        on_sensor(msg, now);
+        return;
+    case IpcMsgId::MSG_TICK:
+        on_tick(now);
+        return;
+    default:
+        break;
+    }
+
+    switch (m_mode) {
+    case SysMode::LOCKED:
+        if (msg.GetId() == IpcMsgId::MSG_MOVE_CMD) {
+            m_pos_cmd = get_move_pos(msg);
+            m_mode = SysMode::MOVING;
+        }
+        break;
+
+    case SysMode::MOVING:
+        if (msg.GetId() == IpcMsgId::MSG_ARRIVED) {
+            m_mode = SysMode::HOLDING;
+        }
+        break;
+
+    case SysMode::HOLDING:
+        switch (msg.GetId()) {
+        case IpcMsgId::MSG_MOVE_CMD:
+            m_pos_cmd = get_move_pos(msg);
+            m_mode = SysMode::MOVING;
+            break;
+        case IpcMsgId::MSG_RESET_CMD:
+            m_mode = SysMode::LOCKED;
+            break;
+        default:
+            break;
+        }
+        break;
+
+    case SysMode::FAILED:
+        break;
+
+    default:
+        m_mode = SysMode::FAILED;
+        break;
+    }
+}
+
+// update the measured state from a sensor packet
+// a packet that can not be decoded is reported and the last good measurement kept
+void SysController::on_sensor(const IpcMsg& msg, const InvTimestamp& now)
+{
+    if (msg.GetId() == IpcMsgId::MSG_CART_DATA) {
+        auto packet = decode_packet<CartDataPacket>(msg.GetData(), msg.GetLen(), now);
+        if (!packet) {
+            enqueue_error(packet.error());
+            return;
+        }
+        m_x[0] = packet->get_pos();
+        m_x[1] = packet->get_vel();
+    }
+    else {
+        auto packet = decode_packet<PendDataPacket>(msg.GetData(), msg.GetLen(), now);
+        if (!packet) {
+            enqueue_error(packet.error());
+            return;
+        }
+        m_x[2] = packet->get_pos() * DEG_TO_RAD;
+        m_x[3] = packet->get_vel();
+    }
+}
+
+// calculate and send the cart force
+// the controller only drives the cart while moving or holding
+void SysController::on_tick(const InvTimestamp& now)
+{
+    double force = 0.0;
+    if (m_mode == SysMode::MOVING || m_mode == SysMode::HOLDING) {
+        force = model_feedback(m_k, m_nbar, m_x, m_pos_cmd);
+        if (m_cart_out) m_cart_out(CartForceCmdPacket(force));
+    }
+    m_status = SysStatus{ now, m_mode, m_pos_cmd, m_x[0], m_x[1], m_x[2], m_x[3], force };
+}
+
+} // namespace inv_example
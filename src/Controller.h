@@ -0,0 +1,66 @@
+// System controller definitions
+
+#ifndef __CONTROLLER_H__
+#define __CONTROLLER_H__
+
+#include <functional>
+#include "System.h"
+#include "Comms.h"
+#include "Messages.h"
+#include "Model.h"
+#include "Timestamp.h"
+
+namespace inv_example {
+// ================================================================================
+// System status
+// state of the controller at the last control tick, one data file record
+// ================================================================================
+struct SysStatus {
+    InvTimestamp time;
+    SysMode mode;
+    double pos_cmd;                     // m
+    double cart_pos;                    // m
+    double cart_vel;                    // m/s
+    double pend_pos;                    // rad
+    double pend_vel;                    // rad/s
+    double force_cmd;                   // N
+};
+
+
+// ================================================================================
+// System controller
+// the SysMode state machine and the cart force controller;
+// driven one message at a time by the main loop or the simulation loop,
+// it takes the time from the caller and never reads the clock itself
+// ================================================================================
+class SysController
+{
+public: // types
+    typedef std::function<void(const CommPacketBase&)> CartSink;    // sends a packet to the cart
+
+public: // constructors
+    explicit SysController(CartSink cart_out);
+
+public: // methods
+    void on_msg(const IpcMsg& msg, const InvTimestamp& now);       // handle one message received at now
+    void set_gains(const double (&k)[MODEL_NUM_STATES], double nbar);  // replace the Model.h gains, e.g. for another sample period
+    SysMode get_mode(void) const { return m_mode; };
+    const SysStatus& get_status(void) const { return m_status; };
+
+private: // methods
+    void on_sensor(const IpcMsg& msg, const InvTimestamp& now);    // update the measured state from a sensor packet
+    void on_tick(const InvTimestamp& now);                          // calculate and send the cart force
+
+private: // data
+    SysMode m_mode;
+    double m_pos_cmd;                   // cart position command, m
+    double m_x[MODEL_NUM_STATES];       // measured cart pos, cart vel, pend pos, pend vel
+    double m_k[MODEL_NUM_STATES];       // feedback gain
+    double m_nbar;                      // reference gain
+    SysStatus m_status;
+    CartSink m_cart_out;
+};
+
+} // namespace inv_example
+
+#endif // __CONTROLLER_H__
@@ -4,11 +4,75 @@
 #include <iostream>
 #include <iomanip>
 #include <sstream>
-#include "error.h"
+#include <mutex>
+#include <deque>
+#include <atomic>
+#include <cstring>
+#include "Error.h"
 
 using namespace std;
 namespace inv_example {
 
+// ========================================
+// Interned messages
+// the store only grows, so the text of a number never moves or changes;
+// a known message is found without locking or allocating, in an open-addressing table of numbers
+// keyed by the hash of the text; only a new message is stored under the lock
+// ========================================
+static const size_t INV_MAX_MSGS = 1024;    // distinct messages kept
+static const size_t INV_MSG_SLOTS = 2 * INV_MAX_MSGS;      // power of two, never more than half full
+
+static std::mutex g_msg_mtx;
+static std::deque<std::string> g_msgs;                      // storage, elements never move
+static const char* g_msg_text[INV_MAX_MSGS];                // text of message n at n - 1
+static std::atomic<InvMsgId> g_msg_slots[INV_MSG_SLOTS];    // message numbers by hash, 0 for an empty slot
+static std::atomic<size_t> g_num_msgs{ 0 };                 // messages published to inv_msg_text
+
+// FNV-1a
+static size_t msg_hash(const char* msg)
+{
+    uint32_t h = 2166136261u;
+    for (const unsigned char* p = reinterpret_cast<const unsigned char*>(msg); *p; ++p) {
+        h = (h ^ *p) * 16777619u;
+    }
+    return h;
+}
+
+// the number of msg, or 0 with slot set to the empty slot where it would go
+static InvMsgId find_msg(const char* msg, size_t& slot)
+{
+    for (slot = msg_hash(msg) & (INV_MSG_SLOTS - 1);; slot = (slot + 1) & (INV_MSG_SLOTS - 1)) {
+        InvMsgId id = g_msg_slots[slot].load(std::memory_order_acquire);
+        if (id == 0 || std::strcmp(g_msg_text[id - 1], msg) == 0) return id;
+    }
+}
+
+InvMsgId inv_intern_msg(const char* msg)
+{
+    size_t slot;
+    InvMsgId id = find_msg(msg, slot);
+    if (id != 0) return id;
+
+    std::lock_guard<std::mutex> lock(g_msg_mtx);
+    id = find_msg(msg, slot);           // stored by another thread since
+    if (id != 0) return id;
+    if (g_msgs.size() >= INV_MAX_MSGS) return 0;
+    g_msgs.emplace_back(msg);
+    id = static_cast<InvMsgId>(g_msgs.size());
+    g_msg_text[id - 1] = g_msgs.back().c_str();
+    g_num_msgs.store(g_msgs.size(), std::memory_order_release);
+    g_msg_slots[slot].store(id, std::memory_order_release);
+    return id;
+}
+
+// lock-free, published messages are never changed
+const char* inv_msg_text(InvMsgId id)
+{
+    if (id == 0 || id > g_num_msgs.load(std::memory_order_acquire)) return "";
+    return g_msg_text[id - 1];
+}
+
+
 // ========================================
 // Error message object
 // represents a single error condition
@@ -16,11 +80,17 @@ namespace inv_example {
 // Create a printable string
 std::string InvError::to_string(void) const
 {
+    // file name without its directory
+    const char* file = m_file ? m_file : "";
+    for (const char* p = file; *p; ++p) {
+        if (*p == '/' || *p == '\\') file = p + 1;
+    }
+
     stringstream str;
     //HH:MM:SS.ssss c2345 f2345678901234567890:l2345
     str << m_time << " ";
     str << setw(6) << m_code << " ";
-    str << setw(20) << setfill(' ') << m_file.substr(20) << ":" << setw(5) << m_line;
+    str << setw(20) << setfill(' ') << file << ":" << setw(5) << m_line;
     return str.str();
 }
 
@@ -49,50 +119,57 @@ void InvErrorTable::AddErrorCode(std::initializer_list<const InvErrorInit> init)
 
 // look up error level for given code
 InvErrorLevel InvErrorTable::LookupErrorLevel(const InvError& err) const
+{
+    return LookupErrorLevel(err.get_code());
+}
+
+
+// look up error message for a given code
+std::string InvErrorTable::LookupErrorMsg(const InvError& err) const
 {
     switch (static_cast<SpecialErrCode>(err.get_code())) {
     case SpecialErrCode::EXCEPTION:
-        // Exceptions are always Info level
-        return InvErrorLevel::INFO;
+        // Exception errors store their own message
+        return inv_msg_text(err.get_msg_id());
         break;
 
     case SpecialErrCode::NULL_ERROR:
-        // No error or message
-        return InvErrorLevel::NONE;
+        return "No error";
         break;
 
     default:
-        try {
-            return m_table.at(err.get_code()).level;
-        }
-        catch (out_of_range) {
-            return InvErrorLevel::WARNING;          // undefined error codes return as a warning
-        }
+        return LookupErrorMsg(err.get_code());
     }
 }
 
 
-// look up error message for a given code
-std::string InvErrorTable::LookupErrorMsg(const InvError& err) const
+// look up error level for given code
+InvErrorLevel InvErrorTable::LookupErrorLevel(InvErrorCode code) const
 {
-    switch (static_cast<SpecialErrCode>(err.get_code())) {
+    switch (static_cast<SpecialErrCode>(code)) {
     case SpecialErrCode::EXCEPTION:
-        // Exception errors store their own message
-        return err.get_exp_msg();
-        break;
+        return InvErrorLevel::INFO;             // exceptions are always Info level
+    case SpecialErrCode::NULL_ERROR:
+        return InvErrorLevel::NONE;             // no error or message
+    default:
+        auto p = m_table.find(code);
+        return p != m_table.end() ? p->second.level : InvErrorLevel::WARNING;  // undefined error codes return as a warning
+    }
+}
+
 
+// look up error message for a given code
+// the message stays valid while the table is unchanged
+const char* InvErrorTable::LookupErrorMsg(InvErrorCode code) const
+{
+    switch (static_cast<SpecialErrCode>(code)) {
+    case SpecialErrCode::EXCEPTION:
+        return "Exception";
     case SpecialErrCode::NULL_ERROR:
         return "No error";
-        break;
-
     default:
-        try {
-            return m_table.at(err.get_code()).msg;
-        }
-        catch (out_of_range) {
-            return "Undefined error";               // error code is not in the table
-        }
-        break;
+        auto p = m_table.find(code);
+        return p != m_table.end() ? p->second.msg.c_str() : "Undefined error";    // error code is not in the table
     }
 }
 
@@ -102,11 +179,11 @@ std::string InvErrorTable::to_string(const InvError& err) const
 {
     string level;
     switch (LookupErrorLevel(err)) {
-    case InvErrorLevel::NONE:       level = "NONE";
-    case InvErrorLevel::FATAL:      level = "FATAL";
-    case InvErrorLevel::WARNING:    level = "WARN";
-    case InvErrorLevel::INFO:       level = "INFO";
-    default:                        level = "UNDEF";
+    case InvErrorLevel::NONE:       level = "NONE";     break;
+    case InvErrorLevel::FATAL:      level = "FATAL";    break;
+    case InvErrorLevel::WARNING:    level = "WARN";     break;
+    case InvErrorLevel::INFO:       level = "INFO";     break;
+    default:                        level = "UNDEF";    break;
     }
 
     stringstream str;
@@ -6,7 +6,12 @@
 
 #include <stdexcept>
 #include <map>
-#include "timestamp.h"
+#include <string>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include "Timestamp.h"
 
 namespace inv_example {
 // ========================================
@@ -35,43 +40,105 @@ enum class InvErrorLevel {
 };
 
 
+// ========================================
+// Interned messages
+// text that is not known at compile time, e.g. from a std::exception, is stored once and
+// referred to by number; 0 is no message
+// ========================================
+typedef uint32_t InvMsgId;
+InvMsgId inv_intern_msg(const char* msg);   // the number of the text, stored on first use; 0 if the store is full
+const char* inv_msg_text(InvMsgId id);      // the stored text, "" for 0 or an unknown number
+
+
 // ========================================
 // Error message object
 // represents a single error condition
+// a small value that can be copied and queued without touching the heap;
+// the file name points at __FILE__ and all formatting is left to the consumer
 // ========================================
 class InvError : std::exception
 {
 public: // constructors
-    InvError::InvError(void) = delete;
+    InvError(void) = delete;
     // Construct an error report that can be queued or thrown as an exception
-    InvError::InvError(InvErrorCode code, int line, const std::string file)
+    InvError(InvErrorCode code, int line, const char* file)
         : m_time(),             // time is now
         m_code(code),
         m_line(line),
-        m_file(file),
-        m_exp_msg("")
+        m_msg_id(0),
+        m_file(file)
     {};
 
     // Construct an error report for an exception thrown by the std library
-    InvError::InvError(std::exception e, int line, const std::string file)
+    InvError(const std::exception& e, int line, const char* file)
         : m_time(),             // time is now
         m_code(static_cast<InvErrorCode>(SpecialErrCode::EXCEPTION)),
         m_line(line),
-        m_file(file),
-        m_exp_msg(e.what())     // error message from the exception
+        m_msg_id(inv_intern_msg(e.what())),     // error message from the exception
+        m_file(file)
     {};
 
 public: // methods
     InvErrorCode get_code(void) const { return m_code; };
-    std::string get_exp_msg(void) const { return m_exp_msg; };
+    const InvTimestamp& get_time(void) const { return m_time; };
+    int get_line(void) const { return m_line; };
+    const char* get_file(void) const { return m_file; };
+    InvMsgId get_msg_id(void) const { return m_msg_id; };     // exception message, or 0 if not an exception
     std::string to_string(void) const;
 
 private: // data
-    const InvTimestamp m_time;      // time of occurrence
-    const InvErrorCode m_code;      // error identifier
-    const int m_line;               // line number
-    const std::string m_file;       // File name
-    const std::string m_exp_msg;    // Exception message, or "" if not an exception
+    InvTimestamp m_time;            // time of occurrence
+    InvErrorCode m_code;            // error identifier
+    int m_line;                     // line number
+    InvMsgId m_msg_id;              // interned exception message, or 0 if not an exception
+    const char* m_file;             // File name, __FILE__
+};
+
+
+// ========================================
+// Result of an operation that can fail
+// holds either the value or the error, so an expected failure such as a malformed
+// packet is returned rather than thrown; get() throws the error for callers that want it
+// ========================================
+struct InvInPlace {};                   // build the value of an InvResult in place from constructor arguments
+const InvInPlace INV_IN_PLACE{};
+
+template <typename T>
+class InvResult
+{
+public: // constructors
+    InvResult(const T& value) : m_ok(true) { new (&m_store) T(value); };
+    template <typename... Args>
+    InvResult(InvInPlace, Args&&... args) : m_ok(true) { new (&m_store) T(std::forward<Args>(args)...); };
+    InvResult(const InvError& err) : m_ok(false) { new (&m_store) InvError(err); };
+    InvResult(const InvResult& other) : m_ok(other.m_ok)
+    {
+        if (m_ok) new (&m_store) T(other.value());
+        else new (&m_store) InvError(other.error());
+    };
+    InvResult& operator=(const InvResult&) = delete;
+    ~InvResult()
+    {
+        if (m_ok) reinterpret_cast<T*>(&m_store)->~T();
+        else reinterpret_cast<InvError*>(&m_store)->~InvError();
+    };
+
+public: // methods
+    bool ok(void) const { return m_ok; };
+    explicit operator bool(void) const { return m_ok; };
+    const T& value(void) const { return *reinterpret_cast<const T*>(&m_store); };          // only if ok()
+    const T* operator->(void) const { return reinterpret_cast<const T*>(&m_store); };
+    const InvError& error(void) const { return *reinterpret_cast<const InvError*>(&m_store); };   // only if not ok()
+    const T& get(void) const                // the value, or throws the error
+    {
+        if (!m_ok) throw error();
+        return value();
+    };
+
+private: // data
+    typename std::aligned_storage<(sizeof(T) > sizeof(InvError) ? sizeof(T) : sizeof(InvError)),
+        (alignof(T) > alignof(InvError) ? alignof(T) : alignof(InvError))>::type m_store;
+    bool m_ok;
 };
 
 
@@ -108,6 +175,8 @@ public: // methods
     // static methods to look up error information
     InvErrorLevel LookupErrorLevel(const InvError& err) const;
     std::string LookupErrorMsg(const InvError& err) const;
+    InvErrorLevel LookupErrorLevel(InvErrorCode code) const;    // by code, exceptions have no message of their own
+    const char* LookupErrorMsg(InvErrorCode code) const;
     std::string to_string(const InvError& err) const;
 
 private: // data
@@ -118,8 +187,8 @@ private: // data
 // ========================================
 // Error creation macro records the filename and line number
 // ========================================
-#define NewInvError(code) InvError::InvError((code), __LINE__, __FILE__)        // arg must be InvErrorCode
-#define NewInvErrorException(e) InvError::InvError((e), __LINE__, __FILE__)     // arg must be std::exception or derivative
+#define NewInvError(code) InvError((code), __LINE__, __FILE__)          // arg must be InvErrorCode
+#define NewInvErrorException(e) InvError((e), __LINE__, __FILE__)       // arg must be std::exception or derivative
 
 } // namespace inv_example
 
@@ -0,0 +1,98 @@
+// Error rate limiting implementation
+
+#include <algorithm>
+#include <cmath>
+#include "ErrorLimit.h"
+
+namespace inv_example {
+// ================================================================================
+// Error rate limiter
+// ================================================================================
+InvErrorLimiter::InvErrorLimiter(const InvErrorTable& table, const ErrorLimitConfig& cfg)
+    : m_table(table),
+    m_window_ms(cfg.window_ms),
+    m_interval_ns(std::max<int64_t>(1, std::llround(1e9 / cfg.rate))),
+    m_depth_ns(m_interval_ns * std::max(cfg.burst, 1u)),
+    m_window_start_ns(InvTimestamp().to_ns())
+{
+}
+
+// count the error and take a token from the bucket of its code
+// the bucket is the time it will be full again: each error pushes it one interval later,
+// and an error is held back if that would be more than a full bucket ahead of now
+bool InvErrorLimiter::admit(const InvError& err)
+{
+    Slot* slot = find(err.get_code());
+    if (slot == nullptr) {
+        m_untracked.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+    slot->reported.fetch_add(1, std::memory_order_relaxed);
+    if (slot->key.load(std::memory_order_relaxed) & 1) return true;    // fatal errors always get through
+
+    const int64_t t = err.get_time().to_ns();
+    int64_t full = slot->full_ns.load(std::memory_order_relaxed);
+    for (;;) {
+        int64_t next = std::max(full, t) + m_interval_ns;
+        if (next - t > m_depth_ns) break;       // bucket empty
+        if (slot->full_ns.compare_exchange_weak(full, next, std::memory_order_relaxed)) return true;
+    }
+
+    slot->suppressed.fetch_add(1, std::memory_order_relaxed);
+    slot->window.fetch_add(1, std::memory_order_relaxed);
+    slot->line.store(err.get_line(), std::memory_order_relaxed);
+    slot->file.store(err.get_file(), std::memory_order_relaxed);
+    return false;
+}
+
+bool InvErrorLimiter::get_counts(InvErrorCode code, InvErrorCounts& counts) const
+{
+    const Slot* slot = find(code);
+    if (slot == nullptr) return false;
+    counts = InvErrorCounts{ code, slot->reported.load(std::memory_order_relaxed), slot->suppressed.load(std::memory_order_relaxed) };
+    return true;
+}
+
+std::vector<InvErrorCounts> InvErrorLimiter::get_counts(void) const
+{
+    std::vector<InvErrorCounts> all;
+    for (const auto& slot : m_slots) {
+        int64_t key = slot.key.load(std::memory_order_acquire);
+        if (key == EMPTY) continue;
+        all.push_back(InvErrorCounts{ slot_code(key), slot.reported.load(std::memory_order_relaxed),
+            slot.suppressed.load(std::memory_order_relaxed) });
+    }
+    std::sort(all.begin(), all.end(), [](const InvErrorCounts& a, const InvErrorCounts& b) { return a.code < b.code; });
+    return all;
+}
+
+// open addressing on the code, the codes of a group are consecutive and spread well by their low bits;
+// slots are only ever added, so a search stops at the first free slot
+InvErrorLimiter::Slot* InvErrorLimiter::find(InvErrorCode code)
+{
+    for (size_t i = 0; i < MAX_CODES; ++i) {
+        Slot& slot = m_slots[(static_cast<uint32_t>(code) + i) & (MAX_CODES - 1)];
+        int64_t key = slot.key.load(std::memory_order_acquire);
+        if (key == EMPTY) {
+            const bool fatal = m_table.LookupErrorLevel(code) == InvErrorLevel::FATAL;
+            int64_t new_key = static_cast<int64_t>(static_cast<uint32_t>(code)) << 1 | (fatal ? 1 : 0);
+            if (slot.key.compare_exchange_strong(key, new_key, std::memory_order_acq_rel)) return &slot;
+            // another thread took the slot, key is now its code
+        }
+        if (slot_code(key) == code) return &slot;
+    }
+    return nullptr;
+}
+
+const InvErrorLimiter::Slot* InvErrorLimiter::find(InvErrorCode code) const
+{
+    for (size_t i = 0; i < MAX_CODES; ++i) {
+        const Slot& slot = m_slots[(static_cast<uint32_t>(code) + i) & (MAX_CODES - 1)];
+        int64_t key = slot.key.load(std::memory_order_acquire);
+        if (key == EMPTY) return nullptr;
+        if (slot_code(key) == code) return &slot;
+    }
+    return nullptr;
+}
+
+} // namespace inv_example
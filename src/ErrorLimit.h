@@ -0,0 +1,121 @@
+// Error rate limiting definitions
+// keeps a storm of one error code from flooding the error queue, the log and the console
+
+#ifndef __ERRORLIMIT_H__
+#define __ERRORLIMIT_H__
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <atomic>
+#include "Error.h"
+
+namespace inv_example {
+// ================================================================================
+// Rate limit options
+// the same limit applies to each code separately; fatal errors are never held back
+// ================================================================================
+struct ErrorLimitConfig {
+    double rate;                        // errors per second passed on after the burst, greater than 0
+    unsigned int burst;                 // errors passed on at once before the rate applies
+    unsigned int window_ms;             // held back errors are summarized once per window
+};
+
+const ErrorLimitConfig ERROR_LIMIT_DEFAULT{ 10.0, 20, 1000 };
+
+
+// ================================================================================
+// Error counts of one code since the start
+// ================================================================================
+struct InvErrorCounts {
+    InvErrorCode code;
+    unsigned long long reported;        // every error of the code
+    unsigned long long suppressed;      // held back by the rate limit
+};
+
+// ================================================================================
+// Errors of one code held back in the last window
+// e.g. logged as "1002 x 4312 in last 1 s"
+// ================================================================================
+struct InvErrorSummary {
+    InvErrorCode code;
+    uint32_t count;                     // errors held back in the window
+    uint32_t window_ms;                 // length of the window
+    int line;                           // where the last of them was reported
+    const char* file;
+};
+
+
+// ================================================================================
+// Error rate limiter
+// a token bucket per code, kept as the time the bucket is next full (GCRA) so that
+// admit() is one compare-and-swap; codes get a slot the first time they are reported
+// ================================================================================
+class InvErrorLimiter
+{
+public: // constructors
+    explicit InvErrorLimiter(const InvErrorTable& table, const ErrorLimitConfig& cfg = ERROR_LIMIT_DEFAULT);
+    InvErrorLimiter(const InvErrorLimiter&) = delete;
+
+public: // methods
+    bool admit(const InvError& err);    // count the error, true to pass it on, false if it is held back; any thread
+    // call f(const InvErrorSummary&) for each code with errors held back since the last call,
+    // once the window has passed, or at once if final; called by one thread
+    template<typename F>
+    void flush(int64_t now_ns, bool final, F f);
+    bool get_counts(InvErrorCode code, InvErrorCounts& counts) const;  // false if the code was never reported
+    std::vector<InvErrorCounts> get_counts(void) const;                // every code reported so far
+    unsigned long long get_untracked(void) const { return m_untracked.load(std::memory_order_relaxed); };  // errors of codes without a slot, passed on
+
+public: // constants
+    static const size_t MAX_CODES = 64;         // distinct codes limited, a power of 2
+
+private: // types
+    static const int64_t EMPTY = -1;    // key of a free slot
+    struct Slot {
+        std::atomic<int64_t> key{ EMPTY };      // code << 1 | fatal, set once
+        std::atomic<int64_t> full_ns{ 0 };      // time the bucket is full again, its level is the time left
+        std::atomic<unsigned long long> reported{ 0 };
+        std::atomic<unsigned long long> suppressed{ 0 };
+        std::atomic<uint32_t> window{ 0 };      // held back since the last summary
+        std::atomic<int> line{ 0 };
+        std::atomic<const char*> file{ nullptr };
+    };
+
+private: // methods
+    Slot* find(InvErrorCode code);      // the slot of the code, added if new; nullptr if all slots are taken
+    const Slot* find(InvErrorCode code) const;
+    static InvErrorCode slot_code(int64_t key) { return static_cast<InvErrorCode>(static_cast<uint32_t>(key >> 1)); };
+
+private: // data
+    const InvErrorTable& m_table;
+    const uint32_t m_window_ms;
+    const int64_t m_interval_ns;        // time for one token
+    const int64_t m_depth_ns;           // time for a full bucket
+    int64_t m_window_start_ns;          // flush thread only
+    std::atomic<unsigned long long> m_untracked{ 0 };
+    Slot m_slots[MAX_CODES];
+};
+
+
+template<typename F>
+void InvErrorLimiter::flush(int64_t now_ns, bool final, F f)
+{
+    int64_t elapsed_ns = now_ns - m_window_start_ns;
+    if (!final && elapsed_ns < static_cast<int64_t>(m_window_ms) * 1000000) return;
+    m_window_start_ns = now_ns;
+    uint32_t window_ms = static_cast<uint32_t>(elapsed_ns > 0 ? (elapsed_ns + 500000) / 1000000 : 0);
+    for (auto& slot : m_slots) {
+        int64_t key = slot.key.load(std::memory_order_acquire);
+        if (key == EMPTY) continue;
+        uint32_t count = slot.window.exchange(0, std::memory_order_relaxed);
+        if (count > 0) {
+            f(InvErrorSummary{ slot_code(key), count, window_ms, slot.line.load(std::memory_order_relaxed),
+                slot.file.load(std::memory_order_relaxed) });
+        }
+    }
+}
+
+} // namespace inv_example
+
+#endif // __ERRORLIMIT_H__
@@ -0,0 +1,245 @@
+// Implementation of the batched multi-plant simulator
+
+#include <algorithm>
+#include <iostream>
+#include <cmath>
+#include "Fleet.h"
+#include "Plant.h"
+
+namespace inv_example {
+// ================================================================================
+// Fleet step kernels
+// u = Nbar·r - K·x, x' = A·x + B·u for plants [begin, end), one plant per array element;
+// the arrays are passed as restrict parameters so the compiler vectorises across plants
+// ================================================================================
+// ========================================
+// Every plant with the same coefficients
+// ========================================
+static void fleet_step_shared(const InvPendFleet::PlantParams& p, double* __restrict x0, double* __restrict x1,
+    double* __restrict x2, double* __restrict x3, const double* __restrict r, double* __restrict u, size_t begin, size_t end)
+{
+    // coefficients in locals, stores to the state arrays can not change them
+    const double a00 = p.a[0][0], a01 = p.a[0][1], a02 = p.a[0][2], a03 = p.a[0][3];
+    const double a10 = p.a[1][0], a11 = p.a[1][1], a12 = p.a[1][2], a13 = p.a[1][3];
+    const double a20 = p.a[2][0], a21 = p.a[2][1], a22 = p.a[2][2], a23 = p.a[2][3];
+    const double a30 = p.a[3][0], a31 = p.a[3][1], a32 = p.a[3][2], a33 = p.a[3][3];
+    const double b0 = p.b[0], b1 = p.b[1], b2 = p.b[2], b3 = p.b[3];
+    const double k0 = p.k[0], k1 = p.k[1], k2 = p.k[2], k3 = p.k[3];
+    const double nbar = p.nbar;
+
+    for (size_t i = begin; i < end; ++i) {
+        const double s0 = x0[i], s1 = x1[i], s2 = x2[i], s3 = x3[i];
+        const double f = nbar * r[i] - ((k0 * s0 + k1 * s1) + (k2 * s2 + k3 * s3));
+        x0[i] = (a00 * s0 + a01 * s1) + (a02 * s2 + a03 * s3) + b0 * f;
+        x1[i] = (a10 * s0 + a11 * s1) + (a12 * s2 + a13 * s3) + b1 * f;
+        x2[i] = (a20 * s0 + a21 * s1) + (a22 * s2 + a23 * s3) + b2 * f;
+        x3[i] = (a30 * s0 + a31 * s1) + (a32 * s2 + a33 * s3) + b3 * f;
+        u[i] = f;
+    }
+}
+
+// ========================================
+// Every plant with its own coefficients
+// coef holds the arrays a00 .. a33, b0 .. b3, k0 .. k3, nbar in that order
+// ========================================
+static void fleet_step_per_plant(const double* const* coef, double* __restrict x0, double* __restrict x1,
+    double* __restrict x2, double* __restrict x3, const double* __restrict r, double* __restrict u, size_t begin, size_t end)
+{
+    const double* __restrict a00 = coef[0];  const double* __restrict a01 = coef[1];
+    const double* __restrict a02 = coef[2];  const double* __restrict a03 = coef[3];
+    const double* __restrict a10 = coef[4];  const double* __restrict a11 = coef[5];
+    const double* __restrict a12 = coef[6];  const double* __restrict a13 = coef[7];
+    const double* __restrict a20 = coef[8];  const double* __restrict a21 = coef[9];
+    const double* __restrict a22 = coef[10]; const double* __restrict a23 = coef[11];
+    const double* __restrict a30 = coef[12]; const double* __restrict a31 = coef[13];
+    const double* __restrict a32 = coef[14]; const double* __restrict a33 = coef[15];
+    const double* __restrict b0 = coef[16];  const double* __restrict b1 = coef[17];
+    const double* __restrict b2 = coef[18];  const double* __restrict b3 = coef[19];
+    const double* __restrict k0 = coef[20];  const double* __restrict k1 = coef[21];
+    const double* __restrict k2 = coef[22];  const double* __restrict k3 = coef[23];
+    const double* __restrict nbar = coef[24];
+
+    for (size_t i = begin; i < end; ++i) {
+        const double s0 = x0[i], s1 = x1[i], s2 = x2[i], s3 = x3[i];
+        const double f = nbar[i] * r[i] - ((k0[i] * s0 + k1[i] * s1) + (k2[i] * s2 + k3[i] * s3));
+        x0[i] = (a00[i] * s0 + a01[i] * s1) + (a02[i] * s2 + a03[i] * s3) + b0[i] * f;
+        x1[i] = (a10[i] * s0 + a11[i] * s1) + (a12[i] * s2 + a13[i] * s3) + b1[i] * f;
+        x2[i] = (a20[i] * s0 + a21[i] * s1) + (a22[i] * s2 + a23[i] * s3) + b2[i] * f;
+        x3[i] = (a30[i] * s0 + a31[i] * s1) + (a32[i] * s2 + a33[i] * s3) + b3[i] * f;
+        u[i] = f;
+    }
+}
+
+
+// ================================================================================
+// Fleet of closed-loop plants
+// ================================================================================
+// all plants at rest at the origin with the default model
+InvPendFleet::InvPendFleet(size_t num_plants, unsigned int num_threads)
+    : m_num_plants(num_plants), m_r(num_plants, 0.0), m_u(num_plants, 0.0), m_shared(default_params()), m_per_plant(false)
+{
+    for (auto& x : m_x) x.assign(num_plants, 0.0);
+    if (num_threads != 1) m_pool.reset(new IpcWorkerPool(num_threads));
+}
+
+InvPendFleet::~InvPendFleet()
+{
+}
+
+// the model and controller compiled into Model.h
+InvPendFleet::PlantParams InvPendFleet::default_params(void)
+{
+    PlantParams p;
+    for (int i = 0; i < MODEL_NUM_STATES; ++i) {
+        for (int j = 0; j < MODEL_NUM_STATES; ++j) p.a[i][j] = MODEL_A[i][j];
+        p.b[i] = MODEL_B[i];
+        p.k[i] = CTL_K[i];
+    }
+    p.nbar = CTL_NBAR;
+    return p;
+}
+
+// give plant i its own model
+void InvPendFleet::set_params(size_t i, const PlantParams& p)
+{
+    if (!m_per_plant) {
+        // spread the shared coefficients to every plant before the first override
+        for (int r = 0; r < MODEL_NUM_STATES; ++r) {
+            for (int c = 0; c < MODEL_NUM_STATES; ++c) m_a[r][c].assign(m_num_plants, m_shared.a[r][c]);
+            m_b[r].assign(m_num_plants, m_shared.b[r]);
+            m_k[r].assign(m_num_plants, m_shared.k[r]);
+        }
+        m_nbar.assign(m_num_plants, m_shared.nbar);
+        m_per_plant = true;
+    }
+    for (int r = 0; r < MODEL_NUM_STATES; ++r) {
+        for (int c = 0; c < MODEL_NUM_STATES; ++c) m_a[r][c][i] = p.a[r][c];
+        m_b[r][i] = p.b[r];
+        m_k[r][i] = p.k[r];
+    }
+    m_nbar[i] = p.nbar;
+}
+
+void InvPendFleet::set_states(size_t i, const InvPendModel::States& x)
+{
+    m_x[0][i] = x.cart_pos;
+    m_x[1][i] = x.cart_vel;
+    m_x[2][i] = x.pend_pos;
+    m_x[3][i] = x.pend_vel;
+}
+
+void InvPendFleet::set_pos_cmd_all(double pos_cmd)
+{
+    std::fill(m_r.begin(), m_r.end(), pos_cmd);
+}
+
+// advance every plant by ticks periods
+// plants are independent, so each thread runs all ticks on its own chunks with no barrier between ticks
+void InvPendFleet::step(unsigned int ticks)
+{
+    auto work = [this, ticks](size_t begin, size_t end) {
+        if (m_per_plant) step_per_plant(begin, end, ticks);
+        else step_shared(begin, end, ticks);
+    };
+    if (m_pool && m_num_plants >= MT_MIN_PLANTS) m_pool->run(m_num_plants, MT_GRAIN, work);
+    else work(0, m_num_plants);
+}
+
+// plants [begin, end) with the common coefficients
+// each chunk runs all ticks while its states are still in cache
+void InvPendFleet::step_shared(size_t begin, size_t end, unsigned int ticks)
+{
+    for (unsigned int t = 0; t < ticks; ++t) {
+        fleet_step_shared(m_shared, m_x[0].data(), m_x[1].data(), m_x[2].data(), m_x[3].data(), m_r.data(), m_u.data(), begin, end);
+    }
+}
+
+// plants [begin, end) with their own coefficients
+void InvPendFleet::step_per_plant(size_t begin, size_t end, unsigned int ticks)
+{
+    const double* coef[MODEL_NUM_STATES * MODEL_NUM_STATES + 2 * MODEL_NUM_STATES + 1];
+    const double** c = coef;
+    for (auto& row : m_a) for (auto& a : row) *c++ = a.data();
+    for (auto& b : m_b) *c++ = b.data();
+    for (auto& k : m_k) *c++ = k.data();
+    *c = m_nbar.data();
+
+    for (unsigned int t = 0; t < ticks; ++t) {
+        fleet_step_per_plant(coef, m_x[0].data(), m_x[1].data(), m_x[2].data(), m_x[3].data(), m_r.data(), m_u.data(), begin, end);
+    }
+}
+
+
+// ================================================================================
+// Fleet self-check
+// ================================================================================
+const unsigned int FLEET_CHECK_TICKS = 50;          // ticks per pass, the fleet runs them without a stop
+const unsigned int FLEET_CHECK_PASSES = 40;         // compared after each pass, through the transient and settled
+const double FLEET_CHECK_X_TOL = 1e-12;             // states, of the order of the 0.2 m step
+const double FLEET_CHECK_U_TOL = 1e-10;             // force, N, of the order of Nbar times the step
+const int FLEET_CHECK_RATES[] = { 100, 200, 500, 1000 };    // Hz, designs given to the plants in turn
+
+bool fleet_check(std::ostream& os)
+{
+    bool ok = true;
+    for (bool per_plant : { false, true }) {
+        const size_t n = InvPendFleet::MT_MIN_PLANTS;  // the smallest fleet stepped on the workers
+        InvPendFleet fleet(n, 2);
+        std::vector<InvPendModel> models;
+        std::vector<double> cmds(n);
+        models.reserve(n);
+        for (size_t i = 0; i < n; ++i) {
+            InvPendModel::States x0{ 0.1 * std::sin(0.1 * i), 0.0, 0.05 * std::cos(0.3 * i), 0.01 * std::sin(0.7 * i) };
+            cmds[i] = i % 2 ? 0.2 : -0.2;
+            fleet.set_states(i, x0);
+            fleet.set_pos_cmd(i, cmds[i]);
+            if (per_plant) {
+                const PlantDesign& d = PlantCache::instance().get(PEND_PHYS_DEFAULT, 1.0 / FLEET_CHECK_RATES[i % 4]);
+                InvPendFleet::PlantParams p;
+                for (int r = 0; r < MODEL_NUM_STATES; ++r) {
+                    for (int c = 0; c < MODEL_NUM_STATES; ++c) p.a[r][c] = d.a[r][c];
+                    p.b[r] = d.b[r];
+                    p.k[r] = d.k[r];
+                }
+                p.nbar = d.nbar;
+                fleet.set_params(i, p);
+                models.emplace_back(x0, d.a, d.b);
+                models.back().set_gains(d.k, d.nbar);
+            }
+            else {
+                models.emplace_back(x0);
+            }
+        }
+
+        double x_diff = 0.0, u_diff = 0.0;
+        for (unsigned int pass = 0; pass < FLEET_CHECK_PASSES; ++pass) {
+            std::vector<double> u(n);
+            for (size_t i = 0; i < n; ++i) {
+                for (unsigned int t = 0; t < FLEET_CHECK_TICKS; ++t) {
+                    u[i] = models[i].feedback(cmds[i]);
+                    models[i].on_tick_100hz(u[i]);
+                }
+            }
+            fleet.step(FLEET_CHECK_TICKS);
+            for (size_t i = 0; i < n; ++i) {
+                InvPendModel::States a = fleet.get_states(i), b = models[i].get_states();
+                const double fa[] = { a.cart_pos, a.cart_vel, a.pend_pos, a.pend_vel };
+                const double fb[] = { b.cart_pos, b.cart_vel, b.pend_pos, b.pend_vel };
+                for (int s = 0; s < MODEL_NUM_STATES; ++s) {
+                    double d = std::fabs(fa[s] - fb[s]);
+                    if (!(d <= x_diff)) x_diff = d;     // NaN is the worst
+                }
+                double d = std::fabs(fleet.get_force(i) - u[i]);
+                if (!(d <= u_diff)) u_diff = d;
+            }
+        }
+        bool fleet_ok = x_diff <= FLEET_CHECK_X_TOL && u_diff <= FLEET_CHECK_U_TOL;
+        os << "Fleet of " << n << (per_plant ? " plants with their own designs" : " plants with the Model.h plant")
+            << " vs InvPendModel, " << FLEET_CHECK_PASSES * FLEET_CHECK_TICKS << " ticks: largest difference state "
+            << x_diff << ", force " << u_diff << (fleet_ok ? ", ok" : ", FAILED") << std::endl;
+        ok = ok && fleet_ok;
+    }
+    return ok;
+}
+
+} // namespace inv_example
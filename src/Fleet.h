@@ -0,0 +1,81 @@
+// Definition of the batched multi-plant simulator
+
+#ifndef __FLEET_H__
+#define __FLEET_H__
+
+#include <cstddef>
+#include <vector>
+#include <memory>
+#include <iosfwd>
+#include "Model.h"
+#include "Ipc.h"
+
+namespace inv_example {
+// ================================================================================
+// Fleet of closed-loop plants
+// N inverted pendulums under state feedback, stored as structure-of-arrays
+// so one step of the whole fleet is a single vectorisable loop per state
+// ================================================================================
+class InvPendFleet
+{
+public: // types
+    struct PlantParams {                        // model and controller of one plant
+        double a[MODEL_NUM_STATES][MODEL_NUM_STATES];
+        double b[MODEL_NUM_STATES];
+        double k[MODEL_NUM_STATES];
+        double nbar;
+    };
+
+public: // constructors
+    // all plants start at rest at the origin with the default model MODEL_A/MODEL_B, CTL_K/CTL_NBAR
+    // fleets of at least MT_MIN_PLANTS plants are stepped on num_threads threads, 0 = one per CPU
+    InvPendFleet(size_t num_plants, unsigned int num_threads = 1);
+    ~InvPendFleet();
+
+public: // methods
+    static PlantParams default_params(void);
+    void set_params(size_t i, const PlantParams& p);    // give plant i its own model, the fleet switches to per-plant coefficients
+    void set_states(size_t i, const InvPendModel::States& x);
+    void set_pos_cmd(size_t i, double pos_cmd) { m_r[i] = pos_cmd; };
+    void set_pos_cmd_all(double pos_cmd);
+    void step(unsigned int ticks = 1);          // advance every plant by ticks periods of 10ms
+    InvPendModel::States get_states(size_t i) const { return InvPendModel::States{ m_x[0][i], m_x[1][i], m_x[2][i], m_x[3][i] }; };
+    double get_cart_pos(size_t i) const { return m_x[0][i]; };
+    double get_force(size_t i) const { return m_u[i]; };   // controller force applied in the last period
+    size_t size(void) const { return m_num_plants; };
+
+public: // constants
+    static const size_t MT_MIN_PLANTS = 4096;   // smaller fleets are not worth the thread handoff
+    static const size_t MT_GRAIN = 1024;        // plants per chunk handed to a worker
+
+private: // methods
+    void step_shared(size_t begin, size_t end, unsigned int ticks);     // plants [begin, end) with the common coefficients
+    void step_per_plant(size_t begin, size_t end, unsigned int ticks);  // plants [begin, end) with their own coefficients
+
+private: // data
+    size_t m_num_plants;
+    std::vector<double> m_x[MODEL_NUM_STATES];  // state i of every plant
+    std::vector<double> m_r;                    // cart position command
+    std::vector<double> m_u;                    // last controller force
+    PlantParams m_shared;                       // coefficients used while no plant has its own
+    bool m_per_plant;
+    // per-plant coefficients, allocated by the first set_params()
+    std::vector<double> m_a[MODEL_NUM_STATES][MODEL_NUM_STATES];
+    std::vector<double> m_b[MODEL_NUM_STATES];
+    std::vector<double> m_k[MODEL_NUM_STATES];
+    std::vector<double> m_nbar;
+    std::unique_ptr<IpcWorkerPool> m_pool;      // null for a single-threaded fleet
+};
+
+
+// ================================================================================
+// Fleet self-check
+// fleets with the shared coefficients and with designs for 100 Hz .. 1 kHz per plant, on two threads,
+// against InvPendModel::on_tick_100hz driven by InvPendModel::feedback from the same states and commands;
+// prints the largest state and force differences, false if any is beyond the tolerance
+// ================================================================================
+bool fleet_check(std::ostream& os);
+
+} // namespace inv_example
+
+#endif // __FLEET_H__
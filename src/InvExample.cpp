@@ -0,0 +1,132 @@
+// Example program
+
+#include <iostream>
+#include "Comms.h"
+#include "Timestamp.h"
+#include "Ipc.h"
+#include "Error.h"
+#include "System.h"
+#include "Plant.h"
+
+#include <iomanip>
+#include <cstdlib>
+#include <ctime>
+#include <chrono>
+#include <string>
+#include <memory>
+
+using namespace std;
+using namespace inv_example;
+
+namespace inv_example {
+void entry_point(const std::string& cart_device, const PlantDesign* design);  // system initialization and main loop
+int sim_entry_point(double duration_s, const char* capture_file, const PlantDesign* design);    // closed-loop simulation on a virtual clock
+int replay_entry_point(const std::string& file_name, bool real_time); // replay a capture through the main loop
+int selftest_entry_point(void);     // numerical checks of the control path
+}
+
+int dbg_count = 0;
+void dbg_callback(void)
+{
+    dbg_count++;
+}
+
+int main(int argc, char *argv[])
+{
+    // real-time options, anywhere on the command line:
+    //   --rt <thread>=<priority>[@<cpus>]  thread is control, rx, tx, timer or logger, priority 1..99 for SCHED_FIFO
+    //                                      or 0, cpus e.g. 2 or 0-1,4; e.g. --rt control=80@2 --rt timer=90@2
+    //   --mlock                            lock memory and prefault the thread stacks
+    // cart interface of the main loop:
+    //   --cart <device>                    device or file the cart commands are written to, e.g. /dev/ttyS0
+    // control rate of the main loop and the simulation:
+    //   --rate <hz>                        e.g. 200, 500 or 1000; the plant is discretised and the controller designed
+    //                                      for the rate at startup; without it the Model.h tables at 100 Hz are used
+    vector<string> args;
+    string cart_device;
+    const PlantDesign* design = nullptr;
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg == "--rt" && i + 1 < argc) {
+            if (!g_sys_rt_config.parse_thread(argv[++i])) {
+                cout << "Bad real-time option --rt " << argv[i] << endl;
+                return 1;
+            }
+        }
+        else if (arg == "--cart" && i + 1 < argc) {
+            cart_device = argv[++i];
+        }
+        else if (arg == "--rate" && i + 1 < argc) {
+            int rate_hz = atoi(argv[++i]);
+            if (rate_hz <= 0 || 1000 % rate_hz != 0) {     // the tick timer counts whole milliseconds
+                cout << "Bad control rate --rate " << argv[i] << ", it must divide 1000 Hz" << endl;
+                return 1;
+            }
+            try {
+                design = &PlantCache::instance().get(PEND_PHYS_DEFAULT, 1.0 / rate_hz);
+            }
+            catch (const InvError& e) {
+                cout << "No controller design for --rate " << argv[i] << endl;
+                cout << e << endl;
+                return 1;
+            }
+        }
+        else if (arg == "--mlock") {
+            g_sys_rt_config.set_lock_memory();
+        }
+        else {
+            args.push_back(arg);
+        }
+    }
+
+    // faster-than-real-time simulation: --sim <seconds> [--capture <file>]
+    if ((args.size() == 2 || (args.size() == 4 && args[2] == "--capture")) && args[0] == "--sim") {
+        return sim_entry_point(stod(args[1]), args.size() == 4 ? args[3].c_str() : nullptr, design);
+    }
+    // capture replay through the main loop: --replay <file> [--fast]
+    if ((args.size() == 2 || (args.size() == 3 && args[2] == "--fast")) && args[0] == "--replay") {
+        return replay_entry_point(args[1], args.size() == 2);
+    }
+    // numerical self-test, exit status 1 if a check fails: --selftest
+    if (args.size() == 1 && args[0] == "--selftest") {
+        return selftest_entry_point();
+    }
+
+    vector<uint8_t> bad_length{ 0xaa, static_cast<uint8_t>(PacketId::FORCE_CMD), 1 };
+    vector<uint8_t> bad_id{ 0xaa, 0xfe, 1, 0 };
+    vector<uint8_t> force_cmd{ 0xaa, static_cast<uint8_t>(PacketId::FORCE_CMD), sizeof(double), 0xC0, 0x5E, 0xDC, 0xCC, 0xCC, 0xCC, 0xCC, 0xCD };    // -123.45
+    vector<uint8_t> bad_data{ 0xaa, static_cast<uint8_t>(PacketId::FORCE_CMD), sizeof(double), 0x5E, 0xDC, 0xCC, 0xCC, 0xCC, 0xCC, 0xCD };           // missing 1st byte
+    vector<uint8_t> cart_data{ 0xaa, static_cast<uint8_t>(PacketId::CART_DATA), 2 * sizeof(double), 0xC0, 0x5E, 0xDC, 0xCC, 0xCC, 0xCC, 0xCC, 0xCD, 0x40, 0x09, 0x21, 0xFB, 0x4D, 0x12, 0xD8, 0x4A };  // -123.45, 3.1415926
+
+    auto msg = CartForceCmdPacket(force_cmd, InvTimestamp());
+    cout << "Force Cmd, Force = " << msg.get_force() << ", Timestamp = " << msg.get_toa() << endl;
+    cout << endl;
+
+    cout << "Timestamp" << endl;
+    auto ts = InvTimestamp();
+    cout << ts << endl;
+    cout << endl;
+
+    try {
+        IpcHighResTimer hrt(10, dbg_callback);
+    }
+    catch (const InvError& e) {
+        cout << "High Res Timer Error" << endl;
+        cout << e << endl;
+    }
+    catch (const exception& e) {
+        cout << "High Res Timer System Error" << endl;
+        cout << e.what() << endl;
+        auto local_error = NewInvErrorException(e);
+        cout << local_error << endl;
+    }
+
+    entry_point(cart_device, design);
+
+    cout << "dbg_count " << dbg_count << endl;
+    auto tend = InvTimestamp();
+    cout << tend << endl;
+    cout << "elapsed " << tend - ts << endl;
+
+    return 0;
+}
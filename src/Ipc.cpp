@@ -0,0 +1,275 @@
+// Platform-independent interprocess communication functions
+
+#include <algorithm>
+#include <chrono>
+
+#include "System.h"
+#include "Ipc.h"
+#include "Error.h"
+
+namespace inv_example {
+// ========================================
+// Spin-wait policy
+// ========================================
+bool ipc_spin_allowed(void)
+{
+    static const bool allowed = std::thread::hardware_concurrency() != 1;   // 0 if unknown, spin then
+    return allowed;
+}
+
+
+// ========================================
+// Timer service
+// one thread serves every periodic and one-shot timer
+// ========================================
+// Start the service thread
+IpcTimerService::IpcTimerService()
+    : m_next_id(1), m_running(0), m_cancel_running(false), m_run(true)
+{
+    m_thread = std::thread(&IpcTimerService::service_thread, this);
+}
+
+// Stop the service thread
+IpcTimerService::~IpcTimerService()
+{
+    {
+        std::unique_lock<std::mutex> lock{ m_mtx };
+        m_run = false;
+        m_cond.notify_one();
+    }
+    m_thread.join();
+}
+
+// The process-wide service, started on first use
+IpcTimerService& IpcTimerService::instance(void)
+{
+    static IpcTimerService service;
+    return service;
+}
+
+// Add a timer
+IpcTimerService::TimerId IpcTimerService::start(int64_t first_ns, int64_t period_ns, TimerCallback cb)
+{
+    std::unique_lock<std::mutex> lock{ m_mtx };
+    TimerId id = m_next_id++;
+    m_timers.emplace(id, Timer{ period_ns, 0, std::move(cb) });
+    m_heap.push(Deadline{ first_ns, id, 0 });
+    if (m_heap.top().id == id) m_cond.notify_one();     // new earliest deadline
+    return id;
+}
+
+// Move the next deadline of a timer
+void IpcTimerService::restart(TimerId id, int64_t first_ns)
+{
+    std::unique_lock<std::mutex> lock{ m_mtx };
+    auto p = m_timers.find(id);
+    if (p == m_timers.end()) return;        // already cancelled or a one-shot that has fired
+    unsigned int gen = ++p->second.gen;     // the old heap entry is now stale
+    m_heap.push(Deadline{ first_ns, id, gen });
+    if (m_heap.top().id == id) m_cond.notify_one();
+}
+
+// Remove a timer
+// waits only if its callback is running on the service thread right now
+void IpcTimerService::cancel(TimerId id)
+{
+    std::unique_lock<std::mutex> lock{ m_mtx };
+    if (m_running == id) {
+        if (std::this_thread::get_id() == m_thread.get_id()) {
+            m_cancel_running = true;        // cancelled from its own callback, removed when the callback returns
+            return;
+        }
+        m_done.wait(lock, [this, id]{ return m_running != id; });
+    }
+    m_timers.erase(id);                     // heap entries are discarded when they reach the top
+}
+
+// Apply scheduling options to the service thread
+// the options are applied by a one-shot timer, on the thread itself
+bool IpcTimerService::configure(const IpcThreadConfig& cfg)
+{
+    auto applied = std::make_shared<std::promise<bool>>();
+    std::future<bool> result = applied->get_future();
+    start(ipc_clock_ns(), 0, [cfg, applied] { applied->set_value(ipc_set_this_thread_config(cfg)); });
+    return result.get();
+}
+
+// Service thread
+// sleeps until the earliest deadline, runs the callback outside the lock and reschedules
+void IpcTimerService::service_thread(void)
+{
+    std::unique_lock<std::mutex> lock{ m_mtx };
+    while (m_run) {
+        if (m_heap.empty()) {
+            m_cond.wait(lock);
+            continue;
+        }
+
+        Deadline next = m_heap.top();
+        auto p = m_timers.find(next.id);
+        if (p == m_timers.end() || p->second.gen != next.gen) {
+            m_heap.pop();                   // cancelled or restarted
+            continue;
+        }
+
+        int64_t now = ipc_clock_ns();
+        if (now < next.t_ns) {
+            m_cond.wait_until(lock, std::chrono::steady_clock::time_point(std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::nanoseconds(next.t_ns))));
+            continue;                       // the heap may have changed while waiting
+        }
+        m_heap.pop();
+
+        // reschedule from the deadline, not from now, skipping any periods already missed
+        Timer& timer = p->second;
+        if (timer.period_ns > 0) {
+            int64_t t = next.t_ns + timer.period_ns;
+            if (t <= now) t += ((now - t) / timer.period_ns + 1) * timer.period_ns;
+            m_heap.push(Deadline{ t, next.id, next.gen });
+        }
+
+        // the timer entry stays in the map while the callback runs, cancel waits for it
+        m_running = next.id;
+        lock.unlock();
+        timer.cb();
+        lock.lock();
+        m_running = 0;
+        if ((timer.period_ns == 0 && timer.gen == next.gen) || m_cancel_running) {     // one-shot done, unless restarted by its callback
+            m_timers.erase(next.id);
+            m_cancel_running = false;
+        }
+        m_done.notify_all();
+    }
+}
+
+
+// ========================================
+// Worker pool
+// runs a parallel-for over an index range on a fixed set of threads
+// ========================================
+// Start the workers
+IpcWorkerPool::IpcWorkerPool(unsigned int num_threads)
+    : m_gen(0), m_busy(0), m_run(true), m_fn(nullptr), m_ctx(nullptr), m_count(0), m_grain(1), m_next(0)
+{
+    if (num_threads == 0) num_threads = std::max(std::thread::hardware_concurrency(), 1u);
+    for (unsigned int i = 1; i < num_threads; ++i) {
+        m_threads.emplace_back(&IpcWorkerPool::worker_thread, this);
+    }
+}
+
+// Stop the workers
+IpcWorkerPool::~IpcWorkerPool()
+{
+    {
+        std::unique_lock<std::mutex> lock{ m_mtx };
+        m_run = false;
+        m_start.notify_all();
+    }
+    for (auto& t : m_threads) t.join();
+}
+
+// Run a job on all threads and wait for it to finish
+void IpcWorkerPool::run_job(size_t count, size_t grain, JobFn fn, void* ctx)
+{
+    if (count == 0) return;
+    {
+        std::unique_lock<std::mutex> lock{ m_mtx };
+        m_fn = fn;
+        m_ctx = ctx;
+        m_count = count;
+        m_grain = std::max(grain, static_cast<size_t>(1));
+        m_next.store(0, std::memory_order_relaxed);
+        m_busy = static_cast<unsigned int>(m_threads.size());
+        ++m_gen;
+        m_start.notify_all();
+    }
+    do_chunks();
+
+    std::unique_lock<std::mutex> lock{ m_mtx };
+    m_done.wait(lock, [this]{ return m_busy == 0; });
+}
+
+// Take chunks of the current job until none are left
+void IpcWorkerPool::do_chunks(void)
+{
+    for (;;) {
+        size_t begin = m_next.fetch_add(m_grain, std::memory_order_relaxed);
+        if (begin >= m_count) break;
+        (*m_fn)(m_ctx, begin, std::min(begin + m_grain, m_count));
+    }
+}
+
+// Worker thread
+void IpcWorkerPool::worker_thread(void)
+{
+    unsigned long long gen = 0;
+    std::unique_lock<std::mutex> lock{ m_mtx };
+    for (;;) {
+        m_start.wait(lock, [this, gen]{ return !m_run || m_gen != gen; });
+        if (!m_run) break;
+        gen = m_gen;
+
+        lock.unlock();
+        do_chunks();
+        lock.lock();
+        if (--m_busy == 0) m_done.notify_one();
+    }
+}
+
+
+// ========================================
+// High-resolution timer
+// Calls a callback function at a periodic rate
+// ========================================
+// Record the timing of this tick, call the callback function and schedule the next deadline
+void IpcHighResTimer::callback(void)
+{
+    int64_t now = ipc_clock_ns();
+
+    // wakeup latency, an early callback counts as on time
+    int64_t late = std::max(now - m_next_ns, static_cast<int64_t>(0));
+    m_late_sum_ns.store(m_late_sum_ns.load(std::memory_order_relaxed) + late, std::memory_order_relaxed);
+    if (late > m_late_max_ns.load(std::memory_order_relaxed)) m_late_max_ns.store(late, std::memory_order_relaxed);
+
+    // interval since the previous tick
+    if (m_last_ns != 0) {
+        int64_t period = now - m_last_ns;
+        if (period < m_period_min_ns.load(std::memory_order_relaxed)) m_period_min_ns.store(period, std::memory_order_relaxed);
+        if (period > m_period_max_ns.load(std::memory_order_relaxed)) m_period_max_ns.store(period, std::memory_order_relaxed);
+    }
+    m_last_ns = now;
+    m_ticks.store(m_ticks.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+
+    (*m_proc)();
+
+    // skip deadlines that passed while the callback ran
+    m_next_ns += m_period_ns;
+    now = ipc_clock_ns();
+    if (now >= m_next_ns) {
+        int64_t skip = (now - m_next_ns) / m_period_ns + 1;
+        m_missed.store(m_missed.load(std::memory_order_relaxed) + skip, std::memory_order_relaxed);
+        m_next_ns += skip * m_period_ns;
+    }
+}
+
+// Timing statistics since the timer started
+// fields are read individually, so a snapshot taken during a tick may mix two ticks
+IpcTimerStats IpcHighResTimer::get_stats(void) const
+{
+    IpcTimerStats stats;
+    stats.ticks = m_ticks.load(std::memory_order_relaxed);
+    stats.missed = m_missed.load(std::memory_order_relaxed);
+    stats.late_mean_us = stats.ticks ? m_late_sum_ns.load(std::memory_order_relaxed) / 1e3 / stats.ticks : 0.0;
+    stats.late_max_us = m_late_max_ns.load(std::memory_order_relaxed) / 1e3;
+
+    int64_t pmin = m_period_min_ns.load(std::memory_order_relaxed);
+    int64_t pmax = m_period_max_ns.load(std::memory_order_relaxed);
+    if (stats.ticks < 2) {
+        pmin = pmax = m_period_ns;      // no interval measured yet
+    }
+    stats.period_min_ms = pmin / 1e6;
+    stats.period_max_ms = pmax / 1e6;
+    stats.jitter_max_us = std::max(m_period_ns - pmin, pmax - m_period_ns) / 1e3;
+    return stats;
+}
+
+} // namespace inv_example
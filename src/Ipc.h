@@ -4,39 +4,91 @@
 #define __IPC_H__
 
 #include <queue>
+#include <vector>
 #include <condition_variable>
 #include <thread>
 #include <chrono>
 #include <memory>
+#include <functional>
+#include <future>
+#include <unordered_map>
+#include <atomic>
+#include <cstdint>
+#include <type_traits>
+#include <algorithm>
+#include <string>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
 
 namespace inv_example {
 
+// ========================================
+// Address wait and wake
+// blocks the calling thread until another thread wakes the address,
+// futex on Linux, WaitOnAddress on Windows
+// ========================================
+void ipc_wait_on_address(std::atomic<uint32_t>& addr, uint32_t expected);  // sleep while addr == expected, may wake spuriously
+void ipc_wake_one(std::atomic<uint32_t>& addr);                            // wake one thread sleeping on addr
+
+// spin-wait hint to the processor
+inline void ipc_cpu_relax(void)
+{
+#if defined(_MSC_VER)
+    _mm_pause();
+#elif defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#else
+    std::this_thread::yield();
+#endif
+}
+
+// true if a thread waiting on another may spin: with one processor the thread it waits on can not run meanwhile
+bool ipc_spin_allowed(void);
+
+
 // ========================================
 // IPC message queue
+// unbounded, any number of producers and consumers
+// Drain and WaitBatch take a burst of messages with one lock
 // ========================================
 template <typename T>
 class IpcQueue
 {
 public: // methods
-    void Send(T& msg);                  // enqueue the message
+    void Send(const T& msg);            // enqueue a copy of the message
+    void Send(T&& msg);                 // enqueue the message
     bool Try(void);                     // return true if a message is available
     T Wait(void);                       // wait for a message to become available
+    bool TryGet(T& msg);                // move a message into msg if one is available
     std::pair<bool, std::unique_ptr<T>> TryGet(void);    // return <true,entry> if one is available, otherwise return <false,nullptr>
+    size_t Drain(std::vector<T>& out, size_t max);       // append up to max messages to out without waiting, return the number taken
+    size_t WaitBatch(std::vector<T>& out, size_t max);   // wait for at least one message, then append up to max to out
+    size_t Size(void);                  // number of messages waiting
 private: // data
     std::queue<T> m_q;
     std::condition_variable m_cond;
     std::mutex m_mtx;
 };
 
-// enqueue a message
+// enqueue a copy of a message
 template <typename T>
-void IpcQueue<T>::Send(T& msg)
+void IpcQueue<T>::Send(const T& msg)
 {
     std::unique_lock<std::mutex> lock{ m_mtx };
     m_q.push(msg);
     m_cond.notify_one();
 }
 
+// enqueue a message
+template <typename T>
+void IpcQueue<T>::Send(T&& msg)
+{
+    std::unique_lock<std::mutex> lock{ m_mtx };
+    m_q.push(std::move(msg));
+    m_cond.notify_one();
+}
+
 
 // return true if a message is available
 template <typename T>
@@ -59,11 +111,23 @@ T IpcQueue<T>::Wait(void)
 }
 
 
+// move a message into the caller's storage without waiting
+template <typename T>
+bool IpcQueue<T>::TryGet(T& msg)
+{
+    std::unique_lock<std::mutex> lock{ m_mtx };
+    if (m_q.empty()) return false;
+    msg = std::move(m_q.front());
+    m_q.pop();
+    return true;
+}
+
+
 // return a message without waiting
 template <typename T>
 std::pair<bool, std::unique_ptr<T>> IpcQueue<T>::TryGet(void)
 {
-    std::pair<bool, unique_ptr<T>> msg(false, nullptr);     // default return value
+    std::pair<bool, std::unique_ptr<T>> msg(false, nullptr);     // default return value
 
     std::unique_lock<std::mutex> lock{ m_mtx };
     if (!m_q.empty()) {
@@ -75,61 +139,584 @@ std::pair<bool, std::unique_ptr<T>> IpcQueue<T>::TryGet(void)
 }
 
 
+// take all pending messages, up to max, without waiting
+// out should have capacity for max messages so appending does not allocate
+template <typename T>
+size_t IpcQueue<T>::Drain(std::vector<T>& out, size_t max)
+{
+    std::unique_lock<std::mutex> lock{ m_mtx };
+    size_t n = std::min(max, m_q.size());
+    for (size_t i = 0; i < n; ++i) {
+        out.push_back(std::move(m_q.front()));
+        m_q.pop();
+    }
+    return n;
+}
+
+
+// wait for a message, then take all pending messages, up to max
+template <typename T>
+size_t IpcQueue<T>::WaitBatch(std::vector<T>& out, size_t max)
+{
+    std::unique_lock<std::mutex> lock{ m_mtx };
+    m_cond.wait(lock, [this]{return !m_q.empty(); });    // keep waiting until queue is not empty
+    size_t n = std::min(max, m_q.size());
+    for (size_t i = 0; i < n; ++i) {
+        out.push_back(std::move(m_q.front()));
+        m_q.pop();
+    }
+    return n;
+}
+
+
+// number of messages waiting
+template <typename T>
+size_t IpcQueue<T>::Size(void)
+{
+    std::unique_lock<std::mutex> lock{ m_mtx };
+    return m_q.size();
+}
+
+
+// ========================================
+// Lock-free IPC message queue
+// bounded ring for exactly one producer thread and one consumer thread,
+// Wait spins briefly, yields once and then sleeps on the address of the ring; on a single processor it does not spin
+// ========================================
+template <typename T, size_t N>
+class IpcSpscQueue
+{
+    static_assert(N >= 2 && (N & (N - 1)) == 0, "IpcSpscQueue length must be a power of 2");
+
+public: // constructors
+    IpcSpscQueue() : m_head(0), m_tail(0), m_sleeping(0), m_head_cache(0), m_tail_cache(0) {};
+    IpcSpscQueue(const IpcSpscQueue&) = delete;
+    ~IpcSpscQueue();                    // destroy messages still in the ring
+
+public: // methods
+    bool Send(const T& msg);            // enqueue a copy of the message, return false if the ring is full
+    bool Send(T&& msg);                 // enqueue the message, return false if the ring is full
+    bool Try(void);                     // return true if a message is available
+    T Wait(void);                       // wait for a message to become available
+    bool TryGet(T& msg);                // move a message into msg if one is available
+    std::pair<bool, std::unique_ptr<T>> TryGet(void);    // return <true,entry> if one is available, otherwise return <false,nullptr>
+    size_t Drain(std::vector<T>& out, size_t max);       // append up to max messages to out without waiting, return the number taken
+    size_t WaitBatch(std::vector<T>& out, size_t max);   // wait for at least one message, then append up to max to out
+    size_t Space(void);                 // free slots, producer only; that many Sends will succeed
+    unsigned long long get_dropped(void) const { return m_dropped.load(std::memory_order_relaxed); };  // messages lost to a full ring
+
+public: // data
+    static constexpr std::chrono::microseconds m_SPIN_TIME{ 20 };  // polling before the consumer yields and sleeps
+
+private: // methods
+    template <typename U> bool push(U&& msg);
+    T take(void);                       // remove the oldest message, the ring must not be empty
+    T* slot(size_t n) { return reinterpret_cast<T*>(&m_slots[n & (N - 1)]); };
+    void wake_consumer(void);
+
+private: // data
+    // producer and consumer indexes are on separate cache lines
+    alignas(64) std::atomic<size_t> m_head;         // next slot to write, free-running, written by producer
+    alignas(64) std::atomic<size_t> m_tail;         // next slot to read, free-running, written by consumer
+    alignas(64) std::atomic<uint32_t> m_sleeping;   // 1 while the consumer is asleep
+    alignas(64) size_t m_head_cache;                // consumer's copy of m_head
+    alignas(64) size_t m_tail_cache;                // producer's copy of m_tail
+    std::atomic<unsigned long long> m_dropped{ 0 };
+    typename std::aligned_storage<sizeof(T), alignof(T)>::type m_slots[N];
+};
+
+// destroy messages still in the ring
+template <typename T, size_t N>
+IpcSpscQueue<T, N>::~IpcSpscQueue()
+{
+    for (size_t n = m_tail.load(); n != m_head.load(); ++n) {
+        slot(n)->~T();
+    }
+}
+
+// enqueue a message
+template <typename T, size_t N>
+template <typename U>
+bool IpcSpscQueue<T, N>::push(U&& msg)
+{
+    size_t head = m_head.load(std::memory_order_relaxed);
+    if (head - m_tail_cache == N) {
+        m_tail_cache = m_tail.load(std::memory_order_acquire);     // only re-read the consumer index when the ring looks full
+        if (head - m_tail_cache == N) {
+            m_dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+    }
+    new (slot(head)) T(std::forward<U>(msg));
+    m_head.store(head + 1, std::memory_order_release);
+    wake_consumer();
+    return true;
+}
+
+template <typename T, size_t N>
+bool IpcSpscQueue<T, N>::Send(const T& msg) { return push(msg); }
+
+template <typename T, size_t N>
+bool IpcSpscQueue<T, N>::Send(T&& msg) { return push(std::move(msg)); }
+
+// wake the consumer if it went to sleep
+// the fence orders the head update before the check, pairs with the fence in Wait
+template <typename T, size_t N>
+void IpcSpscQueue<T, N>::wake_consumer(void)
+{
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (m_sleeping.load(std::memory_order_relaxed)) {
+        m_sleeping.store(0, std::memory_order_relaxed);
+        ipc_wake_one(m_sleeping);
+    }
+}
+
+// free slots
+// only the consumer can change it, and only upwards, so the producer can reserve room for several messages
+template <typename T, size_t N>
+size_t IpcSpscQueue<T, N>::Space(void)
+{
+    m_tail_cache = m_tail.load(std::memory_order_acquire);
+    return N - (m_head.load(std::memory_order_relaxed) - m_tail_cache);
+}
+
+// return true if a message is available
+template <typename T, size_t N>
+bool IpcSpscQueue<T, N>::Try(void)
+{
+    size_t tail = m_tail.load(std::memory_order_relaxed);
+    if (tail != m_head_cache) return true;
+    m_head_cache = m_head.load(std::memory_order_acquire);
+    return tail != m_head_cache;
+}
+
+// remove the oldest message and release its slot to the producer
+template <typename T, size_t N>
+T IpcSpscQueue<T, N>::take(void)
+{
+    size_t tail = m_tail.load(std::memory_order_relaxed);
+    T* p = slot(tail);
+    T msg(std::move(*p));
+    p->~T();
+    m_tail.store(tail + 1, std::memory_order_release);
+    return msg;
+}
+
+// move a message into the caller's storage without waiting
+template <typename T, size_t N>
+bool IpcSpscQueue<T, N>::TryGet(T& msg)
+{
+    if (!Try()) return false;
+    msg = take();
+    return true;
+}
+
+// return a message without waiting
+template <typename T, size_t N>
+std::pair<bool, std::unique_ptr<T>> IpcSpscQueue<T, N>::TryGet(void)
+{
+    std::pair<bool, std::unique_ptr<T>> msg(false, nullptr);     // default return value
+    if (Try()) {
+        msg.first = true;
+        msg.second.reset(new T(take()));
+    }
+    return msg;
+}
+
+// take all pending messages, up to max, without waiting
+// the producer index is read once for the whole batch
+template <typename T, size_t N>
+size_t IpcSpscQueue<T, N>::Drain(std::vector<T>& out, size_t max)
+{
+    size_t tail = m_tail.load(std::memory_order_relaxed);
+    m_head_cache = m_head.load(std::memory_order_acquire);
+    size_t n = std::min(max, m_head_cache - tail);
+    for (size_t i = 0; i < n; ++i) {
+        T* p = slot(tail + i);
+        out.push_back(std::move(*p));
+        p->~T();
+    }
+    m_tail.store(tail + n, std::memory_order_release);
+    return n;
+}
+
+// wait for a message, then take all pending messages, up to max
+template <typename T, size_t N>
+size_t IpcSpscQueue<T, N>::WaitBatch(std::vector<T>& out, size_t max)
+{
+    if (max == 0) return 0;
+    out.push_back(Wait());
+    return 1 + Drain(out, max - 1);
+}
+
+// wait for a message to become available
+template <typename T, size_t N>
+T IpcSpscQueue<T, N>::Wait(void)
+{
+    for (;;) {
+        // spin first, most messages arrive within a few microseconds;
+        // bounded by time, the cost of a pause differs tenfold between processors
+        if (ipc_spin_allowed()) {
+            const auto spin_end = std::chrono::steady_clock::now() + m_SPIN_TIME;
+            do {
+                for (unsigned int i = 0; i < 64; ++i) {
+                    if (Try()) return take();
+                    ipc_cpu_relax();
+                }
+            } while (std::chrono::steady_clock::now() < spin_end);
+        }
+
+        // give the producer the processor before paying for a sleep and a wake
+        std::this_thread::yield();
+        if (Try()) return take();
+
+        // announce the sleep, then check again so a message sent in between is not missed
+        m_sleeping.store(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!Try()) {
+            ipc_wait_on_address(m_sleeping, 1);
+        }
+        m_sleeping.store(0, std::memory_order_relaxed);
+    }
+}
+
+
+// ========================================
+// Lock-free bounded multi-producer queue
+// any number of producer threads and one consumer thread; a producer claims a slot with one
+// compare-and-swap and publishes it through the slot's sequence number, nothing is allocated
+// the consumer polls with Drain
+// ========================================
+template <typename T, size_t N>
+class IpcMpscQueue
+{
+    static_assert(N >= 2 && (N & (N - 1)) == 0, "IpcMpscQueue length must be a power of 2");
+
+public: // constructors
+    IpcMpscQueue();
+    IpcMpscQueue(const IpcMpscQueue&) = delete;
+    ~IpcMpscQueue();                    // destroy messages still in the queue
+
+public: // methods
+    bool Send(const T& msg);            // enqueue a copy of the message, return false if the queue is full
+    bool TryGet(T& msg);                // copy the oldest message into msg if one is available
+    size_t Drain(std::vector<T>& out, size_t max);       // append up to max messages to out without waiting, return the number taken
+    unsigned long long get_dropped(void) const { return m_dropped.load(std::memory_order_relaxed); };  // messages lost to a full queue
+
+private: // types
+    struct Slot {
+        std::atomic<size_t> seq;        // n when free for message n, n + 1 when message n is ready
+        typename std::aligned_storage<sizeof(T), alignof(T)>::type msg;
+        T* get(void) { return reinterpret_cast<T*>(&msg); };
+    };
+
+private: // data
+    alignas(64) std::atomic<size_t> m_head;         // next message number to claim, shared by the producers
+    alignas(64) size_t m_tail;                      // next message number to read, consumer only
+    std::atomic<unsigned long long> m_dropped{ 0 };
+    Slot m_slots[N];
+};
+
+template <typename T, size_t N>
+IpcMpscQueue<T, N>::IpcMpscQueue()
+    : m_head(0), m_tail(0)
+{
+    for (size_t i = 0; i < N; ++i) m_slots[i].seq.store(i, std::memory_order_relaxed);
+}
+
+template <typename T, size_t N>
+IpcMpscQueue<T, N>::~IpcMpscQueue()
+{
+    for (;; ++m_tail) {
+        Slot& slot = m_slots[m_tail & (N - 1)];
+        if (slot.seq.load(std::memory_order_acquire) != m_tail + 1) break;
+        slot.get()->~T();
+    }
+}
+
+// claim the next slot, copy the message in and publish it
+template <typename T, size_t N>
+bool IpcMpscQueue<T, N>::Send(const T& msg)
+{
+    size_t head = m_head.load(std::memory_order_relaxed);
+    for (;;) {
+        Slot& slot = m_slots[head & (N - 1)];
+        size_t seq = slot.seq.load(std::memory_order_acquire);
+        if (seq == head) {
+            if (m_head.compare_exchange_weak(head, head + 1, std::memory_order_relaxed)) {
+                new (slot.get()) T(msg);
+                slot.seq.store(head + 1, std::memory_order_release);
+                return true;
+            }
+        }
+        else if (static_cast<std::ptrdiff_t>(seq - head) < 0) {    // the consumer has not freed the slot, the queue is full
+            m_dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        else {
+            head = m_head.load(std::memory_order_relaxed);     // another producer took the slot
+        }
+    }
+}
+
+// copy the oldest message out and free its slot for message n + N
+template <typename T, size_t N>
+bool IpcMpscQueue<T, N>::TryGet(T& msg)
+{
+    Slot& slot = m_slots[m_tail & (N - 1)];
+    if (slot.seq.load(std::memory_order_acquire) != m_tail + 1) return false;
+    msg = *slot.get();
+    slot.get()->~T();
+    slot.seq.store(m_tail + N, std::memory_order_release);
+    ++m_tail;
+    return true;
+}
+
+// take the pending messages, up to max, without waiting
+template <typename T, size_t N>
+size_t IpcMpscQueue<T, N>::Drain(std::vector<T>& out, size_t max)
+{
+    size_t n = 0;
+    for (; n < max; ++n) {
+        Slot& slot = m_slots[m_tail & (N - 1)];
+        if (slot.seq.load(std::memory_order_acquire) != m_tail + 1) break;
+        out.push_back(*slot.get());
+        slot.get()->~T();
+        slot.seq.store(m_tail + N, std::memory_order_release);
+        ++m_tail;
+    }
+    return n;
+}
+
+
+// ========================================
+// Scheduling options for a thread
+// ========================================
+struct IpcThreadConfig
+{
+    int priority = 0;           // SCHED_FIFO priority 1..99, 0 = normal time-sharing scheduling
+    uint64_t cpus = 0;          // CPUs the thread may run on, bit n for CPU n, 0 = any CPU
+    size_t stack_prefault = 0;  // bytes of stack touched by the thread when the options are applied, so it does not fault on them later
+};
+
+// apply the scheduling options, return false if the process is not allowed to change them;
+// SCHED_FIFO and an affinity mask on Linux, a time-critical priority and an affinity mask on Windows
+bool ipc_set_thread_config(std::thread& t, const IpcThreadConfig& cfg);    // scheduling and CPUs only, the stack can only be prefaulted by the thread itself
+bool ipc_set_this_thread_config(const IpcThreadConfig& cfg);   // the calling thread, e.g. the main loop
+
+// start a thread that applies the options and then runs f; ok is false if they could not be applied
+template <typename F>
+std::thread ipc_start_thread(const IpcThreadConfig& cfg, bool& ok, F f)
+{
+    std::promise<bool> applied;
+    std::future<bool> result = applied.get_future();
+    std::thread t([cfg, f, applied = std::move(applied)]() mutable {
+        applied.set_value(ipc_set_this_thread_config(cfg));
+        f();
+    });
+    ok = result.get();
+    return t;
+}
+
+
+// ========================================
+// Monotonic clock in nanoseconds
+// same time base as the timer deadlines
+// ========================================
+inline int64_t ipc_clock_ns(void)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+// ========================================
+// Timer service
+// one thread serves every periodic and one-shot timer from a min-heap of absolute deadlines
+// ========================================
+class IpcTimerService
+{
+public: // types
+    typedef unsigned long long TimerId;                 // 0 is never a valid id
+    typedef std::function<void(void)> TimerCallback;    // runs on the service thread, must not block
+
+public: // constructors
+    IpcTimerService();
+    IpcTimerService(const IpcTimerService&) = delete;
+    ~IpcTimerService();                                 // stop the service thread, pending timers are dropped
+
+public: // methods
+    static IpcTimerService& instance(void);             // the process-wide service used by IpcTimer
+    TimerId start(int64_t first_ns, int64_t period_ns, TimerCallback cb);  // first deadline in ipc_clock_ns time, period 0 for a one-shot timer
+    void restart(TimerId id, int64_t first_ns);         // move the next deadline of a timer, e.g. to reset a timeout
+    void cancel(TimerId id);                            // no callback for this timer runs after cancel returns
+    bool configure(const IpcThreadConfig& cfg);         // apply scheduling options to the service thread, false if they could not be applied
+
+private: // types
+    struct Timer {
+        int64_t period_ns;          // 0 for a one-shot timer
+        unsigned int gen;           // incremented on restart to invalidate older heap entries
+        TimerCallback cb;
+    };
+
+    struct Deadline {
+        int64_t t_ns;               // absolute deadline
+        TimerId id;
+        unsigned int gen;           // matches Timer::gen while the entry is current
+        bool operator>(const Deadline& d) const { return t_ns > d.t_ns; };
+    };
+
+private: // methods
+    void service_thread(void);
+
+private: // data
+    std::mutex m_mtx;
+    std::condition_variable m_cond;     // wakes the service thread when the earliest deadline changes
+    std::condition_variable m_done;     // signalled after each callback, for cancel
+    std::priority_queue<Deadline, std::vector<Deadline>, std::greater<Deadline>> m_heap;
+    std::unordered_map<TimerId, Timer> m_timers;    // active timers, heap entries for missing ids are discarded
+    TimerId m_next_id;                  // id for the next timer
+    TimerId m_running;                  // timer whose callback is running, 0 if none
+    bool m_cancel_running;              // the running timer cancelled itself
+    bool m_run;                         // stop the service thread when false
+    std::thread m_thread;
+};
+
+
 // ========================================
 // Timer to generate periodic messages
-// low-resolution and low-accuracy timer intended for timeouts and keepalives
+// low-resolution timer intended for timeouts and keepalives,
+// deadlines are absolute so the period does not drift
 // ========================================
-template <typename T>
+template <typename T, typename Q = IpcQueue<T>>
 class IpcTimer
 {
 public: // constructors
-    IpcTimer(unsigned int period_ms, T msg, IpcQueue<T>& q);    // send the specified msg to the q with the given period
+    IpcTimer(unsigned int period_ms, T msg, Q& q, bool periodic = true);   // send the specified msg to the q with the given period, or once after period_ms
     IpcTimer() = delete;                                        // must provide period
+    IpcTimer(const IpcTimer&) = delete;
     ~IpcTimer();                                                // cancel the timer
 
-private: // methods
-    void timer_thread(void);
+public: // methods
+    void restart(void);         // start counting a full period from now, e.g. when a keepalive arrives
 
 private: // data
-    unsigned int m_period;  // timer period in ms
-    T m_msg;            // copy of the message to be sent
-    IpcQueue<T>& m_q;   // destination queue
-    bool m_run = true;  // cancel timer when false
-    std::unique_ptr<std::thread> m_pthread;   // pointer to thread object
+    int64_t m_period_ns;        // timer period
+    T m_msg;                    // copy of the message to be sent
+    Q& m_q;                     // destination queue
+    IpcTimerService::TimerId m_id;      // timer in the shared service
 };
 
 // Create and start a timer that sends the specified msg to the given queue with the given period
-template <typename T>
-IpcTimer<T>::IpcTimer(unsigned int period_ms, T msg, IpcQueue<T>& q)
-    : m_period(period_ms), m_msg(msg), m_q(q)
+template <typename T, typename Q>
+IpcTimer<T, Q>::IpcTimer(unsigned int period_ms, T msg, Q& q, bool periodic)
+    : m_period_ns(static_cast<int64_t>(period_ms) * 1000000), m_msg(msg), m_q(q)
 {
-    // Create and start the thread
-    m_pthread = std::unique_ptr<std::thread>(new std::thread(&IpcTimer<T>::timer_thread, this));
+    m_id = IpcTimerService::instance().start(ipc_clock_ns() + m_period_ns, periodic ? m_period_ns : 0, [this] { m_q.Send(m_msg); });
 }
 
-// timer thread
-template <typename T>
-void IpcTimer<T>::timer_thread(void)
+// Restart the period from now
+template <typename T, typename Q>
+void IpcTimer<T, Q>::restart(void)
 {
-    std::this_thread::sleep_for(std::chrono::milliseconds{ m_period }); // wait one period before first msg
-    while (m_run) {
-        // send msg first so cancelling the timer doesn't result in one additonal msg sent
-        m_q.Send(m_msg);
-        std::this_thread::sleep_for(std::chrono::milliseconds{ m_period });
-    }
+    IpcTimerService::instance().restart(m_id, ipc_clock_ns() + m_period_ns);
 }
 
-// Cancel the timer. May wait for as long as the timer period before returning
-template <typename T>
-IpcTimer<T>::~IpcTimer()
+// Cancel the timer. Returns immediately unless the message is being sent
+template <typename T, typename Q>
+IpcTimer<T, Q>::~IpcTimer()
 {
-    m_run = false;
-    m_pthread->join();
+    IpcTimerService::instance().cancel(m_id);
 }
 
+
+// ========================================
+// Worker pool
+// runs a parallel-for over an index range on a fixed set of threads,
+// the calling thread takes part and run() returns when the whole range is done
+// ========================================
+class IpcWorkerPool
+{
+public: // constructors
+    explicit IpcWorkerPool(unsigned int num_threads);   // total threads including the caller, 0 = one per CPU
+    IpcWorkerPool(const IpcWorkerPool&) = delete;
+    ~IpcWorkerPool();
+
+public: // methods
+    // call f(begin, end) on chunks of [0, count), chunk sizes are multiples of grain except the last
+    template <typename F>
+    void run(size_t count, size_t grain, F& f) { run_job(count, grain, &invoke<F>, &f); };
+    unsigned int size(void) const { return static_cast<unsigned int>(m_threads.size()) + 1; };
+
+private: // types
+    typedef void (*JobFn)(void* ctx, size_t begin, size_t end);
+
+private: // methods
+    template <typename F>
+    static void invoke(void* ctx, size_t begin, size_t end) { (*static_cast<F*>(ctx))(begin, end); };
+    void run_job(size_t count, size_t grain, JobFn fn, void* ctx);
+    void do_chunks(void);                   // take chunks until the range is done
+    void worker_thread(void);
+
+private: // data
+    std::mutex m_mtx;
+    std::condition_variable m_start;        // a new job is ready
+    std::condition_variable m_done;         // a worker finished its part of the job
+    unsigned long long m_gen;               // job number, workers wait for it to change
+    unsigned int m_busy;                    // workers still running the current job
+    bool m_run;                             // stop the workers when false
+    // current job
+    JobFn m_fn;
+    void* m_ctx;
+    size_t m_count;
+    size_t m_grain;
+    std::atomic<size_t> m_next;             // start of the next chunk to hand out
+    std::vector<std::thread> m_threads;
+};
+
+
+// ========================================
+// Memory locking
+// keeps every page of the process, including those mapped later, in RAM so the control path does not
+// page fault; call before the threads start so their stacks are locked too
+// ========================================
+bool ipc_lock_memory(void);     // false if the process is not allowed to lock memory
+
+
+// ========================================
+// Resource usage counters
+// ========================================
+struct IpcUsage
+{
+    unsigned long long minor_faults;    // page faults served without I/O, e.g. first touch of a page
+    unsigned long long major_faults;    // page faults that waited for I/O
+    unsigned long long vol_switches;    // context switches while waiting, e.g. for a message
+    unsigned long long invol_switches;  // context switches when the thread was preempted
+};
+
+bool ipc_get_thread_usage(IpcUsage& usage);     // the calling thread, false if the platform does not count them
+bool ipc_get_process_usage(IpcUsage& usage);    // every thread of the process
+int ipc_current_cpu(void);                      // CPU the calling thread is running on, -1 if unknown
+
+
+// ========================================
+// High-resolution timer statistics
+// ========================================
+struct IpcTimerStats
+{
+    unsigned long long ticks;       // callbacks made
+    unsigned long long missed;      // deadlines skipped because the timer fell behind
+    double late_mean_us;            // mean wakeup latency after the deadline
+    double late_max_us;             // worst wakeup latency after the deadline
+    double period_min_ms;           // shortest interval between callbacks
+    double period_max_ms;           // longest interval between callbacks
+    double jitter_max_us;           // largest deviation of an interval from the nominal period
+};
+
+
 // ========================================
 // High-resolution timer
 // Calls a callback function at a periodic rate
+// deadlines are absolute, a late callback does not delay the following ones
 // ========================================
 class IpcHighResTimer
 {
@@ -137,20 +724,97 @@ public: // types
     typedef void (*IpcHighResTimerCallback)(void);
 
 public: // constructors
-    IpcHighResTimer(unsigned int period_ms, IpcHighResTimerCallback proc);  // Create and start a timer with the given period and callback function
+    // Create and start a timer with the given period and callback function
+    // the thread configuration applies to platforms where the timer owns its thread
+    IpcHighResTimer(unsigned int period_ms, IpcHighResTimerCallback proc, IpcThreadConfig cfg = IpcThreadConfig());
     IpcHighResTimer() = delete;                                             // must specify period and callback
     ~IpcHighResTimer();                                                     // cancel the timer
 
 public: // methods
-    void callback(void) { (*m_proc)(); };
+    void callback(void);                    // record the tick timing and call the callback function
+    IpcTimerStats get_stats(void) const;    // timing statistics since the timer started
 
 private: // data
     IpcHighResTimerCallback m_proc;         // pointer to callback function
+    int64_t m_period_ns;                    // nominal period
+    int64_t m_next_ns;                      // deadline of the next tick, see ipc_clock_ns
+    int64_t m_last_ns;                      // time of the previous tick, 0 before the first tick
+
+    // statistics, written by the timer thread only
+    std::atomic<unsigned long long> m_ticks{ 0 };
+    std::atomic<unsigned long long> m_missed{ 0 };
+    std::atomic<int64_t> m_late_sum_ns{ 0 };
+    std::atomic<int64_t> m_late_max_ns{ 0 };
+    std::atomic<int64_t> m_period_min_ns{ INT64_MAX };
+    std::atomic<int64_t> m_period_max_ns{ 0 };
+
+#if defined(_WIN32)
     unsigned int m_timerid;                 // timer ID returned by windows
+#else
+    void timer_thread(void);                // sleeps until each deadline on CLOCK_MONOTONIC
+    std::atomic<bool> m_run{ true };        // cancel timer when false
+    std::thread m_thread;
+#endif
+};
+
+
+// ========================================
+// Read-only memory-mapped file
+// pages are read on first access, so a large file costs nothing until it is used;
+// mmap on Linux, a file mapping on Windows
+// ========================================
+class IpcMappedFile
+{
+public: // constructors
+    explicit IpcMappedFile(const std::string& file_name);  // map the whole file, throws InvError if it can not be mapped
+    IpcMappedFile(const IpcMappedFile&) = delete;
+    ~IpcMappedFile();                                       // unmap the file
+
+public: // methods
+    const uint8_t* data(void) const { return m_data; };     // nullptr for an empty file
+    size_t size(void) const { return m_size; };
+
+private: // data
+    const uint8_t* m_data;
+    size_t m_size;
+#if defined(_WIN32)
+    void* m_file;                           // file and mapping handles
+    void* m_map;
+#endif
+};
+
+
+// ========================================
+// Append-only file
+// unbuffered writes with an explicit sync to the storage device,
+// write and fsync on Linux, WriteFile and FlushFileBuffers on Windows
+// ========================================
+class IpcFile
+{
+public: // constructors
+    IpcFile();
+    IpcFile(const IpcFile&) = delete;
+    ~IpcFile() { close(); };
+
+public: // methods
+    bool open(const std::string& file_name);    // create the file or append to it, false if it can not be opened
+    void close(void);
+    bool is_open(void) const;
+    bool write(const char* data, size_t len);   // false if not all of the data was written
+    bool sync(void);                            // wait until the data written is on the storage device
+    uint64_t size(void) const { return m_size; };   // file size, including data appended before it was opened
+
+private: // data
+    uint64_t m_size;
+#if defined(_WIN32)
+    void* m_handle;
+#else
+    int m_fd;
+#endif
 };
 
 
 } // namespace inv_example
 
-#endif __IPC_H__
+#endif // __IPC_H__
 
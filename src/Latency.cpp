@@ -0,0 +1,78 @@
+// Latency histogram implementation
+
+#include <cstdio>
+#include "Latency.h"
+
+namespace inv_example {
+// ================================================================================
+// Latency histogram
+// ================================================================================
+// largest time counted in bucket i, the inverse of bucket()
+int64_t InvLatencyHistogram::bucket_high(size_t i)
+{
+    if (i < 2 * LAT_SUB_BUCKETS) return static_cast<int64_t>(i);
+    unsigned int shift = static_cast<unsigned int>(i / LAT_SUB_BUCKETS) - 1;
+    uint64_t sub = i % LAT_SUB_BUCKETS + LAT_SUB_BUCKETS;
+    return static_cast<int64_t>(((sub + 1) << shift) - 1);
+}
+
+// walk the buckets up to the p % sample
+// samples recorded while walking may or may not be counted
+int64_t InvLatencyHistogram::percentile(double p) const
+{
+    unsigned long long count = m_count.load(std::memory_order_acquire);
+    if (count == 0) return 0;
+    unsigned long long rank = static_cast<unsigned long long>(p / 100.0 * count + 0.5);
+    if (rank < 1) rank = 1;
+    if (rank > count) rank = count;
+    unsigned long long seen = 0;
+    for (size_t i = 0; i < LAT_NUM_BUCKETS; ++i) {
+        seen += m_buckets[i].load(std::memory_order_relaxed);
+        if (seen >= rank) {
+            int64_t high = bucket_high(i);
+            int64_t max = m_max_ns.load(std::memory_order_relaxed);
+            return high < max ? high : max;
+        }
+    }
+    return m_max_ns.load(std::memory_order_relaxed);
+}
+
+InvLatencySummary InvLatencyHistogram::get_summary(void) const
+{
+    unsigned long long count = get_count();
+    return InvLatencySummary{ count, percentile(50.0), percentile(99.0), percentile(99.9), m_max_ns.load(std::memory_order_relaxed),
+        count > 0 ? static_cast<double>(m_sum_ns.load(std::memory_order_relaxed)) / count : 0.0 };
+}
+
+
+// ================================================================================
+// Sensor to actuator stages
+// ================================================================================
+const char* latency_stage_name(LatencyStage stage)
+{
+    switch (stage) {
+    case LatencyStage::FRAME:           return "Frame";
+    case LatencyStage::ENQUEUE:         return "Enqueue";
+    case LatencyStage::QUEUE:           return "Queue";
+    case LatencyStage::WAIT:            return "Wait";
+    case LatencyStage::TICK:            return "Tick";
+    case LatencyStage::SENSOR_TO_FORCE: return "SensorToForce";
+    default:                            return "Unknown";
+    }
+}
+
+//   Stage            Count       p50       p99     p99.9       Max      Mean  (us)
+void InvLatencyStages::print(std::ostream& os) const
+{
+    char line[128];
+    std::snprintf(line, sizeof(line), "%-15s %10s %9s %9s %9s %9s %9s  (us)\n", "Stage", "Count", "p50", "p99", "p99.9", "Max", "Mean");
+    os << line;
+    for (int i = 0; i < LATENCY_NUM_STAGES; ++i) {
+        InvLatencySummary s = m_hist[i].get_summary();
+        std::snprintf(line, sizeof(line), "%-15s %10llu %9.1f %9.1f %9.1f %9.1f %9.1f\n", latency_stage_name(static_cast<LatencyStage>(i)),
+            s.count, s.p50 / 1e3, s.p99 / 1e3, s.p999 / 1e3, s.max / 1e3, s.mean / 1e3);
+        os << line;
+    }
+}
+
+} // namespace inv_example
@@ -0,0 +1,125 @@
+// Latency histogram definitions
+// where the time goes between a sensor byte arriving and the cart force being sent
+
+#ifndef __LATENCY_H__
+#define __LATENCY_H__
+
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <iostream>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace inv_example {
+// ================================================================================
+// Latency summary, ns
+// percentiles are the upper edge of their bucket, within 1 / LAT_SUB_BUCKETS of the true value
+// ================================================================================
+struct InvLatencySummary {
+    unsigned long long count;
+    int64_t p50;
+    int64_t p99;
+    int64_t p999;
+    int64_t max;                        // exact
+    double mean;
+};
+
+
+// ================================================================================
+// Latency histogram
+// log-linear buckets as in HDR histograms: each power of 2 is split into LAT_SUB_BUCKETS,
+// so the relative error is the same from ns to minutes; record() is a few relaxed atomic adds
+// and can be called from any thread while others read the percentiles
+// ================================================================================
+const unsigned int LAT_SUB_BITS = 5;
+const unsigned int LAT_SUB_BUCKETS = 1u << LAT_SUB_BITS;    // 3 % resolution
+const unsigned int LAT_MAX_BITS = 40;                       // 2^40 ns = 18 min, longer times count as the largest bucket
+const size_t LAT_NUM_BUCKETS = (LAT_MAX_BITS - LAT_SUB_BITS + 1) * LAT_SUB_BUCKETS;
+
+class InvLatencyHistogram
+{
+public: // constructors
+    InvLatencyHistogram() {};
+    InvLatencyHistogram(const InvLatencyHistogram&) = delete;
+
+public: // methods
+    void record(int64_t ns);            // negative times count as 0
+    unsigned long long get_count(void) const { return m_count.load(std::memory_order_relaxed); };
+    int64_t percentile(double p) const; // time below which p % of the samples fall, 0 if there are none
+    InvLatencySummary get_summary(void) const;
+
+private: // methods
+    static size_t bucket(uint64_t ns);
+    static int64_t bucket_high(size_t i);       // largest time counted in bucket i
+
+private: // data
+    std::atomic<unsigned long long> m_count{ 0 };
+    std::atomic<unsigned long long> m_sum_ns{ 0 };
+    std::atomic<int64_t> m_max_ns{ 0 };
+    std::atomic<unsigned long long> m_buckets[LAT_NUM_BUCKETS] = {};
+};
+
+// bucket of a time: the first 2 * LAT_SUB_BUCKETS ns one each, then LAT_SUB_BUCKETS per power of 2
+inline size_t InvLatencyHistogram::bucket(uint64_t ns)
+{
+    if (ns < 2 * LAT_SUB_BUCKETS) return static_cast<size_t>(ns);
+    if (ns >> LAT_MAX_BITS) return LAT_NUM_BUCKETS - 1;
+#if defined(_MSC_VER)
+    unsigned long msb;
+    _BitScanReverse64(&msb, ns);
+#else
+    unsigned int msb = 63 - __builtin_clzll(ns);
+#endif
+    unsigned int shift = static_cast<unsigned int>(msb) - LAT_SUB_BITS;
+    return static_cast<size_t>(shift * LAT_SUB_BUCKETS + (ns >> shift));     // ns >> shift is LAT_SUB_BUCKETS .. 2 * LAT_SUB_BUCKETS - 1
+}
+
+inline void InvLatencyHistogram::record(int64_t ns)
+{
+    if (ns < 0) ns = 0;
+    m_buckets[bucket(static_cast<uint64_t>(ns))].fetch_add(1, std::memory_order_relaxed);
+    m_sum_ns.fetch_add(static_cast<unsigned long long>(ns), std::memory_order_relaxed);
+    int64_t max = m_max_ns.load(std::memory_order_relaxed);
+    while (ns > max && !m_max_ns.compare_exchange_weak(max, ns, std::memory_order_relaxed)) {
+    }
+    m_count.fetch_add(1, std::memory_order_release);
+}
+
+
+// ================================================================================
+// Sensor to actuator stages
+// the stages of one sensor sample add up to SENSOR_TO_FORCE
+// ================================================================================
+enum class LatencyStage : int {
+    FRAME,                  // first byte arrived -> frame complete in the parser
+    ENQUEUE,                // frame complete -> IpcMsg sent to the main loop
+    QUEUE,                  // sent -> taken from the queue by the main loop
+    WAIT,                   // taken from the queue -> next control tick
+    TICK,                   // control tick taken from the queue -> model feedback done and force packet encoded
+    SENSOR_TO_FORCE,        // first byte arrived -> force packet encoded, for the oldest sample used by the tick
+};
+const int LATENCY_NUM_STAGES = 6;
+
+const char* latency_stage_name(LatencyStage stage);
+
+class InvLatencyStages
+{
+public: // constructors
+    InvLatencyStages() {};
+    InvLatencyStages(const InvLatencyStages&) = delete;
+
+public: // methods
+    void record(LatencyStage stage, int64_t ns) { m_hist[static_cast<int>(stage)].record(ns); };
+    const InvLatencyHistogram& get(LatencyStage stage) const { return m_hist[static_cast<int>(stage)]; };
+    void print(std::ostream& os) const;     // a table of the percentiles of each stage in us
+
+private: // data
+    InvLatencyHistogram m_hist[LATENCY_NUM_STAGES];
+};
+
+} // namespace inv_example
+
+#endif // __LATENCY_H__
@@ -0,0 +1,246 @@
+// Linux implementation of interprocess communication functions
+
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <alloca.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <cerrno>
+#include <stdexcept>
+
+#include "System.h"
+#include "Ipc.h"
+#include "Error.h"
+
+namespace inv_example {
+// ========================================
+// Address wait and wake
+// private futex, the word is only shared between threads of this process
+// ========================================
+void ipc_wait_on_address(std::atomic<uint32_t>& addr, uint32_t expected)
+{
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&addr), FUTEX_WAIT_PRIVATE, expected, nullptr, nullptr, 0);
+}
+
+void ipc_wake_one(std::atomic<uint32_t>& addr)
+{
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&addr), FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+}
+
+
+// ========================================
+// Apply scheduling options to a thread
+// returns false if the process is not allowed to change them;
+// priority 0 and no CPUs undo options the thread inherited from its creator
+// ========================================
+static bool apply_thread_config(pthread_t t, const IpcThreadConfig& cfg)
+{
+    bool ok = true;
+    sched_param param{};
+    param.sched_priority = cfg.priority;
+    ok = pthread_setschedparam(t, cfg.priority > 0 ? SCHED_FIFO : SCHED_OTHER, &param) == 0 && ok;
+
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+        if (cfg.cpus == 0 || (cpu < 64 && (cfg.cpus >> cpu) & 1)) CPU_SET(cpu, &cpus);     // the kernel leaves out CPUs the process may not use
+    }
+    ok = pthread_setaffinity_np(t, sizeof(cpus), &cpus) == 0 && ok;
+    return ok;
+}
+
+// touch the pages of the next bytes of stack below the caller
+static void __attribute__((noinline)) prefault_stack(size_t bytes)
+{
+    volatile uint8_t* p = static_cast<volatile uint8_t*>(alloca(bytes));
+    const size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    for (size_t i = 0; i < bytes; i += page) p[i] = 0;
+}
+
+bool ipc_set_thread_config(std::thread& t, const IpcThreadConfig& cfg)
+{
+    return apply_thread_config(t.native_handle(), cfg);
+}
+
+bool ipc_set_this_thread_config(const IpcThreadConfig& cfg)
+{
+    if (cfg.stack_prefault > 0) prefault_stack(cfg.stack_prefault);
+    return apply_thread_config(pthread_self(), cfg);
+}
+
+
+// ========================================
+// Memory locking
+// ========================================
+bool ipc_lock_memory(void)
+{
+    return mlockall(MCL_CURRENT | MCL_FUTURE) == 0;
+}
+
+
+// ========================================
+// Resource usage counters
+// ========================================
+static bool get_usage(int who, IpcUsage& usage)
+{
+    rusage ru;
+    if (getrusage(who, &ru) != 0) return false;
+    usage.minor_faults = static_cast<unsigned long long>(ru.ru_minflt);
+    usage.major_faults = static_cast<unsigned long long>(ru.ru_majflt);
+    usage.vol_switches = static_cast<unsigned long long>(ru.ru_nvcsw);
+    usage.invol_switches = static_cast<unsigned long long>(ru.ru_nivcsw);
+    return true;
+}
+
+bool ipc_get_thread_usage(IpcUsage& usage)
+{
+    return get_usage(RUSAGE_THREAD, usage);
+}
+
+bool ipc_get_process_usage(IpcUsage& usage)
+{
+    return get_usage(RUSAGE_SELF, usage);
+}
+
+int ipc_current_cpu(void)
+{
+    return sched_getcpu();
+}
+
+
+// ========================================
+// High-resolution timer
+// Calls a callback function at a periodic rate
+// ========================================
+// Create and start a timer with the given period and callback function
+IpcHighResTimer::IpcHighResTimer(unsigned int period_ms, IpcHighResTimerCallback proc, IpcThreadConfig cfg)
+{
+    if (period_ms == 0) {
+        throw std::invalid_argument("High Res Timer period out of range");
+    }
+    if (proc == nullptr) {
+        throw std::invalid_argument("High Res Timer has a null callback");
+    }
+
+    m_proc = proc;
+    m_period_ns = static_cast<int64_t>(period_ms) * 1000000;
+    m_next_ns = ipc_clock_ns() + m_period_ns;
+    m_last_ns = 0;
+    bool ok;
+    m_thread = ipc_start_thread(cfg, ok, [this] { timer_thread(); });
+
+    // running without real-time privileges is allowed, but reported
+    if (!ok) {
+        enqueue_error(NewInvError(SYSERR_THREAD_CONFIG_FAILED));
+    }
+}
+
+// Timer thread
+// sleeps until each absolute deadline so the period does not drift
+void IpcHighResTimer::timer_thread(void)
+{
+    while (m_run.load(std::memory_order_relaxed)) {
+        timespec deadline;
+        deadline.tv_sec = static_cast<time_t>(m_next_ns / 1000000000);
+        deadline.tv_nsec = static_cast<long>(m_next_ns % 1000000000);
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, nullptr) == EINTR) {
+            // interrupted by a signal, sleep again until the same deadline
+        }
+        if (!m_run.load(std::memory_order_relaxed)) break;
+        callback();
+    }
+}
+
+// Cancel the timer. May wait for as long as the timer period before returning
+IpcHighResTimer::~IpcHighResTimer()
+{
+    m_run = false;
+    m_thread.join();
+}
+
+// ========================================
+// Read-only memory-mapped file
+// ========================================
+IpcMappedFile::IpcMappedFile(const std::string& file_name)
+    : m_data(nullptr), m_size(0)
+{
+    int fd = open(file_name.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) throw NewInvError(SYSERR_FILE_MAP_FAILED);
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        throw NewInvError(SYSERR_FILE_MAP_FAILED);
+    }
+    m_size = static_cast<size_t>(st.st_size);
+    if (m_size > 0) {
+        void* p = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p == MAP_FAILED) {
+            close(fd);
+            throw NewInvError(SYSERR_FILE_MAP_FAILED);
+        }
+        m_data = static_cast<const uint8_t*>(p);
+    }
+    close(fd);                          // the mapping keeps the file open
+}
+
+IpcMappedFile::~IpcMappedFile()
+{
+    if (m_data) munmap(const_cast<uint8_t*>(m_data), m_size);
+}
+
+
+// ========================================
+// Append-only file
+// ========================================
+IpcFile::IpcFile()
+    : m_size(0), m_fd(-1)
+{
+}
+
+bool IpcFile::open(const std::string& file_name)
+{
+    close();
+    m_fd = ::open(file_name.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (m_fd < 0) return false;
+    struct stat st;
+    m_size = fstat(m_fd, &st) == 0 ? static_cast<uint64_t>(st.st_size) : 0;
+    return true;
+}
+
+void IpcFile::close(void)
+{
+    if (m_fd >= 0) ::close(m_fd);
+    m_fd = -1;
+    m_size = 0;
+}
+
+bool IpcFile::is_open(void) const
+{
+    return m_fd >= 0;
+}
+
+bool IpcFile::write(const char* data, size_t len)
+{
+    while (len > 0 && m_fd >= 0) {
+        ssize_t n = ::write(m_fd, data, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        data += n;
+        len -= static_cast<size_t>(n);
+        m_size += static_cast<uint64_t>(n);
+    }
+    return len == 0;
+}
+
+bool IpcFile::sync(void)
+{
+    return m_fd >= 0 && fdatasync(m_fd) == 0;
+}
+
+} // namespace inv_example
@@ -0,0 +1,245 @@
+// Log file implementation
+
+#include <cstdio>
+#include <chrono>
+#include <iostream>
+#include <algorithm>
+#include <mutex>
+#include "Logger.h"
+#include "System.h"
+
+namespace inv_example {
+static std::atomic<uint64_t> g_logger_id{ 0 };
+
+// loggers that exist, so a thread that exits frees its ring only if the logger is still there;
+// taken when a logger is created or destroyed and when a thread that logged changes logger or exits
+static std::mutex g_loggers_lock;
+static std::vector<std::pair<uint64_t, InvLogger*>> g_loggers;
+
+// ================================================================================
+// Logger
+// ================================================================================
+InvLogger::InvLogger(const InvErrorTable& table)
+    : m_table(table),
+    m_id(++g_logger_id),
+    m_cfg(LOG_CONFIG_DEFAULT)
+{
+    std::lock_guard<std::mutex> lock(g_loggers_lock);
+    g_loggers.emplace_back(m_id, this);
+}
+
+InvLogger::~InvLogger()
+{
+    close();
+    std::lock_guard<std::mutex> lock(g_loggers_lock);
+    g_loggers.erase(std::find(g_loggers.begin(), g_loggers.end(), std::make_pair(m_id, this)));
+}
+
+// create or append to the log file and start the writer thread
+bool InvLogger::open(const std::string& file_name, const LogConfig& cfg)
+{
+    close();
+    m_file_name = file_name;
+    m_cfg = cfg;
+    if (!m_file.open(m_file_name)) return false;
+
+    m_run = true;
+    bool ok;
+    m_thread = ipc_start_thread(m_cfg.thread, ok, [this] { writer_thread(); });
+    m_open = true;
+    if (!ok) enqueue_error(NewInvError(SYSERR_THREAD_CONFIG_FAILED));     // logged once the writer runs
+    return true;
+}
+
+// stop the writer thread after it has written every queued record
+void InvLogger::close(void)
+{
+    m_open = false;
+    if (m_thread.joinable()) {
+        m_run = false;
+        m_thread.join();
+    }
+    m_file.close();
+}
+
+// queue a record
+// called from any thread, copies the record into the ring of the calling thread and returns
+bool InvLogger::log(InvErrorCode code, int line, const char* file)
+{
+    if (!m_open.load(std::memory_order_acquire)) return false;
+    LogRing* ring = thread_ring();
+    if (ring == nullptr) {
+        m_no_ring.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    return ring->Send(LogRecord{ InvTimestamp().to_ns(), file, code, line, 0, 0, 0 });
+}
+
+bool InvLogger::log(const InvError& err)
+{
+    if (!m_open.load(std::memory_order_acquire)) return false;
+    LogRing* ring = thread_ring();
+    if (ring == nullptr) {
+        m_no_ring.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    return ring->Send(LogRecord{ err.get_time().to_ns(), err.get_file(), err.get_code(), err.get_line(), err.get_msg_id(), 0, 0 });
+}
+
+bool InvLogger::log(const InvErrorSummary& summary)
+{
+    if (!m_open.load(std::memory_order_acquire)) return false;
+    LogRing* ring = thread_ring();
+    if (ring == nullptr) {
+        m_no_ring.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    return ring->Send(LogRecord{ InvTimestamp().to_ns(), summary.file, summary.code, summary.line, 0, summary.count, summary.window_ms });
+}
+
+unsigned long long InvLogger::get_dropped(void) const
+{
+    unsigned long long n = m_no_ring.load(std::memory_order_relaxed);
+    for (const auto& ring : m_rings) n += ring.get_dropped();
+    return n;
+}
+
+// the ring of the calling thread
+// a thread claims a free ring the first time it logs and frees it when it exits or logs to another logger;
+// records still in the ring are written, the next thread to claim it queues behind them
+InvLogger::LogRing* InvLogger::thread_ring(void)
+{
+    struct ThreadRing {
+        uint64_t id;
+        size_t slot;                    // MAX_THREADS if there was no free ring
+        LogRing* ring;
+        ~ThreadRing() { if (ring) release_ring(id, slot); };
+    };
+    static thread_local ThreadRing cache{ 0, MAX_THREADS, nullptr };
+    if (cache.id != m_id) {
+        if (cache.ring) release_ring(cache.id, cache.slot);
+        cache.id = m_id;
+        cache.slot = MAX_THREADS;
+        cache.ring = nullptr;
+        for (size_t i = 0; i < MAX_THREADS; ++i) {
+            bool owned = false;
+            if (m_ring_owned[i].compare_exchange_strong(owned, true, std::memory_order_acquire)) {
+                size_t n = m_num_rings.load(std::memory_order_relaxed);
+                while (n <= i && !m_num_rings.compare_exchange_weak(n, i + 1, std::memory_order_release)) {}
+                cache.slot = i;
+                cache.ring = &m_rings[i];
+                break;
+            }
+        }
+    }
+    return cache.ring;
+}
+
+// the release hands the producer end of the ring to the thread that claims it next
+void InvLogger::release_ring(uint64_t id, size_t slot)
+{
+    std::lock_guard<std::mutex> lock(g_loggers_lock);
+    for (const auto& logger : g_loggers) {
+        if (logger.first == id) logger.second->m_ring_owned[slot].store(false, std::memory_order_release);
+    }
+}
+
+// Writer thread
+// takes the records from every ring, writes them in time order and syncs the file at most every sync_ms
+void InvLogger::writer_thread(void)
+{
+    std::vector<LogRecord> batch;
+    batch.reserve(MAX_THREADS * RING_LEN);
+    auto last_sync = std::chrono::steady_clock::now();
+    bool unsynced = false;
+    bool run = true;
+    while (run) {
+        run = m_run.load(std::memory_order_acquire);       // one more pass after close to empty the rings
+        batch.clear();
+        size_t num_rings = m_num_rings.load(std::memory_order_acquire);
+        if (num_rings > MAX_THREADS) num_rings = MAX_THREADS;
+        for (size_t i = 0; i < num_rings; ++i) m_rings[i].Drain(batch, RING_LEN);
+
+        bool fatal = false;
+        if (!batch.empty()) {
+            fatal = write_batch(batch);
+            unsynced = true;
+        }
+        auto now = std::chrono::steady_clock::now();
+        if (unsynced && (fatal || !run || now - last_sync >= std::chrono::milliseconds(m_cfg.sync_ms))) {
+            m_file.sync();
+            last_sync = now;
+            unsynced = false;
+        }
+        if (m_file.size() >= m_cfg.max_bytes) rotate();
+        if (batch.empty() && run) std::this_thread::sleep_for(std::chrono::milliseconds(POLL_MS));
+    }
+}
+
+// format the records in time order and write them with one call
+bool InvLogger::write_batch(std::vector<LogRecord>& batch)
+{
+    std::stable_sort(batch.begin(), batch.end(), [](const LogRecord& a, const LogRecord& b) { return a.t_ns < b.t_ns; });
+    bool fatal = false;
+    m_text.clear();
+    for (const auto& rec : batch) {
+        fatal = fatal || m_table.LookupErrorLevel(rec.code) == InvErrorLevel::FATAL;
+        format(rec, m_text);
+    }
+    m_file.write(m_text.data(), m_text.size());
+    if (m_cfg.console) std::cout << m_text << std::flush;
+    m_written.fetch_add(batch.size(), std::memory_order_relaxed);
+    return fatal;
+}
+
+// one line of the log file
+//   HH:MM:SS.ssss:L:Filename:Line:Message
+// errors held back by the rate limit are one line, with the message
+//   Code x Count in last Window s: Message
+void InvLogger::format(const LogRecord& rec, std::string& out)
+{
+    char time[14];
+    InvTimestamp::from_ns(rec.t_ns).format(time, sizeof(time));
+
+    // file name without its directory, at most 15 characters
+    const char* file = rec.file ? rec.file : "";
+    for (const char* p = file; *p; ++p) {
+        if (*p == '/' || *p == '\\') file = p + 1;
+    }
+
+    int level = 3;
+    switch (m_table.LookupErrorLevel(rec.code)) {
+    case InvErrorLevel::FATAL:      level = 1; break;
+    case InvErrorLevel::WARNING:    level = 2; break;
+    default:                        level = 3; break;
+    }
+
+    const char* msg = rec.msg_id ? inv_msg_text(rec.msg_id) : m_table.LookupErrorMsg(rec.code);
+    char repeat[256];
+    if (rec.repeat > 0) {
+        std::snprintf(repeat, sizeof(repeat), "%d x %u in last %g s: %s", rec.code, rec.repeat, rec.window_ms / 1000.0, msg);
+        msg = repeat;
+    }
+
+    char line[40 + 15 + 255];
+    int n = std::snprintf(line, sizeof(line), "%s:%d:%.15s:%05d:%.255s\n", time, level, file,
+        std::min(std::max(rec.line, 0), 99999), msg);
+    if (n > 0) out.append(line, std::min(static_cast<size_t>(n), sizeof(line) - 1));
+}
+
+// rename name -> name.1 -> name.2 ... and start a new file
+void InvLogger::rotate(void)
+{
+    m_file.sync();
+    m_file.close();
+    for (unsigned int i = m_cfg.max_files; i > 0; --i) {
+        std::string to = m_file_name + "." + std::to_string(i);
+        std::string from = i > 1 ? m_file_name + "." + std::to_string(i - 1) : m_file_name;
+        std::remove(to.c_str());        // rename does not replace a file on every platform
+        std::rename(from.c_str(), to.c_str());
+    }
+    if (m_cfg.max_files == 0) std::remove(m_file_name.c_str());
+    m_file.open(m_file_name);
+}
+
+} // namespace inv_example
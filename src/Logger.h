@@ -0,0 +1,107 @@
+// Log file definitions
+
+#ifndef __LOGGER_H__
+#define __LOGGER_H__
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include "Ipc.h"
+#include "Error.h"
+#include "ErrorLimit.h"
+
+namespace inv_example {
+// ================================================================================
+// Log record
+// fixed size, nothing is formatted or copied from the heap when it is logged;
+// the message and level come from the error table when the record is written
+// ================================================================================
+struct LogRecord {
+    int64_t t_ns;                       // steady clock, see InvTimestamp::to_ns
+    const char* file;                   // __FILE__, static storage
+    InvErrorCode code;
+    int line;
+    InvMsgId msg_id;                    // exception message, 0 for the message of the code
+    uint32_t repeat;                    // errors of the code held back in the window, 0 for a single error
+    uint32_t window_ms;
+};
+
+
+// ================================================================================
+// Log file options
+// ================================================================================
+struct LogConfig {
+    uint64_t max_bytes;                 // a larger file is renamed to name.1 and a new file started
+    unsigned int max_files;             // rotated files kept, name.1 .. name.max_files
+    unsigned int sync_ms;               // longest time written lines wait for fsync, fatal errors are synced at once
+    bool console;                       // also write the lines to the console
+    IpcThreadConfig thread;             // scheduling options of the writer thread
+};
+
+const LogConfig LOG_CONFIG_DEFAULT{ 16u << 20, 4, 1000, true };
+
+
+// ================================================================================
+// Logger
+// writes the Log File Format of doc/InterfaceDefinitions.txt
+//   Time:Log_Level:Filename:Line:Message
+// each thread that logs gets its own lock-free ring, a writer thread takes the records from all rings,
+// formats them in time order and appends them to the file; log() never formats, locks or does I/O
+// ================================================================================
+class InvLogger
+{
+public: // constructors
+    explicit InvLogger(const InvErrorTable& table);     // records are dropped until the log is opened
+    InvLogger(const InvLogger&) = delete;
+    ~InvLogger();
+
+public: // methods
+    bool open(const std::string& file_name, const LogConfig& cfg = LOG_CONFIG_DEFAULT);    // start the writer, false if the file can not be created
+    void close(void);                   // write the records still queued, sync and close the file
+    bool log(const InvError& err);      // queue a record, false if it was dropped
+    bool log(InvErrorCode code, int line, const char* file);
+    bool log(const InvErrorSummary& summary);   // one line for the errors held back by the rate limit
+    unsigned long long get_dropped(void) const;     // records lost to full rings or to too many threads
+    unsigned long long get_written(void) const { return m_written.load(std::memory_order_relaxed); };
+
+public: // constants
+    static const size_t MAX_THREADS = 16;       // threads logging at once, a ring is freed when its thread exits
+    static const size_t RING_LEN = 256;         // records per thread between writer passes
+    static const unsigned int POLL_MS = 10;     // writer sleep when the rings are empty
+
+private: // types
+    typedef IpcSpscQueue<LogRecord, RING_LEN> LogRing;
+
+private: // methods
+    LogRing* thread_ring(void);         // the ring of the calling thread, nullptr if there are no free rings
+    static void release_ring(uint64_t id, size_t slot);     // free a ring of the logger id, if it still exists
+    void writer_thread(void);
+    bool write_batch(std::vector<LogRecord>& batch);   // format and write, true if a fatal error was written
+    void format(const LogRecord& rec, std::string& out);
+    void rotate(void);
+
+private: // data
+    const InvErrorTable& m_table;
+    const uint64_t m_id;                // tells this logger's rings apart from those of an earlier logger at the same address
+    LogRing m_rings[MAX_THREADS];
+    std::atomic<bool> m_ring_owned[MAX_THREADS] = {};     // ring claimed by a thread
+    std::atomic<size_t> m_num_rings{ 0 };   // rings ever claimed, the writer drains [0, m_num_rings)
+    std::atomic<unsigned long long> m_no_ring{ 0 };
+    std::atomic<unsigned long long> m_written{ 0 };
+    std::atomic<bool> m_open{ false };
+    std::atomic<bool> m_run{ false };
+
+    // writer thread data
+    std::string m_file_name;
+    LogConfig m_cfg;
+    IpcFile m_file;
+    std::string m_text;
+    std::thread m_thread;
+};
+
+} // namespace inv_example
+
+#endif // __LOGGER_H__
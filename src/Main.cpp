@@ -2,11 +2,23 @@
 
 #include <iostream> // DEBUG
 #include <string> // DEBUG
+#include <thread>
+#include <chrono>
 
 #include "System.h"
 #include "Error.h"
 #include "Ipc.h"
 #include "Messages.h"
+#include "Controller.h"
+#include "Plant.h"
+#include "Recorder.h"
+#include "Capture.h"
+#include "Transmit.h"
+#include "Sim.h"
+#include "Fleet.h"
+#include "Logger.h"
+#include "ErrorLimit.h"
+#include "Latency.h"
 
 using namespace std;
 
@@ -20,9 +32,26 @@ initializer_list<const InvErrorTable::InvErrorInit> error_definitions = {
     { SYSERR_CART_DATA_MSG_PARSE,           InvErrorLevel::WARNING, "Unable to decode Cart Data msg" },
     { SYSERR_CART_POLL_MSG_PARSE,           InvErrorLevel::WARNING, "Unable to decode Cart Poll msg" },
     { SYSERR_CART_KEEPALIVE_MSG_PARSE,      InvErrorLevel::WARNING, "Unable to decode Cart Keepalive msg" },
+    { SYSERR_CART_LOCK_MSG_PARSE,           InvErrorLevel::WARNING, "Unable to decode Cart Lock msg" },
     { SYSERR_PEND_DATA_MSG_PARSE,           InvErrorLevel::WARNING, "Unable to decode Pend Data msg" },
+    { SYSERR_TX_OPEN_FAILED,                InvErrorLevel::WARNING, "Unable to open the cart interface, commands are not sent" },
+    { SYSERR_TX_DROPPED,                    InvErrorLevel::WARNING, "Cart command not sent, interface not open or transmit queue full" },
+    { SYSERR_TX_WRITE_FAILED,               InvErrorLevel::WARNING, "Unable to write cart commands to the interface" },
+    // model errors
+    { SYSERR_PLANT_DESIGN_FAILED,           InvErrorLevel::WARNING, "Unable to design a controller for the plant" },
+    // data recorder and capture errors
+    { SYSERR_RECORDER_OPEN_FAILED,          InvErrorLevel::WARNING, "Unable to create the data file, not recording" },
+    { SYSERR_RECORDER_WRITE_FAILED,         InvErrorLevel::WARNING, "Unable to write the data file" },
+    { SYSERR_RECORDER_BAD_FILE,             InvErrorLevel::WARNING, "Data file is damaged or not a data file" },
+    { SYSERR_CAPTURE_OPEN_FAILED,           InvErrorLevel::WARNING, "Unable to create the capture file, not capturing" },
+    { SYSERR_CAPTURE_WRITE_FAILED,          InvErrorLevel::WARNING, "Unable to write the capture file" },
+    { SYSERR_CAPTURE_BAD_FILE,              InvErrorLevel::WARNING, "Capture file is damaged or not a capture file" },
     // system resource allocation errors
     { SYSERR_RESOURCE_ALLOCATION_FAILED,    InvErrorLevel::FATAL,   "Unable to create or allocate a resource" },
+    { SYSERR_THREAD_CONFIG_FAILED,          InvErrorLevel::WARNING, "Unable to set thread priority or CPU affinity" },
+    { SYSERR_FILE_MAP_FAILED,               InvErrorLevel::WARNING, "Unable to map a file into memory" },
+    { SYSERR_MEMORY_LOCK_FAILED,            InvErrorLevel::WARNING, "Unable to lock memory, the control path may page fault" },
+    { SYSERR_RT_CHECK_FAILED,               InvErrorLevel::WARNING, "Control thread page faults, preemption or CPU migration in the real-time check" },
 };
 
 // global storage for the error table
@@ -30,93 +59,163 @@ InvErrorTable g_sys_err_table{ error_definitions };
 
 
 // ================================================================================
-// System error queue
+// System error queue and log file
 // ================================================================================
-IpcQueue<InvError> g_sys_err_queue;
+IpcMpscQueue<InvError, 1024> g_sys_err_queue;   // reported from any thread, errors beyond a full queue are only logged
+InvErrorLimiter g_sys_err_limit{ g_sys_err_table };     // per code, so a fault storm does not flood the queue and the log
+InvLogger g_sys_log{ g_sys_err_table };
+const char LOG_FILE_NAME[] = "InvExample.log";
+
+
+// ================================================================================
+// Sensor to actuator latency
+// ================================================================================
+InvLatencyStages g_sys_latency;         // recorded by the main loop, printed on exit
+
+
+// ================================================================================
+// Real-time options
+// ================================================================================
+SysRtConfig g_sys_rt_config;            // set by the command line, applied by system_init
 
 
 // ================================================================================
 // Report a system error
 // ================================================================================
-void enqueue_error(InvError& err)
+void enqueue_error(const InvError& err)
 {
+    if (!g_sys_err_limit.admit(err)) return;    // counted, and summarized in the log once per window
+    g_sys_log.log(err);                 // the log writer formats it, and shows it on the console
     g_sys_err_queue.Send(err);
 }
 
+// log a line for each code with errors held back by the rate limit,
+// once the window has passed or at once if final; called by the main loop only
+void log_error_summaries(bool final)
+{
+    g_sys_err_limit.flush(InvTimestamp().to_ns(), final, [](const InvErrorSummary& summary) {
+        g_sys_log.log(summary);
+    });
+}
+
 
 // ================================================================================
 // Main event loop
 // ================================================================================
-void main_loop(void)
+const size_t MSG_BATCH_LEN = 64;        // most messages handled per queue lock
+const size_t ERR_BATCH_LEN = 64;        // most errors taken from the queue in one pass
+const int TICK_MS = 10;                 // control tick of the Model.h plant
+const int KEEPALIVE_MS = 500;           // slow timeout timer
+const char DATA_FILE_NAME[] = "InvExample.rec";     // 100 Hz data file, see RecExport for CSV
+
+// main loop options
+struct SysLoopConfig {
+    const char* data_file;              // 100 Hz data file
+    CommTransmitter* cart;              // commands to the cart; nullptr in a replay, where they are only recorded
+    bool virtual_clock;                 // the sender of the messages also sends the ticks and keepalives, and sets the time
+                                        // of every message on its virtual clock; else they come from the timer service
+    const PlantDesign* design;          // controller gains and tick period, nullptr for the Model.h gains at TICK_MS
+    SysRtCheck* rt_check;               // real-time check of the first ticks, nullptr for none
+    bool debug_exit;                    // quit after a few keepalives in the locked state
+};
+
+// messages arrive on msgq from the timers and the receive path, or all from a replay
+void main_loop(IpcQueue<IpcMsg>& msgq, const SysLoopConfig& cfg)
 {
-    SysMode mode = SysMode::LOCKED;
-    IpcQueue<IpcMsg> msgq;
-    IpcMsg keepalive_msg(IpcMsgId::MSG_KEEPALIVE);
-    IpcTimer<IpcMsg> keepalive(500, keepalive_msg, msgq);       // slow timeout timer
+    int64_t force_ns = 0;               // time the last force packet was queued for the cart
+    CommTransmitter* cart = cfg.cart;
+    SysController controller([&force_ns, cart](const CommPacketBase& packet) {
+        if (cart) cart->send(packet);   // a packet that is not sent is reported
+        force_ns = InvTimestamp::fast().to_ns();
+    });
+    if (cfg.design) controller.set_gains(cfg.design->k, cfg.design->nbar);
+    std::unique_ptr<IpcTimer<IpcMsg>> keepalive, tick;
+    if (!cfg.virtual_clock) {
+        unsigned int tick_ms = cfg.design ? static_cast<unsigned int>(llround(cfg.design->ts * 1000.0)) : TICK_MS;
+        keepalive.reset(new IpcTimer<IpcMsg>(KEEPALIVE_MS, IpcMsg(IpcMsgId::MSG_KEEPALIVE), msgq));
+        tick.reset(new IpcTimer<IpcMsg>(tick_ms, IpcMsg(IpcMsgId::MSG_TICK), msgq));
+    }
+    DataRecorder recorder(cfg.data_file, g_sys_rt_config.get(SysThread::LOGGER));
 
     // DEBUG timer testing
     int dbg_count = 0;
-    IpcMsg debug_exit(IpcMsgId::MSG_EXIT);
+    IpcMsg debug_exit_msg(IpcMsgId::MSG_EXIT);
+
+    std::vector<IpcMsg> msgs;           // messages taken from the queue in one pass
+    msgs.reserve(MSG_BATCH_LEN);
+    std::vector<InvError> errs;         // errors taken from the error queue in one pass
+    errs.reserve(ERR_BATCH_LEN);
+    int64_t sensor_toa_ns = 0;          // oldest sensor sample not yet used by a tick, 0 if none
+    int64_t sensor_taken_ns = 0;        // when it was taken from the queue
+    bool run = true;
 
-    for (;;) {
-        auto msg = msgq.Wait();         // block waiting for a message
-        if (msg.GetId() == IpcMsgId::MSG_EXIT) break;   // quit the application
+    while (run) {
+        msgs.clear();
+        msgq.WaitBatch(msgs, MSG_BATCH_LEN);        // block waiting for messages
+        const int64_t taken_ns = InvTimestamp::fast().to_ns();
 
-        switch (mode) {
-        case SysMode::LOCKED:
-            if (msg.GetId() == IpcMsgId::MSG_MOVE_CMD) {
-                mode = SysMode::MOVING;
+        for (auto& msg : msgs) {
+            if (msg.GetId() == IpcMsgId::MSG_EXIT) {   // quit the application
+                run = false;
+                break;
             }
 
             // DEBUG timer testing
-            if (msg.GetId() == IpcMsgId::MSG_KEEPALIVE) {
+            if (cfg.debug_exit && msg.GetId() == IpcMsgId::MSG_KEEPALIVE && controller.get_mode() == SysMode::LOCKED) {
                 cout << "Tick " << dbg_count << endl;
                 if (++dbg_count > 5) {
-                    msgq.Send(debug_exit);
+                    msgq.Send(debug_exit_msg);
                 }
             }
-            break;
 
-        case SysMode::MOVING:
-            if (msg.GetId() == IpcMsgId::MSG_ARRIVED) {
-                mode = SysMode::HOLDING;
+            // sensor samples are timed up to the tick that uses them
+            if (msg.GetToaNs() != 0 && msg.GetSentNs() != 0) {
+                g_sys_latency.record(LatencyStage::FRAME, msg.GetReadyNs() - msg.GetToaNs());
+                g_sys_latency.record(LatencyStage::ENQUEUE, msg.GetSentNs() - msg.GetReadyNs());
+                g_sys_latency.record(LatencyStage::QUEUE, taken_ns - msg.GetSentNs());
+                if (sensor_toa_ns == 0) {
+                    sensor_toa_ns = msg.GetToaNs();
+                    sensor_taken_ns = taken_ns;
+                }
+            }
+            const int64_t tick_ns = msg.GetId() == IpcMsgId::MSG_TICK ? InvTimestamp::fast().to_ns() : 0;
+            force_ns = 0;
+            if (tick_ns != 0 && cfg.rt_check && cfg.rt_check->on_tick()) {     // printed after the loop
+                if (!cfg.rt_check->get_report().is_clean()) enqueue_error(NewInvError(SYSERR_RT_CHECK_FAILED));
             }
-            break;
 
-        case SysMode::HOLDING:
-            switch (msg.GetId()) {
-            case IpcMsgId::MSG_MOVE_CMD:
-                mode = SysMode::MOVING;
-                break;
-            case IpcMsgId::MSG_RESET_CMD:
-                mode = SysMode::LOCKED;
-                break;
+            const InvTimestamp now = cfg.virtual_clock ? InvTimestamp::from_ns(msg.GetClockNs()) : InvTimestamp();
+            controller.on_msg(msg, now);                // state machine and control
+            if (msg.GetId() == IpcMsgId::MSG_TICK) {
+                recorder.record(controller.get_status());
+            }
+            else if (msg.GetId() == IpcMsgId::MSG_KEEPALIVE) {
+                InvFastClock::resync();                 // follow drift of the steady clock
             }
-            break;
-
-        case SysMode::FAILED:
-            break;
-
-        default:
-            mode = SysMode::FAILED;
-            break;
-        } // message processing
-
-        // process errors in the queue
-        auto m = g_sys_err_queue.TryGet();
-        while (m.first) {
-            // TODO log errors to file
-            // TODO display errors on console
-            cout << g_sys_err_table.to_string(*m.second) << endl;       // DEBUG
-
-            // quit on a fatal error
-            if (g_sys_err_table.LookupErrorLevel(*m.second) == InvErrorLevel::FATAL) {
-                msgq.Send(IpcMsg(IpcMsgId::MSG_EXIT));          // send a message to terminate the system
+
+            if (force_ns != 0) {                        // the tick sent a force
+                g_sys_latency.record(LatencyStage::TICK, force_ns - tick_ns);
+                if (sensor_toa_ns != 0) {
+                    g_sys_latency.record(LatencyStage::WAIT, tick_ns - sensor_taken_ns);
+                    g_sys_latency.record(LatencyStage::SENSOR_TO_FORCE, force_ns - sensor_toa_ns);
+                }
             }
+            if (tick_ns != 0) sensor_toa_ns = 0;       // the tick used every sample so far
+        }
+        if (!run) break;
 
-            // try to get the next error
-            m = g_sys_err_queue.TryGet();
+        // process errors in the queue, a batch at a time until it is empty
+        for (;;) {
+            errs.clear();
+            if (g_sys_err_queue.Drain(errs, ERR_BATCH_LEN) == 0) break;
+            for (auto& err : errs) {
+                // quit on a fatal error
+                if (g_sys_err_table.LookupErrorLevel(err) == InvErrorLevel::FATAL) {
+                    msgq.Send(IpcMsg(IpcMsgId::MSG_EXIT));      // send a message to terminate the system
+                }
+            }
         } // error processing
+        log_error_summaries(false);
     }   // main loop
 }
 
@@ -124,20 +223,141 @@ void main_loop(void)
 // ================================================================================
 // System initialization
 // ================================================================================
-void system_init(void)
+// the calling thread becomes the control thread
+void system_init(const char* log_file = LOG_FILE_NAME)
 {
+    const SysRtConfig& rt = g_sys_rt_config;
+    bool locked = !rt.lock_memory || ipc_lock_memory();     // before the threads start, so their stacks are locked too
+    InvFastClock::calibrate();          // time of arrival stamps from the TSC, if it can be used
+    LogConfig log_cfg = LOG_CONFIG_DEFAULT;
+    log_cfg.thread = rt.get(SysThread::LOGGER);
+    if (!g_sys_log.open(log_file, log_cfg)) {
+        cout << "Unable to create the log file " << log_file << endl;
+    }
+    if (!locked) enqueue_error(NewInvError(SYSERR_MEMORY_LOCK_FAILED));
+
+    // running without real-time privileges is allowed, but reported
+    if (!IpcTimerService::instance().configure(rt.get(SysThread::TIMER))) {
+        enqueue_error(NewInvError(SYSERR_THREAD_CONFIG_FAILED));
+    }
+    if (!ipc_set_this_thread_config(rt.get(SysThread::CONTROL))) {
+        enqueue_error(NewInvError(SYSERR_THREAD_CONFIG_FAILED));
+    }
+}
 
+
+// ================================================================================
+// System shutdown
+// ================================================================================
+void system_exit(void)
+{
+    log_error_summaries(true);
+    g_sys_log.close();                  // write the errors still queued
+    if (g_sys_latency.get(LatencyStage::QUEUE).get_count() > 0) {
+        g_sys_latency.print(cout);      // where the time went from sensor to force
+    }
 }
 
 
 // ================================================================================
 // Program entry point
-// initialization and main loop
+// initialization and main loop; commands are written to cart_device, e.g. a serial port;
+// the controller runs at the sample period of design, or with the Model.h gains at 100 Hz if it is nullptr
 // ================================================================================
-void entry_point(void)
+void entry_point(const std::string& cart_device, const PlantDesign* design)
 {
     system_init();
-    main_loop();
+    IpcQueue<IpcMsg> msgq;
+    SysRtCheck rt_check;                // page faults and context switches of the first ticks
+    {
+        CommTransmitter cart(CommLink::CART, cart_device, g_sys_rt_config.get(SysThread::COMMS_TX));
+        main_loop(msgq, SysLoopConfig{ DATA_FILE_NAME, &cart, false, design, &rt_check, true });
+    }                                   // the commands still queued are sent before the log closes
+    if (rt_check.get_report().ticks > 0) rt_check.print(cout);
+    system_exit();
+}
+
+
+// ================================================================================
+// Capture replay
+// a replay thread feeds the capture through the receive path into the main loop, with the ticks and keepalives
+// of a virtual clock that runs on capture time, so every replay of a capture records the same data whatever the
+// scheduling or the speed; the rates cover the parser, the message queue and the main loop up to the last frame
+// ================================================================================
+const size_t REPLAY_MAX_QUEUED = 4096;  // messages ahead of the main loop before the replay waits
+const char REPLAY_LOG_FILE_NAME[] = "InvExample.replay.log";
+const char REPLAY_DATA_FILE_NAME[] = "InvExample.replay.rec";
+
+int replay_entry_point(const std::string& file_name, bool real_time)
+{
+    system_init(REPLAY_LOG_FILE_NAME);
+    IpcQueue<IpcMsg> msgq;
+    ReplayStats stats;
+    unsigned long long ticks = 0;
+    try {
+        CaptureReplay replay(file_name);
+        auto t0 = chrono::steady_clock::now();
+        bool rx_ok;
+        std::thread feeder = ipc_start_thread(g_sys_rt_config.get(SysThread::COMMS_RX), rx_ok, [&]() {
+            auto send = [&msgq](IpcMsg&& msg) {
+                while (msgq.Size() >= REPLAY_MAX_QUEUED) this_thread::yield();
+                msg.StampSent();
+                msgq.Send(std::move(msg));
+            };
+            SimScheduler clock;             // capture time, the first tick one period after the first chunk
+            bool started = false;
+            auto timers = [&](int64_t t_ns) {
+                if (!started) {
+                    clock.post(t_ns + TICK_MS * 1000000LL, IpcMsg(IpcMsgId::MSG_TICK), TICK_MS * 1000000LL);
+                    clock.post(t_ns + KEEPALIVE_MS * 1000000LL, IpcMsg(IpcMsgId::MSG_KEEPALIVE), KEEPALIVE_MS * 1000000LL);
+                    started = true;
+                }
+                clock.run_until(t_ns - 1, [&](const IpcMsg& timer_msg) {     // a tick at the time of a chunk follows its frames
+                    IpcMsg msg = timer_msg;
+                    msg.SetClockNs(clock.now_ns());
+                    if (msg.GetId() == IpcMsgId::MSG_TICK) ++ticks;
+                    send(std::move(msg));
+                    return true;
+                });
+            };
+            stats = replay.run(send, timers, real_time);
+            msgq.Send(IpcMsg(IpcMsgId::MSG_EXIT));
+        });
+        if (!rx_ok) enqueue_error(NewInvError(SYSERR_THREAD_CONFIG_FAILED));
+        main_loop(msgq, SysLoopConfig{ REPLAY_DATA_FILE_NAME, nullptr, true, nullptr, nullptr, false });
+        feeder.join();
+        stats.wall_s = chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+    }
+    catch (const InvError& e) {
+        enqueue_error(e);
+        system_exit();
+        return 1;
+    }
+    system_exit();
+
+    cout << "Replayed " << stats.chunks << " chunks, " << stats.bytes << " bytes, " << stats.frames << " frames, "
+        << stats.discarded_bytes << " bytes discarded, " << ticks << " ticks to " << REPLAY_DATA_FILE_NAME << endl;
+    cout << "Capture " << stats.capture_s << " s, replay " << stats.wall_s << " s, "
+        << (stats.wall_s > 0.0 ? stats.frames / stats.wall_s : 0.0) << " frames/s, "
+        << (stats.frames > 0 ? stats.wall_s * 1e9 / stats.frames : 0.0) << " ns/frame" << endl;
+    return 0;
+}
+
+
+// ================================================================================
+// Self-test
+// numerical checks of the control path, e.g. for a build with another compiler or on another platform
+// ================================================================================
+int selftest_entry_point(void)
+{
+    bool ok = comm_codec_check(cout);
+    ok = model_kernel_check(cout) && ok;
+    ok = model_step_check(cout) && ok;
+    ok = plant_check(cout) && ok;
+    ok = sim_settle_check(cout) && ok;
+    ok = fleet_check(cout) && ok;
+    cout << (ok ? "Self-test passed" : "Self-test FAILED") << endl;
+    return ok ? 0 : 1;
 }
 
 } // namespace inv_example
@@ -3,6 +3,8 @@
 #ifndef __MESSAGES_H__
 #define __MESSAGES_H__
 
+#include <cstring>
+#include <algorithm>
 #include "Comms.h"
 
 namespace inv_example {
@@ -14,6 +16,7 @@ enum IpcMsgId {
     MSG_RESET_CMD,
     MSG_ARRIVED,
     MSG_KEEPALIVE,
+    MSG_TICK,                           // 100 Hz control tick
 
     // communication messages
     MSG_CART_DATA = PacketId::CART_DATA,    // Cart interface messages
@@ -22,22 +25,81 @@ enum IpcMsgId {
 
 // ========================================
 // IPC messages
+// the data, e.g. a received frame, is held in the message, so making, queueing and copying one never allocates
 // ========================================
 class IpcMsg
 {
+public: // constants
+    static const size_t MAX_DATA_LEN = CommPacketBase::m_MAX_LEN;      // the largest packet in the schema
 public: // constructor
     IpcMsg(IpcMsgId id) : m_id{ id } {};
-    IpcMsg(IpcMsgId id, std::vector<uint8_t> raw_msg) : m_id{ id }, m_raw_msg(raw_msg) { };
+    IpcMsg(IpcMsgId id, const uint8_t* data, size_t len)               // data beyond MAX_DATA_LEN is not kept
+        : m_id{ id }, m_len{ static_cast<uint8_t>(std::min(len, MAX_DATA_LEN)) } { std::memcpy(m_data, data, m_len); };
     IpcMsg() = delete;                  // must provide id and data
 public: // methods
-    IpcMsgId GetId() { return m_id; };
-    std::vector<uint8_t> GetRawMsg() { return m_raw_msg; };
+    IpcMsgId GetId() const { return m_id; };
+    const uint8_t* GetData() const { return m_data; };
+    size_t GetLen() const { return m_len; };
+    // latency stamps of a received frame, ns of the steady clock, 0 if not stamped
+    void SetRxStamps(const InvTimestamp& toa, const InvTimestamp& ready) { m_toa_ns = toa.to_ns(); m_ready_ns = ready.to_ns(); };
+    void StampSent(void) { m_sent_ns = InvTimestamp::fast().to_ns(); };    // just before the message is queued
+    int64_t GetToaNs() const { return m_toa_ns; };          // first byte of the frame arrived
+    int64_t GetReadyNs() const { return m_ready_ns; };      // frame complete in the parser
+    int64_t GetSentNs() const { return m_sent_ns; };        // queued for the main loop
+    // time on a virtual clock, e.g. the capture time in a replay; 0 if the message is handled in real time
+    void SetClockNs(int64_t t_ns) { m_clock_ns = t_ns; };
+    int64_t GetClockNs() const { return m_clock_ns; };
 private: // data
     IpcMsgId m_id;                           // message id
-    std::vector<uint8_t> m_raw_msg;
+    uint8_t m_len = 0;
+    uint8_t m_data[MAX_DATA_LEN] = {};
+    int64_t m_toa_ns = 0;
+    int64_t m_ready_ns = 0;
+    int64_t m_sent_ns = 0;
+    int64_t m_clock_ns = 0;
 };
 
 
+// ========================================
+// Move command
+// the target cart position in m is carried in the message data
+// ========================================
+inline IpcMsg make_move_cmd(double pos)
+{
+    uint8_t data[sizeof(double)];
+    store_be(data, pos);
+    return IpcMsg(IpcMsgId::MSG_MOVE_CMD, data, sizeof(data));
+}
+
+inline double get_move_pos(const IpcMsg& msg)      // 0 if the command has no position
+{
+    return msg.GetLen() == sizeof(double) ? load_be<double>(msg.GetData()) : 0.0;
+}
+
+
+// ========================================
+// Received frame
+// the frame bytes are copied into the message, the packet classes decode them from it;
+// the message is stamped with the frame's time of arrival and the time it was taken from the parser
+// ========================================
+inline IpcMsg make_frame_msg(const CommFrame& frame)
+{
+    InvTimestamp ready = InvTimestamp::fast();
+    IpcMsg msg(static_cast<IpcMsgId>(frame.data[1]), frame.data, frame.len);
+    msg.SetRxStamps(frame.toa, ready);
+    return msg;
+}
+
+// a frame replayed from a capture: its time of arrival is from the capture, so the message is stamped
+// with the time its bytes were delivered to the parser instead, on the same clock as the other stamps
+inline IpcMsg make_frame_msg(const CommFrame& frame, const InvTimestamp& delivered)
+{
+    IpcMsg msg = make_frame_msg(frame);
+    msg.SetRxStamps(delivered, InvTimestamp::from_ns(msg.GetReadyNs()));
+    return msg;
+}
+
+
 }
 
 #endif // __MESSAGES_H__
@@ -0,0 +1,170 @@
+// Implementation of system model
+
+#include <iostream>
+#include <random>
+#include <cmath>
+#include "Model.h"
+
+namespace inv_example {
+// ================================================================================
+// Kernel self-check
+// ================================================================================
+const int KERNEL_CHECK_CASES = 100000;
+const double KERNEL_CHECK_TOL = 1e-14;      // relative to the sum of the magnitudes of the terms
+
+bool model_kernel_check(std::ostream& os)
+{
+    std::mt19937_64 rng(1);                 // the same cases on every run
+    std::uniform_real_distribution<double> dist(-10.0, 10.0);
+    double a[MODEL_NUM_STATES][MODEL_NUM_STATES], b[MODEL_NUM_STATES], x[MODEL_NUM_STATES];
+    double worst = 0.0;
+    for (int n = 0; n < KERNEL_CHECK_CASES; ++n) {
+        // the Model.h plant for the first half, random matrices for the rest
+        for (int i = 0; i < MODEL_NUM_STATES; ++i) {
+            for (int j = 0; j < MODEL_NUM_STATES; ++j) a[i][j] = n < KERNEL_CHECK_CASES / 2 ? MODEL_A[i][j] : dist(rng);
+            b[i] = n < KERNEL_CHECK_CASES / 2 ? MODEL_B[i] : dist(rng);
+            x[i] = dist(rng);
+        }
+        double u = 10.0 * dist(rng);
+
+        double fast[MODEL_NUM_STATES], ref[MODEL_NUM_STATES];
+        model_state_update(a, b, x, u, fast);
+        model_state_update_scalar(a, b, x, u, ref);
+        for (int i = 0; i < MODEL_NUM_STATES; ++i) {
+            double mag = std::fabs(b[i] * u);
+            for (int j = 0; j < MODEL_NUM_STATES; ++j) mag += std::fabs(a[i][j] * x[j]);
+            double err = mag > 0.0 ? std::fabs(fast[i] - ref[i]) / mag : std::fabs(fast[i] - ref[i]);
+            if (!(err <= worst)) worst = err;      // NaN is the worst
+        }
+    }
+
+#ifdef MODEL_KERNEL_SSE2
+    const char* kernel = "SSE2";
+#else
+    const char* kernel = "scalar";
+#endif
+    bool ok = worst <= KERNEL_CHECK_TOL;
+    os << "State update kernel (" << kernel << ") vs scalar reference, " << KERNEL_CHECK_CASES << " cases: "
+        << "largest relative difference " << worst << (ok ? ", ok" : ", FAILED") << std::endl;
+    return ok;
+}
+
+
+// ================================================================================
+// Step response self-check
+// ================================================================================
+// cart position of the doc/IpModel3.py step response at sample k, the state after k periods from rest;
+// the values printed by the loop of the script, run in double precision
+struct ModelStepRef {
+    int k;
+    double cart_pos;    // m
+};
+
+const ModelStepRef MODEL_STEP_REF[] = {
+    { 25,   -0.020653035473 },
+    { 50,    0.13162234428 },
+    { 100,   0.192839187311 },
+    { 150,   0.198122401603 },
+    { 200,   0.198540880365 },
+    { 300,   0.198569914121 },
+    { 400,   0.198569848908 },
+    { 499,   0.198569845497 },
+};
+const double MODEL_STEP_R = 0.2;            // m, r in the script
+const double MODEL_STEP_TOL = 1e-9;         // m, the sums are added in another order
+
+bool model_step_check(std::ostream& os)
+{
+    InvPendModel model;
+    double worst = 0.0;
+    int k = 0;
+    for (const ModelStepRef& ref : MODEL_STEP_REF) {
+        for (; k < ref.k; ++k) model.on_tick_100hz(model.feedback(MODEL_STEP_R));
+        double err = std::fabs(model.get_states().cart_pos - ref.cart_pos);
+        if (!(err <= worst)) worst = err;   // NaN is the worst
+    }
+
+    bool ok = worst <= MODEL_STEP_TOL;
+    os << "Closed-loop " << MODEL_STEP_R << " m step vs IpModel3.py, " << sizeof(MODEL_STEP_REF) / sizeof(MODEL_STEP_REF[0]) << " samples: "
+        << "largest difference " << worst << " m" << (ok ? ", ok" : ", FAILED") << std::endl;
+    return ok;
+}
+
+
+// ================================================================================
+// Pendulum model
+// ================================================================================
+// set new state
+void PendModel::set_pos_vel(double pos, double vel)
+{
+    m_pos = pos;
+    m_vel = vel;
+}
+
+
+// ================================================================================
+// System math model
+// ================================================================================
+// start at rest at the origin
+InvPendModel::InvPendModel()
+    : InvPendModel(States{ 0.0, 0.0, 0.0, 0.0 })
+{
+}
+
+// start from the given state
+InvPendModel::InvPendModel(const States& x0)
+    : InvPendModel(x0, MODEL_A, MODEL_B)
+{
+}
+
+// start from the given state with another discrete model, e.g. from the plant design cache
+InvPendModel::InvPendModel(const States& x0, const double (&a)[MODEL_NUM_STATES][MODEL_NUM_STATES], const double (&b)[MODEL_NUM_STATES])
+    : m_k{ CTL_K[0], CTL_K[1], CTL_K[2], CTL_K[3] },
+    m_nbar(CTL_NBAR),
+    m_x{ x0.cart_pos, x0.cart_vel, x0.pend_pos, x0.pend_vel },
+    m_cart(x0.cart_pos, x0.cart_vel),
+    m_pend(x0.pend_pos, x0.pend_vel)
+{
+    for (int i = 0; i < MODEL_NUM_STATES; ++i) {
+        for (int j = 0; j < MODEL_NUM_STATES; ++j) m_a[i][j] = a[i][j];
+        m_b[i] = b[i];
+    }
+}
+
+// return the outputs for the current state and advance the state by one period
+// the same sequence as y[k] = C·x[k], x[k+1] = A·x[k] + B·u[k] in IpModel3.py
+InvPendModel::Outputs InvPendModel::iterate_100hz(Inputs in)
+{
+    double y[MODEL_NUM_OUTPUTS];
+    model_outputs(MODEL_C, m_x, y);
+
+    double x_next[MODEL_NUM_STATES];
+    model_state_update(m_a, m_b, m_x, in.cart_force, x_next);
+    for (int i = 0; i < MODEL_NUM_STATES; ++i) m_x[i] = x_next[i];
+
+    return Outputs{ y[0], y[1] };
+}
+
+// calculate response, update the cart model, update the pend model
+void InvPendModel::on_tick_100hz(double cart_force_cmd)
+{
+    m_cart.set_force_cmd(cart_force_cmd);
+    iterate_100hz(Inputs{ cart_force_cmd });
+    m_cart.set_pos_vel(m_x[0], m_x[1]);
+    m_pend.set_pos_vel(m_x[2], m_x[3]);
+}
+
+// controller force for the current state and cart position command
+double InvPendModel::feedback(double pos_cmd) const
+{
+    return model_feedback(m_k, m_nbar, m_x, pos_cmd);
+}
+
+// replace the controller gains, e.g. with those of the plant design for another sample period
+void InvPendModel::set_gains(const double (&k)[MODEL_NUM_STATES], double nbar)
+{
+    for (int i = 0; i < MODEL_NUM_STATES; ++i) m_k[i] = k[i];
+    m_nbar = nbar;
+}
+
+} // namespace inv_example
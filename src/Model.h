@@ -3,6 +3,13 @@
 #ifndef __MODEL_H__
 #define __MODEL_H__
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define MODEL_KERNEL_SSE2
+#endif
+
+#include <iosfwd>
+
 namespace inv_example {
 // ================================================================================
 // Model coefficients
@@ -22,7 +29,7 @@ const double MODEL_B[] = {
 
 };
 
-const double MODEL_C[][] = {
+const double MODEL_C[][4] = {
     { 1, 0, 0, 0 },
     { 0, 0, 1, 0 }
 };
@@ -33,6 +40,107 @@ const double CTL_K[] = {
 
 const double CTL_NBAR = -61.5500;
 
+const int MODEL_NUM_STATES = 4;
+const int MODEL_NUM_OUTPUTS = 2;
+
+
+// ================================================================================
+// Fixed-size state-space kernel
+// 4 states, 1 input, 2 outputs; loops over the fixed sizes are unrolled at compile time
+// ================================================================================
+// ========================================
+// Compile-time loop unrolling
+// calls f(0) .. f(N-1)
+// ========================================
+template <int N>
+struct ModelUnroll {
+    template <typename F> static void run(F f) { ModelUnroll<N - 1>::run(f); f(N - 1); }
+};
+template <>
+struct ModelUnroll<0> {
+    template <typename F> static void run(F) {}
+};
+
+// ========================================
+// Dot product of a gain row and the state vector
+// ========================================
+inline double model_dot(const double (&k)[MODEL_NUM_STATES], const double (&x)[MODEL_NUM_STATES])
+{
+    return (k[0] * x[0] + k[1] * x[1]) + (k[2] * x[2] + k[3] * x[3]);
+}
+
+// ========================================
+// State update x' = A·x + B·u, plain C++
+// the reference for the SSE2 kernel, see model_kernel_check
+// ========================================
+inline void model_state_update_scalar(const double (&a)[MODEL_NUM_STATES][MODEL_NUM_STATES], const double (&b)[MODEL_NUM_STATES],
+    const double (&x)[MODEL_NUM_STATES], double u, double (&x_next)[MODEL_NUM_STATES])
+{
+    ModelUnroll<MODEL_NUM_STATES>::run([&](int i) {
+        x_next[i] = (a[i][0] * x[0] + a[i][1] * x[1]) + (a[i][2] * x[2] + a[i][3] * x[3]) + b[i] * u;
+    });
+}
+
+// ========================================
+// State update x' = A·x + B·u
+// x_next must not alias x
+// ========================================
+inline void model_state_update(const double (&a)[MODEL_NUM_STATES][MODEL_NUM_STATES], const double (&b)[MODEL_NUM_STATES],
+    const double (&x)[MODEL_NUM_STATES], double u, double (&x_next)[MODEL_NUM_STATES])
+{
+#ifdef MODEL_KERNEL_SSE2
+    // each row product is kept as a pair of partial sums, two rows are folded into one register at the end
+    const __m128d x01 = _mm_loadu_pd(&x[0]);
+    const __m128d x23 = _mm_loadu_pd(&x[2]);
+    const __m128d uu = _mm_set1_pd(u);
+    __m128d r[MODEL_NUM_STATES];
+    ModelUnroll<MODEL_NUM_STATES>::run([&](int i) {
+        r[i] = _mm_add_pd(_mm_mul_pd(_mm_loadu_pd(&a[i][0]), x01), _mm_mul_pd(_mm_loadu_pd(&a[i][2]), x23));
+    });
+    __m128d y01 = _mm_add_pd(_mm_unpacklo_pd(r[0], r[1]), _mm_unpackhi_pd(r[0], r[1]));
+    __m128d y23 = _mm_add_pd(_mm_unpacklo_pd(r[2], r[3]), _mm_unpackhi_pd(r[2], r[3]));
+    _mm_storeu_pd(&x_next[0], _mm_add_pd(y01, _mm_mul_pd(_mm_loadu_pd(&b[0]), uu)));
+    _mm_storeu_pd(&x_next[2], _mm_add_pd(y23, _mm_mul_pd(_mm_loadu_pd(&b[2]), uu)));
+#else
+    model_state_update_scalar(a, b, x, u, x_next);
+#endif
+}
+
+// ========================================
+// Outputs y = C·x
+// ========================================
+inline void model_outputs(const double (&c)[MODEL_NUM_OUTPUTS][MODEL_NUM_STATES], const double (&x)[MODEL_NUM_STATES], double (&y)[MODEL_NUM_OUTPUTS])
+{
+    ModelUnroll<MODEL_NUM_OUTPUTS>::run([&](int i) {
+        y[i] = model_dot(c[i], x);
+    });
+}
+
+// ========================================
+// State feedback u = Nbar·r - K·x
+// ========================================
+inline double model_feedback(const double (&k)[MODEL_NUM_STATES], double nbar, const double (&x)[MODEL_NUM_STATES], double r)
+{
+    return nbar * r - model_dot(k, x);
+}
+
+
+// ========================================
+// Kernel self-check
+// model_state_update against model_state_update_scalar for random states, inputs and matrices;
+// the kernels add the row products in a different order, so they must agree to a few ulp
+// prints the largest difference, false if it is beyond the tolerance
+// ========================================
+bool model_kernel_check(std::ostream& os);
+
+// ========================================
+// Step response self-check
+// the Model.h plant and gains from rest with a 0.2 m position command, the cart position at fixed samples
+// against the step response of doc/IpModel3.py
+// prints the largest difference, false if it is beyond the tolerance
+// ========================================
+bool model_step_check(std::ostream& os);
+
 
 // ================================================================================
 // Cart model
@@ -101,14 +209,25 @@ public: // types
     };
 
 public: // constructors
-    InvPendModel();
+    InvPendModel();                             // start at rest at the origin
+    InvPendModel(const States& x0);             // start from the given state
+    InvPendModel(const States& x0, const double (&a)[MODEL_NUM_STATES][MODEL_NUM_STATES], const double (&b)[MODEL_NUM_STATES]);    // another plant or sample period
 
 public: // methods
-    Outputs iterate_100hz(Inputs in);           // TODO calculate system response
-    void on_tick_100hz(double cart_force_cmd);  // TODO calculate response, update the cart model, update the pend model
+    Outputs iterate_100hz(Inputs in);           // return the outputs for the current state and advance the state by one period
+    void on_tick_100hz(double cart_force_cmd);  // calculate response, update the cart model, update the pend model
+    double feedback(double pos_cmd) const;      // controller force for the current state and cart position command
+    void set_gains(const double (&k)[MODEL_NUM_STATES], double nbar);  // replace the Model.h gains used by feedback
+    States get_states(void) const { return States{ m_x[0], m_x[1], m_x[2], m_x[3] }; };
+    CartModel& get_cart(void) { return m_cart; };
+    PendModel& get_pend(void) { return m_pend; };
 
 private: // data
-    States m_x;
+    double m_a[MODEL_NUM_STATES][MODEL_NUM_STATES];     // discrete model, MODEL_A and MODEL_B by default
+    double m_b[MODEL_NUM_STATES];
+    double m_k[MODEL_NUM_STATES];               // feedback gain, CTL_K by default
+    double m_nbar;                              // reference gain, CTL_NBAR by default
+    double m_x[MODEL_NUM_STATES];               // cart pos, cart vel, pend pos, pend vel
     CartModel m_cart;
     PendModel m_pend;
 };
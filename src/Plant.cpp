@@ -0,0 +1,489 @@
+// Plant model implementation
+
+#include <cmath>
+#include <algorithm>
+#include <iterator>
+#include <limits>
+#include <vector>
+#include <iostream>
+#include "Plant.h"
+#include "System.h"
+#include "Error.h"
+
+namespace inv_example {
+const int N = MODEL_NUM_STATES;         // states
+const double PLANT_PI = 3.14159265358979323846;
+
+// ================================================================================
+// Small fixed-size matrix helpers
+// ================================================================================
+template <int R, int K, int C>
+static void mat_mul(const double (&a)[R][K], const double (&b)[K][C], double (&out)[R][C])
+{
+    for (int i = 0; i < R; ++i) {
+        for (int j = 0; j < C; ++j) {
+            double s = 0.0;
+            for (int p = 0; p < K; ++p) s += a[i][p] * b[p][j];
+            out[i][j] = s;
+        }
+    }
+}
+
+template <int R, int C>
+static void mat_copy(const double (&a)[R][C], double (&out)[R][C])
+{
+    for (int i = 0; i < R; ++i) {
+        for (int j = 0; j < C; ++j) out[i][j] = a[i][j];
+    }
+}
+
+template <int M>
+static void mat_identity(double (&out)[M][M])
+{
+    for (int i = 0; i < M; ++i) {
+        for (int j = 0; j < M; ++j) out[i][j] = (i == j) ? 1.0 : 0.0;
+    }
+}
+
+// Solve A·X = B in place by Gaussian elimination with partial pivoting, X is left in b
+// false if A is singular
+template <int M, int C>
+static bool mat_solve(double (&a)[M][M], double (&b)[M][C])
+{
+    for (int col = 0; col < M; ++col) {
+        int piv = col;
+        for (int i = col + 1; i < M; ++i) {
+            if (std::fabs(a[i][col]) > std::fabs(a[piv][col])) piv = i;
+        }
+        if (a[piv][col] == 0.0) return false;
+        if (piv != col) {
+            std::swap(a[piv], a[col]);
+            std::swap(b[piv], b[col]);
+        }
+        for (int i = col + 1; i < M; ++i) {
+            double f = a[i][col] / a[col][col];
+            for (int j = col; j < M; ++j) a[i][j] -= f * a[col][j];
+            for (int j = 0; j < C; ++j) b[i][j] -= f * b[col][j];
+        }
+    }
+    for (int i = M - 1; i >= 0; --i) {
+        for (int j = 0; j < C; ++j) {
+            double s = b[i][j];
+            for (int p = i + 1; p < M; ++p) s -= a[i][p] * b[p][j];
+            b[i][j] = s / a[i][i];
+        }
+    }
+    return true;
+}
+
+// Matrix exponential by scaling and squaring with a [6/6] Pade approximant
+// the scaled matrix has 1-norm at most 0.5, where the approximant is accurate to double precision
+template <int M>
+static void mat_expm(const double (&a)[M][M], double (&e)[M][M])
+{
+    double norm = 0.0;
+    for (int j = 0; j < M; ++j) {
+        double col = 0.0;
+        for (int i = 0; i < M; ++i) col += std::fabs(a[i][j]);
+        norm = std::max(norm, col);
+    }
+    int squarings = 0;
+    if (norm > 0.5) squarings = std::max(0, static_cast<int>(std::ceil(std::log2(norm / 0.5))));
+    const double scale = std::ldexp(1.0, -squarings);
+
+    double x[M][M];
+    for (int i = 0; i < M; ++i) {
+        for (int j = 0; j < M; ++j) x[i][j] = a[i][j] * scale;
+    }
+
+    // N = sum c_k·X^k, D = sum (-1)^k·c_k·X^k
+    const int Q = 6;
+    double num[M][M], den[M][M], xk[M][M], tmp[M][M];
+    mat_identity(num);
+    mat_identity(den);
+    mat_identity(xk);
+    double c = 1.0;
+    for (int k = 1; k <= Q; ++k) {
+        c *= static_cast<double>(Q - k + 1) / (k * (2 * Q - k + 1));
+        mat_mul(xk, x, tmp);
+        mat_copy(tmp, xk);
+        const double sign = (k % 2) ? -1.0 : 1.0;
+        for (int i = 0; i < M; ++i) {
+            for (int j = 0; j < M; ++j) {
+                num[i][j] += c * xk[i][j];
+                den[i][j] += sign * c * xk[i][j];
+            }
+        }
+    }
+    mat_solve(den, num);                // D is well conditioned for the scaled matrix
+
+    for (int s = 0; s < squarings; ++s) {
+        mat_mul(num, num, tmp);
+        mat_copy(tmp, num);
+    }
+    mat_copy(num, e);
+}
+
+
+// ================================================================================
+// Plant analysis and controller design
+// ================================================================================
+// Continuous model, the A and B matrices of doc/IpModel.m
+void plant_continuous(const PendPhysParams& phys, double (&a)[MODEL_NUM_STATES][MODEL_NUM_STATES], double (&b)[MODEL_NUM_STATES])
+{
+    const double M = phys.M, m = phys.m, fb = phys.b, I = phys.I, l = phys.l, g = PEND_GRAVITY;
+    const double p = I * (M + m) + M * m * l * l;      // denominator for the A and B matrices
+
+    const double ac[N][N] = {
+        { 0.0, 1.0,                         0.0,                        0.0 },
+        { 0.0, -(I + m * l * l) * fb / p,   (m * m * g * l * l) / p,    0.0 },
+        { 0.0, 0.0,                         0.0,                        1.0 },
+        { 0.0, -(m * l * fb) / p,           m * g * l * (M + m) / p,    0.0 }
+    };
+    const double bc[N] = { 0.0, (I + m * l * l) / p, 0.0, m * l / p };
+
+    mat_copy(ac, a);
+    std::copy(std::begin(bc), std::end(bc), b);
+}
+
+// Zero-order-hold discretisation
+// exp([A B; 0 0]·ts) = [Ad Bd; 0 1]
+void plant_discretise(const double (&ac)[MODEL_NUM_STATES][MODEL_NUM_STATES], const double (&bc)[MODEL_NUM_STATES], double ts,
+    double (&ad)[MODEL_NUM_STATES][MODEL_NUM_STATES], double (&bd)[MODEL_NUM_STATES])
+{
+    const int NA = N + 1;               // augmented size
+    double x[NA][NA] = {};
+    for (int i = 0; i < N; ++i) {
+        for (int j = 0; j < N; ++j) x[i][j] = ac[i][j] * ts;
+        x[i][N] = bc[i] * ts;
+    }
+    double e[NA][NA];
+    mat_expm(x, e);
+
+    for (int i = 0; i < N; ++i) {
+        for (int j = 0; j < N; ++j) ad[i][j] = e[i][j];
+        bd[i] = e[i][N];
+    }
+}
+
+// Characteristic polynomial by Faddeev-LeVerrier
+void plant_char_poly(const double (&a)[MODEL_NUM_STATES][MODEL_NUM_STATES], double (&c)[MODEL_NUM_STATES + 1])
+{
+    c[N] = 1.0;
+    double mk[N][N] = {};               // M_0 = 0
+    for (int k = 1; k <= N; ++k) {
+        // M_k = A·M_(k-1) + c[N-k+1]·I, c[N-k] = -trace(A·M_k) / k
+        double next[N][N];
+        mat_mul(a, mk, next);
+        for (int i = 0; i < N; ++i) next[i][i] += c[N - k + 1];
+        double trace = 0.0;
+        for (int i = 0; i < N; ++i) {
+            for (int p = 0; p < N; ++p) trace += a[i][p] * next[p][i];
+        }
+        c[N - k] = -trace / k;
+        mat_copy(next, mk);
+    }
+}
+
+// Largest eigenvalue magnitude
+// the roots of the characteristic polynomial by Durand-Kerner iteration
+double plant_spectral_radius(const double (&a)[MODEL_NUM_STATES][MODEL_NUM_STATES])
+{
+    double c[N + 1];                    // z^N + c[N-1]·z^(N-1) + ... + c[0]
+    plant_char_poly(a, c);
+
+    // start on a circle that contains all the roots
+    double bound = 0.0;
+    for (int i = 0; i < N; ++i) bound = std::max(bound, std::fabs(c[i]));
+    bound += 1.0;
+    std::complex<double> z[N];
+    const std::complex<double> seed(0.4, 0.9);
+    z[0] = seed * bound;
+    for (int i = 1; i < N; ++i) z[i] = z[i - 1] * seed;
+
+    for (int iter = 0; iter < 100; ++iter) {
+        double change = 0.0;
+        for (int i = 0; i < N; ++i) {
+            std::complex<double> num = c[N];
+            for (int p = N - 1; p >= 0; --p) num = num * z[i] + c[p];
+            std::complex<double> den = 1.0;
+            for (int j = 0; j < N; ++j) {
+                if (j != i) den *= z[i] - z[j];
+            }
+            if (std::abs(den) == 0.0) den = 1e-300;
+            std::complex<double> dz = num / den;
+            z[i] -= dz;
+            change = std::max(change, std::abs(dz) / std::max(std::abs(z[i]), 1.0));
+        }
+        if (change < 1e-10) break;      // clustered roots do not settle much below this
+    }
+
+    double radius = 0.0;
+    for (int i = 0; i < N; ++i) radius = std::max(radius, std::abs(z[i]));
+    return radius;
+}
+
+// Loop gain and phase margins
+// L(z) = K·(zI - A)^-1·B = (det(zI - A + B·K) - det(zI - A)) / det(zI - A), so L = n/d with both from
+// characteristic polynomials; a grid of frequencies up to Nyquist brackets the crossings of the negative real
+// axis, Im(n·conj(d)) = 0, and of the unit circle, |n| = |d|, and bisection finds each one
+const int MARGIN_GRID = 512;            // log-spaced frequencies, rad/sample
+const double MARGIN_W_MIN = 1e-5;
+const int MARGIN_BISECT = 40;
+
+static std::complex<double> poly_at(const double (&c)[N + 1], std::complex<double> z)
+{
+    std::complex<double> v = c[N];
+    for (int p = N - 1; p >= 0; --p) v = v * z + c[p];
+    return v;
+}
+
+void plant_loop_margins(const double (&ad)[MODEL_NUM_STATES][MODEL_NUM_STATES], const double (&bd)[MODEL_NUM_STATES],
+    const double (&k)[MODEL_NUM_STATES], LoopMargins& margins)
+{
+    double d[N + 1], n[N + 1], acl[N][N];
+    for (int i = 0; i < N; ++i) {
+        for (int j = 0; j < N; ++j) acl[i][j] = ad[i][j] - bd[i] * k[j];
+    }
+    plant_char_poly(ad, d);
+    plant_char_poly(acl, n);
+    for (int p = 0; p <= N; ++p) n[p] -= d[p];
+
+    // n·conj(d) at z: its angle is the phase of L, and |n|^2 - |d|^2 is zero at a gain crossover
+    auto loop_at = [&n, &d](std::complex<double> z) {
+        std::complex<double> nz = poly_at(n, z), dz = poly_at(d, z);
+        return std::make_pair(nz * std::conj(dz), std::norm(nz) - std::norm(dz));
+    };
+    auto loop = [&loop_at](double w) { return loop_at(std::polar(1.0, w)); };
+    auto bisect = [&loop](double lo, double hi, bool phase) {
+        auto f = [&loop, phase](double w) { auto v = loop(w); return phase ? v.first.imag() : v.second; };
+        double f_lo = f(lo);
+        for (int i = 0; i < MARGIN_BISECT; ++i) {
+            double mid = 0.5 * (lo + hi);
+            double f_mid = f(mid);
+            if ((f_mid < 0.0) == (f_lo < 0.0)) { lo = mid; f_lo = f_mid; }
+            else hi = mid;
+        }
+        return 0.5 * (lo + hi);
+    };
+
+    const double inf = std::numeric_limits<double>::infinity();
+    double up = inf, down = 0.0;        // loop gain factors that reach -1
+    margins.phase_deg = inf;
+    auto phase_crossing = [&up, &down](std::complex<double> l) {     // L where it is real
+        if (l.real() >= 0.0) return;
+        double g = -1.0 / l.real();
+        if (g > 1.0) up = std::min(up, g);
+        else down = std::max(down, g);
+    };
+
+    // the grid is the same for every loop
+    static const std::vector<std::pair<double, std::complex<double>>> grid = [] {
+        std::vector<std::pair<double, std::complex<double>>> g(MARGIN_GRID + 1);
+        for (int i = 0; i <= MARGIN_GRID; ++i) {
+            double w = MARGIN_W_MIN * std::pow(PLANT_PI / MARGIN_W_MIN, static_cast<double>(i) / MARGIN_GRID);
+            g[i] = std::make_pair(w, std::polar(1.0, w));
+        }
+        return g;
+    }();
+
+    double w_prev = grid[0].first;
+    auto v_prev = loop_at(grid[0].second);
+    for (int i = 1; i <= MARGIN_GRID; ++i) {
+        double w = grid[i].first;
+        auto v = loop_at(grid[i].second);
+        if (i < MARGIN_GRID && (v.first.imag() < 0.0) != (v_prev.first.imag() < 0.0)) {
+            double wc = bisect(w_prev, w, true);
+            std::complex<double> dz = poly_at(d, std::polar(1.0, wc));
+            phase_crossing(loop(wc).first / std::norm(dz));
+        }
+        if ((v.second < 0.0) != (v_prev.second < 0.0)) {
+            double wc = bisect(w_prev, w, false);
+            double phase = std::abs(std::arg(loop(wc).first)) * 180.0 / PLANT_PI;
+            margins.phase_deg = std::min(margins.phase_deg, 180.0 - phase);
+        }
+        w_prev = w;
+        v_prev = v;
+    }
+    // L is real at the ends of the range, z = 1 and z = -1
+    for (double z : { 1.0, -1.0 }) {
+        double dz = poly_at(d, z).real();
+        if (dz != 0.0) phase_crossing(poly_at(n, z) / dz);
+    }
+    margins.gain_up_db = up == inf ? inf : 20.0 * std::log10(up);
+    margins.gain_down_db = down == 0.0 ? inf : -20.0 * std::log10(down);
+}
+
+// Discrete LQR gain
+// iterates P = Q + A'·P·A - A'·P·B·(R + B'·P·B)^-1·B'·P·A from P = Q until it stops changing
+bool plant_dlqr(const double (&ad)[MODEL_NUM_STATES][MODEL_NUM_STATES], const double (&bd)[MODEL_NUM_STATES], const LqrWeights& w,
+    double (&k)[MODEL_NUM_STATES])
+{
+    double p[N][N] = {};
+    for (int i = 0; i < N; ++i) p[i][i] = w.q[i];
+
+    for (int iter = 0; iter < 100000; ++iter) {
+        double pa[N][N];                // P·A
+        mat_mul(p, ad, pa);
+        double pb[N];                   // P·B
+        for (int i = 0; i < N; ++i) {
+            pb[i] = 0.0;
+            for (int j = 0; j < N; ++j) pb[i] += p[i][j] * bd[j];
+        }
+        double s = w.r;                 // R + B'·P·B
+        for (int i = 0; i < N; ++i) s += bd[i] * pb[i];
+        for (int j = 0; j < N; ++j) {   // K = (R + B'·P·B)^-1·B'·P·A
+            double bpa = 0.0;
+            for (int i = 0; i < N; ++i) bpa += bd[i] * pa[i][j];
+            k[j] = bpa / s;
+        }
+
+        // P' = Q + A'·P·A - A'·P·B·K
+        double next[N][N];
+        double change = 0.0, size = 0.0;
+        for (int i = 0; i < N; ++i) {
+            double apb = 0.0;           // (A'·P·B)_i
+            for (int r = 0; r < N; ++r) apb += ad[r][i] * pb[r];
+            for (int j = 0; j < N; ++j) {
+                double apa = 0.0;
+                for (int r = 0; r < N; ++r) apa += ad[r][i] * pa[r][j];
+                next[i][j] = (i == j ? w.q[i] : 0.0) + apa - apb * k[j];
+                change = std::max(change, std::fabs(next[i][j] - p[i][j]));
+                size = std::max(size, std::fabs(next[i][j]));
+            }
+        }
+        if (!std::isfinite(size)) return false;
+        mat_copy(next, p);
+        if (change <= 1e-13 * size) return true;
+    }
+    return false;
+}
+
+// Ackermann's formula K = [0 .. 0 1]·W^-1·phi(A), W = [B A·B .. A^(N-1)·B]
+bool plant_place(const double (&ad)[MODEL_NUM_STATES][MODEL_NUM_STATES], const double (&bd)[MODEL_NUM_STATES],
+    const std::complex<double> (&poles)[MODEL_NUM_STATES], double (&k)[MODEL_NUM_STATES])
+{
+    // desired characteristic polynomial (z - p0)·(z - p1)..., alpha[i] is the coefficient of z^i
+    std::complex<double> alpha[N + 1] = { 1.0 };
+    for (int p = 0; p < N; ++p) {
+        for (int i = p + 1; i > 0; --i) alpha[i] = alpha[i - 1] - poles[p] * alpha[i];
+        alpha[0] = -poles[p] * alpha[0];
+    }
+
+    // phi(A) = A^N + alpha[N-1]·A^(N-1) + ... + alpha[0]·I by Horner's rule
+    double phi[N][N], tmp[N][N];
+    mat_identity(phi);
+    for (int p = N - 1; p >= 0; --p) {
+        mat_mul(phi, ad, tmp);
+        mat_copy(tmp, phi);
+        for (int i = 0; i < N; ++i) phi[i][i] += alpha[p].real();
+    }
+
+    // y' = [0 .. 0 1]·W^-1, i.e. W'·y = e_N
+    double wt[N][N];                    // W transposed, row i = A^i·B
+    double col[N];
+    std::copy(std::begin(bd), std::end(bd), col);
+    for (int i = 0; i < N; ++i) {
+        for (int j = 0; j < N; ++j) wt[i][j] = col[j];
+        double next[N];
+        for (int r = 0; r < N; ++r) {
+            next[r] = 0.0;
+            for (int j = 0; j < N; ++j) next[r] += ad[r][j] * col[j];
+        }
+        std::copy(std::begin(next), std::end(next), col);
+    }
+    double y[N][1] = {};
+    y[N - 1][0] = 1.0;
+    if (!mat_solve(wt, y)) return false;
+
+    for (int j = 0; j < N; ++j) {
+        k[j] = 0.0;
+        for (int i = 0; i < N; ++i) k[j] += y[i][0] * phi[i][j];
+    }
+    return true;
+}
+
+// Reference gain
+// steady state x = (I - A + B·K)^-1·B·Nbar·r with cart position x[0] = r
+double plant_nbar(const double (&ad)[MODEL_NUM_STATES][MODEL_NUM_STATES], const double (&bd)[MODEL_NUM_STATES], const double (&k)[MODEL_NUM_STATES])
+{
+    double m[N][N];
+    double x[N][1];
+    for (int i = 0; i < N; ++i) {
+        for (int j = 0; j < N; ++j) m[i][j] = (i == j ? 1.0 : 0.0) - ad[i][j] + bd[i] * k[j];
+        x[i][0] = bd[i];
+    }
+    if (!mat_solve(m, x) || x[0][0] == 0.0) return 0.0;
+    return 1.0 / x[0][0];
+}
+
+// Discretise and design an LQR controller
+bool plant_design(const PendPhysParams& phys, double ts, const LqrWeights& w, PlantDesign& design)
+{
+    double ac[N][N], bc[N];
+    design.phys = phys;
+    design.ts = ts;
+    plant_continuous(phys, ac, bc);
+    plant_discretise(ac, bc, ts, design.a, design.b);
+    if (!plant_dlqr(design.a, design.b, w, design.k)) return false;
+    design.nbar = plant_nbar(design.a, design.b, design.k);
+    return design.nbar != 0.0;
+}
+
+// Self-check against the Model.h tables
+const double PLANT_CHECK_TS = 0.01;
+const double PLANT_CHECK_TOL = 0.5e-4 + 1e-9;      // rounding to 4 decimals
+
+bool plant_check(std::ostream& os)
+{
+    PlantDesign d;
+    if (!plant_design(PEND_PHYS_DEFAULT, PLANT_CHECK_TS, LQR_WEIGHTS_DEFAULT, d)) {
+        os << "Plant design at " << PLANT_CHECK_TS << " s: FAILED, the design did not converge" << std::endl;
+        return false;
+    }
+    double a_err = 0.0, b_err = 0.0, k_err = 0.0;
+    auto worst = [](double& err, double x, double ref) {
+        double e = std::fabs(x - ref);
+        if (!(e <= err)) err = e;       // NaN is the worst
+    };
+    for (int i = 0; i < N; ++i) {
+        for (int j = 0; j < N; ++j) worst(a_err, d.a[i][j], MODEL_A[i][j]);
+        worst(b_err, d.b[i], MODEL_B[i]);
+        worst(k_err, d.k[i], CTL_K[i]);
+    }
+    bool ok = a_err <= PLANT_CHECK_TOL && b_err <= PLANT_CHECK_TOL && k_err <= PLANT_CHECK_TOL;
+    os << "Plant design at " << PLANT_CHECK_TS << " s vs Model.h, largest difference: A " << a_err << ", B " << b_err
+        << ", K " << k_err << (ok ? ", ok" : ", FAILED") << std::endl;
+    return ok;
+}
+
+
+// ================================================================================
+// Plant design cache
+// ================================================================================
+PlantCache& PlantCache::instance(void)
+{
+    static PlantCache cache;
+    return cache;
+}
+
+bool PlantCache::Key::operator<(const Key& o) const
+{
+    return std::lexicographical_compare(std::begin(v), std::end(v), std::begin(o.v), std::end(o.v));
+}
+
+// design on first use
+// the design runs under the lock, it is done once per key and takes well under a millisecond
+const PlantDesign& PlantCache::get(const PendPhysParams& phys, double ts)
+{
+    Key key{ { phys.M, phys.m, phys.b, phys.I, phys.l, ts } };
+    std::unique_lock<std::mutex> lock{ m_mtx };
+    auto p = m_designs.find(key);
+    if (p != m_designs.end()) return p->second;
+
+    PlantDesign design;
+    if (!plant_design(phys, ts, LQR_WEIGHTS_DEFAULT, design)) throw NewInvError(SYSERR_PLANT_DESIGN_FAILED);
+    return m_designs.emplace(key, design).first->second;
+}
+
+} // namespace inv_example
@@ -0,0 +1,129 @@
+// Plant model definitions
+// continuous model of the cart and pendulum, its discretisation and the controller design
+
+#ifndef __PLANT_H__
+#define __PLANT_H__
+
+#include <complex>
+#include <map>
+#include <mutex>
+#include <iosfwd>
+#include "Model.h"
+
+namespace inv_example {
+// ================================================================================
+// Physical parameters of the cart and pendulum
+// names and values from doc/IpModel.m
+// ================================================================================
+struct PendPhysParams {
+    double M;                           // mass of the cart, kg
+    double m;                           // mass of the pendulum, kg
+    double b;                           // coefficient of friction for cart, N/m/sec
+    double I;                           // mass moment of inertia of the pendulum, kg.m^2
+    double l;                           // length to pendulum center of mass, m
+};
+
+const PendPhysParams PEND_PHYS_DEFAULT = { 0.5, 0.2, 0.1, 0.006, 0.3 };
+const double PEND_GRAVITY = 9.8;        // m/s^2
+
+
+// ================================================================================
+// Plant analysis and controller design
+// ================================================================================
+// Continuous model x_dot = A·x + B·u, the A and B matrices of doc/IpModel.m
+void plant_continuous(const PendPhysParams& phys, double (&a)[MODEL_NUM_STATES][MODEL_NUM_STATES], double (&b)[MODEL_NUM_STATES]);
+
+// Zero-order-hold discretisation for sample period ts, c2d(sys, ts, 'zoh')
+void plant_discretise(const double (&ac)[MODEL_NUM_STATES][MODEL_NUM_STATES], const double (&bc)[MODEL_NUM_STATES], double ts,
+    double (&ad)[MODEL_NUM_STATES][MODEL_NUM_STATES], double (&bd)[MODEL_NUM_STATES]);
+
+// Characteristic polynomial det(zI - A) = z^N + c[N-1]·z^(N-1) + ... + c[0], c[N] = 1
+void plant_char_poly(const double (&a)[MODEL_NUM_STATES][MODEL_NUM_STATES], double (&c)[MODEL_NUM_STATES + 1]);
+
+// Largest eigenvalue magnitude of a state matrix
+double plant_spectral_radius(const double (&a)[MODEL_NUM_STATES][MODEL_NUM_STATES]);
+
+// Stability margins of the discrete loop K·(zI - A)^-1·B broken at the actuator, for u = -K·x;
+// how far the loop gain can rise or fall, and the phase lag that can be added, before the closed loop is
+// unstable; infinite where there is no limit; only meaningful for a stable closed loop
+struct LoopMargins {
+    double gain_up_db;                  // gain increase margin, dB
+    double gain_down_db;                // gain reduction margin, dB, finite for a plant that is unstable open loop
+    double phase_deg;                   // phase margin, degrees
+};
+
+void plant_loop_margins(const double (&ad)[MODEL_NUM_STATES][MODEL_NUM_STATES], const double (&bd)[MODEL_NUM_STATES],
+    const double (&k)[MODEL_NUM_STATES], LoopMargins& margins);
+
+// Diagonal LQR weights
+struct LqrWeights {
+    double q[MODEL_NUM_STATES];         // state weights
+    double r;                           // input weight
+};
+
+const LqrWeights LQR_WEIGHTS_DEFAULT = { { 5000.0, 0.0, 100.0, 0.0 }, 1.0 };    // Q and R of doc/IpModel.m
+
+// Discrete LQR gain for u = -K·x, dlqr(A, B, Q, R); false if the Riccati iteration does not converge
+bool plant_dlqr(const double (&ad)[MODEL_NUM_STATES][MODEL_NUM_STATES], const double (&bd)[MODEL_NUM_STATES], const LqrWeights& w,
+    double (&k)[MODEL_NUM_STATES]);
+
+// Gain that places the poles of A - B·K by Ackermann's formula; false if the plant is not controllable
+// complex poles must come in conjugate pairs
+bool plant_place(const double (&ad)[MODEL_NUM_STATES][MODEL_NUM_STATES], const double (&bd)[MODEL_NUM_STATES],
+    const std::complex<double> (&poles)[MODEL_NUM_STATES], double (&k)[MODEL_NUM_STATES]);
+
+// Reference gain for zero steady-state cart position error with u = Nbar·r - K·x
+double plant_nbar(const double (&ad)[MODEL_NUM_STATES][MODEL_NUM_STATES], const double (&bd)[MODEL_NUM_STATES], const double (&k)[MODEL_NUM_STATES]);
+
+
+// ================================================================================
+// Plant and controller for one sample period
+// ================================================================================
+struct PlantDesign {
+    PendPhysParams phys;
+    double ts;                          // sample period, s
+    double a[MODEL_NUM_STATES][MODEL_NUM_STATES];
+    double b[MODEL_NUM_STATES];
+    double k[MODEL_NUM_STATES];         // LQR gain
+    double nbar;
+};
+
+// Discretise and design an LQR controller; false if the design fails
+bool plant_design(const PendPhysParams& phys, double ts, const LqrWeights& w, PlantDesign& design);
+
+// Self-check: the design at 10 ms with the default parameters and weights against MODEL_A, MODEL_B and CTL_K,
+// which are printed to 4 decimals in Model.h; prints the largest differences, false if any is beyond the rounding
+bool plant_check(std::ostream& os);
+
+
+// ================================================================================
+// Plant design cache
+// one design per (physical parameters, sample period), made on first use with the default LQR weights;
+// entries are never removed, so returned references stay valid
+// ================================================================================
+class PlantCache
+{
+public: // constructors
+    static PlantCache& instance(void);              // the process-wide cache
+
+public: // methods
+    const PlantDesign& get(const PendPhysParams& phys, double ts);     // throws InvError if the design fails
+
+private: // constructors
+    PlantCache(void) {};
+    PlantCache(const PlantCache&) = delete;
+
+private: // types
+    struct Key {
+        double v[6];                    // M, m, b, I, l, ts
+        bool operator<(const Key& o) const;
+    };
+
+private: // data
+    std::mutex m_mtx;
+    std::map<Key, PlantDesign> m_designs;
+};
+
+} // namespace inv_example
+
+#endif // __PLANT_H__
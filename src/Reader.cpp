@@ -0,0 +1,204 @@
+// Data file reader implementation
+
+#include <cstring>
+#include <cmath>
+#include <limits>
+#include "Reader.h"
+#include "System.h"
+#include "Error.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define READER_KERNEL_SSE2
+#endif
+
+namespace inv_example {
+// ================================================================================
+// Data file reader
+// ================================================================================
+// map the file and index its chunks
+DataReader::DataReader(const std::string& file_name)
+    : m_file(file_name),
+    m_header(reinterpret_cast<const RecFileHeader*>(m_file.data())),
+    m_chunk_records(0),
+    m_size(0)
+{
+    const uint8_t* p = m_file.data();
+    const size_t size = m_file.size();
+    if (size < sizeof(RecFileHeader) || std::memcmp(m_header->magic, REC_FILE_MAGIC, sizeof(m_header->magic)) != 0 ||
+        m_header->version != REC_FILE_VERSION || m_header->byte_order != REC_BYTE_ORDER_MARK ||
+        m_header->num_columns != REC_NUM_COLUMNS || m_header->chunk_records == 0) {
+        throw NewInvError(SYSERR_RECORDER_BAD_FILE);
+    }
+    m_chunk_records = m_header->chunk_records;
+
+    size_t off = sizeof(RecFileHeader);
+    while (off + sizeof(RecChunkHeader) <= size) {
+        const RecChunkHeader* ch = reinterpret_cast<const RecChunkHeader*>(p + off);
+        if (ch->magic != REC_CHUNK_MAGIC || ch->count == 0 || ch->count > m_chunk_records) break;
+        if (off + rec_chunk_bytes(ch->count) > size) break;                     // still being written
+        if (!m_chunks.empty() && m_chunks.back().count != m_chunk_records) break;  // only the last chunk may be partial
+
+        RecChunkView view;
+        view.count = ch->count;
+        view.t = reinterpret_cast<const int64_t*>(p + off + rec_column_offset(REC_T, ch->count));
+        for (int c = 0; c < REC_NUM_VALUES; ++c) {
+            view.value[c] = reinterpret_cast<const double*>(p + off + rec_column_offset(static_cast<RecColumn>(REC_POS_CMD + c), ch->count));
+        }
+        view.mode = p + off + rec_column_offset(REC_MODE, ch->count);
+        m_chunks.push_back(view);
+        m_size += ch->count;
+        off += rec_chunk_bytes(ch->count);
+    }
+}
+
+// one record
+RecRecord DataReader::get(uint64_t n) const
+{
+    const RecChunkView& c = m_chunks[static_cast<size_t>(n / m_chunk_records)];
+    uint32_t i = static_cast<uint32_t>(n % m_chunk_records);
+    RecRecord rec;
+    rec.t_ns = c.t[i];
+    for (int v = 0; v < REC_NUM_VALUES; ++v) rec.value[v] = c.value[v][i];
+    rec.mode = c.mode[i];
+    return rec;
+}
+
+int64_t DataReader::t_first_ns(void) const
+{
+    return m_chunks.empty() ? 0 : m_chunks.front().t[0];
+}
+
+int64_t DataReader::t_last_ns(void) const
+{
+    return m_chunks.empty() ? 0 : m_chunks.back().t[m_chunks.back().count - 1];
+}
+
+// first record with t >= t_ns
+// the chunk by the time of its last record, then the record within the chunk
+uint64_t DataReader::first_at(int64_t t_ns) const
+{
+    auto c = std::lower_bound(m_chunks.begin(), m_chunks.end(), t_ns,
+        [](const RecChunkView& chunk, int64_t t) { return chunk.t[chunk.count - 1] < t; });
+    if (c == m_chunks.end()) return m_size;
+    const int64_t* i = std::lower_bound(c->t, c->t + c->count, t_ns);
+    return static_cast<uint64_t>(c - m_chunks.begin()) * m_chunk_records + static_cast<uint64_t>(i - c->t);
+}
+
+// records with t_begin <= t < t_end
+RecRange DataReader::range(int64_t t_begin_ns, int64_t t_end_ns) const
+{
+    uint64_t begin = first_at(t_begin_ns);
+    uint64_t end = first_at(t_end_ns);
+    return RecRange{ begin, std::max(begin, end) };
+}
+
+
+// ================================================================================
+// Mode segment statistics
+// ================================================================================
+struct ColumnAcc {
+    double min;
+    double max;
+    double sum_sq;
+};
+
+// end of the run of records in the mode of record i
+static uint32_t mode_run_end(const uint8_t* mode, uint32_t i, uint32_t end)
+{
+    const uint8_t m = mode[i];
+#ifdef READER_KERNEL_SSE2
+    const __m128i mm = _mm_set1_epi8(static_cast<char>(m));
+    while (i + 16 <= end) {
+        unsigned diff = ~static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(mode + i)), mm))) & 0xffffu;
+        if (diff != 0) {
+            while ((diff & 1u) == 0) {
+                diff >>= 1;
+                ++i;
+            }
+            return i;
+        }
+        i += 16;
+    }
+#endif
+    while (i < end && mode[i] == m) ++i;
+    return i;
+}
+
+// add n values to the statistics of a column
+static void column_acc(const double* v, uint32_t n, ColumnAcc& acc)
+{
+    uint32_t i = 0;
+#ifdef READER_KERNEL_SSE2
+    __m128d mn = _mm_set1_pd(acc.min);
+    __m128d mx = _mm_set1_pd(acc.max);
+    __m128d s0 = _mm_setzero_pd();
+    __m128d s1 = _mm_setzero_pd();
+    for (; i + 4 <= n; i += 4) {
+        const __m128d x0 = _mm_loadu_pd(v + i);
+        const __m128d x1 = _mm_loadu_pd(v + i + 2);
+        mn = _mm_min_pd(mn, _mm_min_pd(x0, x1));
+        mx = _mm_max_pd(mx, _mm_max_pd(x0, x1));
+        s0 = _mm_add_pd(s0, _mm_mul_pd(x0, x0));
+        s1 = _mm_add_pd(s1, _mm_mul_pd(x1, x1));
+    }
+    double r[2];
+    _mm_storeu_pd(r, _mm_min_pd(mn, _mm_unpackhi_pd(mn, mn)));
+    acc.min = r[0];
+    _mm_storeu_pd(r, _mm_max_pd(mx, _mm_unpackhi_pd(mx, mx)));
+    acc.max = r[0];
+    _mm_storeu_pd(r, _mm_add_pd(s0, s1));
+    acc.sum_sq += r[0] + r[1];
+#endif
+    for (; i < n; ++i) {
+        acc.min = v[i] < acc.min ? v[i] : acc.min;
+        acc.max = v[i] > acc.max ? v[i] : acc.max;
+        acc.sum_sq += v[i] * v[i];
+    }
+}
+
+static RecColumnStats column_stats(const ColumnAcc& acc, uint64_t count)
+{
+    return RecColumnStats{ acc.min, acc.max, std::sqrt(acc.sum_sq / static_cast<double>(count)) };
+}
+
+// statistics of each mode segment in the range
+// a segment may continue across chunks, it is closed when the mode changes or the range ends
+std::vector<RecSegmentStats> rec_segment_stats(const DataReader& reader, const RecRange& r)
+{
+    std::vector<RecSegmentStats> segments;
+    bool open = false;
+    RecSegmentStats seg{};
+    ColumnAcc pend{}, force{};
+
+    auto close = [&]() {
+        seg.pend_pos = column_stats(pend, seg.count);
+        seg.force_cmd = column_stats(force, seg.count);
+        segments.push_back(seg);
+    };
+
+    reader.for_each_span(r, [&](const RecChunkView& chunk, uint32_t begin, uint32_t end) {
+        const double* pend_pos = chunk.column(REC_PEND_POS);
+        const double* force_cmd = chunk.column(REC_FORCE_CMD);
+        uint32_t i = begin;
+        while (i < end) {
+            uint32_t run_end = mode_run_end(chunk.mode, i, end);
+            SysMode mode = static_cast<SysMode>(chunk.mode[i]);
+            if (!open || mode != seg.mode) {
+                if (open) close();
+                open = true;
+                seg = RecSegmentStats{ mode, chunk.t[i], chunk.t[i], 0, {}, {} };
+                pend = force = ColumnAcc{ std::numeric_limits<double>::infinity(), -std::numeric_limits<double>::infinity(), 0.0 };
+            }
+            column_acc(pend_pos + i, run_end - i, pend);
+            column_acc(force_cmd + i, run_end - i, force);
+            seg.count += run_end - i;
+            seg.t_end_ns = chunk.t[run_end - 1];
+            i = run_end;
+        }
+    });
+    if (open) close();
+    return segments;
+}
+
+} // namespace inv_example
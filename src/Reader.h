@@ -0,0 +1,124 @@
+// Data file reader definitions
+
+#ifndef __READER_H__
+#define __READER_H__
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "Ipc.h"
+#include "Recorder.h"
+#include "Timestamp.h"
+
+namespace inv_example {
+// ================================================================================
+// Data file chunk
+// the column arrays of one chunk, pointing into the mapped file
+// ================================================================================
+struct RecChunkView {
+    uint32_t count;
+    const int64_t* t;                           // REC_T
+    const double* value[REC_NUM_VALUES];        // REC_POS_CMD .. REC_FORCE_CMD
+    const uint8_t* mode;                        // REC_MODE
+
+    const double* column(RecColumn col) const { return value[col - REC_POS_CMD]; };
+};
+
+// Records [begin, end) of a data file, numbered from the start of the file
+struct RecRange {
+    uint64_t begin;
+    uint64_t end;
+    uint64_t size(void) const { return end - begin; };
+};
+
+
+// ================================================================================
+// Data file reader
+// maps a data file of the data recorder and reads the columns in place, nothing is copied or parsed;
+// every chunk but the last is full, so record n is in chunk n / chunk_records
+// ================================================================================
+class DataReader
+{
+public: // constructors
+    // map the file, throws InvError if it can not be mapped or is not a data file;
+    // an incomplete chunk at the end, e.g. of a recording that is still running, is ignored
+    explicit DataReader(const std::string& file_name);
+    DataReader(const DataReader&) = delete;
+
+public: // methods
+    const RecFileHeader& get_header(void) const { return *m_header; };
+    uint64_t size(void) const { return m_size; };                   // number of records
+    size_t num_chunks(void) const { return m_chunks.size(); };
+    const RecChunkView& chunk(size_t i) const { return m_chunks[i]; };
+    RecRecord get(uint64_t n) const;                                // one record
+    int64_t t_first_ns(void) const;                                 // time of the first and last record
+    int64_t t_last_ns(void) const;
+
+    // records with t_begin <= t < t_end, found by binary search
+    RecRange range(int64_t t_begin_ns, int64_t t_end_ns) const;
+    RecRange range(const InvTimestamp& t_begin, const InvTimestamp& t_end) const { return range(rec_time_ns(t_begin), rec_time_ns(t_end)); };
+    RecRange all(void) const { return RecRange{ 0, m_size }; };
+
+    // call f(chunk, begin, end) for each part of a chunk in the range, in order
+    template<typename F>
+    void for_each_span(const RecRange& r, F f) const
+    {
+        uint64_t n = r.begin;
+        while (n < r.end) {
+            size_t c = static_cast<size_t>(n / m_chunk_records);
+            uint32_t begin = static_cast<uint32_t>(n - c * m_chunk_records);
+            uint32_t end = static_cast<uint32_t>(std::min<uint64_t>(m_chunks[c].count, r.end - c * m_chunk_records));
+            f(m_chunks[c], begin, end);
+            n += end - begin;
+        }
+    };
+
+    // call f(t_ns, value) for each value of a column in the range
+    template<typename F>
+    void for_each(RecColumn col, const RecRange& r, F f) const
+    {
+        for_each_span(r, [col, &f](const RecChunkView& chunk, uint32_t begin, uint32_t end) {
+            const double* v = chunk.column(col);
+            for (uint32_t i = begin; i < end; ++i) f(chunk.t[i], v[i]);
+        });
+    };
+
+private: // methods
+    uint64_t first_at(int64_t t_ns) const;     // first record with t >= t_ns
+
+private: // data
+    IpcMappedFile m_file;
+    const RecFileHeader* m_header;
+    uint32_t m_chunk_records;
+    uint64_t m_size;
+    std::vector<RecChunkView> m_chunks;
+};
+
+
+// ================================================================================
+// Mode segment statistics
+// one segment per run of records in the same mode
+// ================================================================================
+struct RecColumnStats {
+    double min;
+    double max;
+    double rms;
+};
+
+struct RecSegmentStats {
+    SysMode mode;
+    int64_t t_begin_ns;                 // first and last record of the segment
+    int64_t t_end_ns;
+    uint64_t count;
+    RecColumnStats pend_pos;            // rad
+    RecColumnStats force_cmd;           // N
+};
+
+// statistics of each mode segment in the range, one pass over the mode, PendPos and ForceCmd columns
+std::vector<RecSegmentStats> rec_segment_stats(const DataReader& reader, const RecRange& r);
+
+} // namespace inv_example
+
+#endif // __READER_H__
@@ -0,0 +1,187 @@
+// Data recorder implementation
+
+#include <cstring>
+#include <chrono>
+#include <iomanip>
+#include "Recorder.h"
+#include "Reader.h"
+#include "System.h"
+#include "Error.h"
+
+namespace inv_example {
+const uint8_t REC_MODE_END = 0xff;      // record that stops the writer thread, never written
+
+// ================================================================================
+// One data file record
+// ================================================================================
+RecRecord rec_record(const SysStatus& status)
+{
+    RecRecord rec;
+    rec.t_ns = rec_time_ns(status.time);
+    rec.value[0] = status.pos_cmd;
+    rec.value[1] = status.cart_pos;
+    rec.value[2] = status.cart_vel;
+    rec.value[3] = status.pend_pos;
+    rec.value[4] = status.pend_vel;
+    rec.value[5] = status.force_cmd;
+    rec.mode = static_cast<uint8_t>(status.mode);
+    return rec;
+}
+
+int64_t rec_time_ns(const InvTimestamp& t)
+{
+    return t.to_ns();
+}
+
+InvTimestamp rec_timestamp(int64_t t_ns)
+{
+    return InvTimestamp::from_ns(t_ns);
+}
+
+
+// ================================================================================
+// Data recorder
+// ================================================================================
+// create the file and start the writer thread
+DataRecorder::DataRecorder(const std::string& file_name, const IpcThreadConfig& cfg)
+    : m_file(file_name, std::ios::binary | std::ios::trunc),
+    m_write_failed(false),
+    m_count(0),
+    m_t(REC_CHUNK_RECORDS),
+    m_mode(REC_CHUNK_RECORDS)
+{
+    for (auto& v : m_value) v.resize(REC_CHUNK_RECORDS);
+
+    RecFileHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, REC_FILE_MAGIC, sizeof(header.magic));
+    header.version = REC_FILE_VERSION;
+    header.byte_order = REC_BYTE_ORDER_MARK;
+    header.chunk_records = REC_CHUNK_RECORDS;
+    header.num_columns = REC_NUM_COLUMNS;
+    header.start_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    header.start_wall_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    m_file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    if (!m_file) {
+        enqueue_error(NewInvError(SYSERR_RECORDER_OPEN_FAILED));
+        return;                         // not recording, records are discarded
+    }
+
+    bool ok;
+    m_thread = ipc_start_thread(cfg, ok, [this] { writer_thread(); });
+    if (!ok) enqueue_error(NewInvError(SYSERR_THREAD_CONFIG_FAILED));
+}
+
+// queue the end marker behind the last record and wait for the writer
+DataRecorder::~DataRecorder()
+{
+    if (!is_open()) return;
+    RecRecord end;
+    std::memset(&end, 0, sizeof(end));
+    end.mode = REC_MODE_END;
+    record_wait(end);
+    m_thread.join();
+}
+
+// queue a record
+// called from the control thread, copies the record into the ring and returns
+bool DataRecorder::record(const RecRecord& rec)
+{
+    if (!is_open()) return false;
+    if (m_ring.Send(rec)) return true;
+    m_dropped.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+// queue a record, waiting for the writer thread to make room
+void DataRecorder::record_wait(const RecRecord& rec)
+{
+    if (!is_open()) return;
+    while (!m_ring.Send(rec)) std::this_thread::yield();
+}
+
+bool DataRecorder::record(const SysStatus& status)
+{
+    return record(rec_record(status));
+}
+
+// Writer thread
+// transposes records into the column arrays and writes a chunk whenever one fills up
+void DataRecorder::writer_thread(void)
+{
+    std::vector<RecRecord> batch;
+    batch.reserve(BATCH_LEN);
+    bool run = true;
+    while (run) {
+        batch.clear();
+        m_ring.WaitBatch(batch, BATCH_LEN);
+        for (auto& rec : batch) {
+            if (rec.mode == REC_MODE_END) {
+                run = false;
+                break;
+            }
+            m_t[m_count] = rec.t_ns;
+            for (int c = 0; c < REC_NUM_VALUES; ++c) m_value[c][m_count] = rec.value[c];
+            m_mode[m_count] = rec.mode;
+            if (++m_count == REC_CHUNK_RECORDS) write_chunk();
+        }
+    }
+    write_chunk();                      // the last, partial chunk
+    m_file.close();
+}
+
+// write the buffered records as one chunk
+void DataRecorder::write_chunk(void)
+{
+    if (m_count == 0) return;
+    RecChunkHeader header;
+    std::memset(&header, 0, sizeof(header));
+    header.magic = REC_CHUNK_MAGIC;
+    header.count = m_count;
+    header.t_first_ns = m_t[0];
+    header.t_last_ns = m_t[m_count - 1];
+
+    m_file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    m_file.write(reinterpret_cast<const char*>(m_t.data()), sizeof(int64_t) * m_count);
+    for (auto& v : m_value) m_file.write(reinterpret_cast<const char*>(v.data()), sizeof(double) * m_count);
+    static const char pad[8] = {};
+    m_file.write(reinterpret_cast<const char*>(m_mode.data()), m_count);
+    m_file.write(pad, rec_chunk_bytes(m_count) - rec_column_offset(REC_MODE, m_count) - m_count);
+    m_file.flush();
+
+    if (!m_file && !m_write_failed) {
+        m_write_failed = true;
+        enqueue_error(NewInvError(SYSERR_RECORDER_WRITE_FAILED));
+    }
+    m_written.fetch_add(m_count, std::memory_order_relaxed);
+    m_count = 0;
+}
+
+
+// ================================================================================
+// CSV export
+// ================================================================================
+// the file is read through the data file reader, an incomplete last chunk is left out
+bool rec_export_csv(const std::string& file_name, std::ostream& out)
+{
+    try {
+        DataReader reader(file_name);
+        const int64_t t0 = reader.t_first_ns();
+        out << "Time,Mode,PosCmd,CartPos,CartVel,PendPos,PendVel,ForceCmd\n";
+        out << std::fixed;
+        reader.for_each_span(reader.all(), [&out, t0](const RecChunkView& chunk, uint32_t begin, uint32_t end) {
+            for (uint32_t i = begin; i < end; ++i) {
+                out << std::setprecision(4) << (chunk.t[i] - t0) / 1e9 << ',' << sys_mode_name(static_cast<SysMode>(chunk.mode[i]));
+                out << std::setprecision(6);
+                for (int c = 0; c < REC_NUM_VALUES; ++c) out << ',' << chunk.value[c][i];
+                out << '\n';
+            }
+        });
+        return true;
+    }
+    catch (const InvError&) {
+        return false;
+    }
+}
+
+} // namespace inv_example
@@ -0,0 +1,142 @@
+// Data recorder definitions
+
+#ifndef __RECORDER_H__
+#define __RECORDER_H__
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <thread>
+#include <atomic>
+#include "Ipc.h"
+#include "Controller.h"
+
+namespace inv_example {
+// ================================================================================
+// Data file format
+// the 100 Hz record of doc/InterfaceDefinitions.txt stored by column in chunks;
+// native byte order with every field 8-byte aligned so a mapped file can be read in place
+//   file header
+//   chunk header, then one array of count values per column:
+//     t_ns (int64), pos_cmd, cart_pos, cart_vel, pend_pos, pend_vel, force_cmd (double), mode (uint8, padded to 8 bytes)
+//   ... more chunks, every chunk but the last is full
+// ================================================================================
+const char REC_FILE_MAGIC[8] = { 'I', 'N', 'V', 'R', 'E', 'C', '1', '\0' };
+const uint32_t REC_FILE_VERSION = 1;
+const uint32_t REC_BYTE_ORDER_MARK = 0x01020304;    // reads back differently on a host of the other byte order
+const uint32_t REC_CHUNK_MAGIC = 0x4b4e4843;        // "CHNK"
+const uint32_t REC_CHUNK_RECORDS = 1024;            // records in a full chunk, 10.24 s at 100 Hz
+
+struct RecFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;                // REC_BYTE_ORDER_MARK
+    uint32_t chunk_records;             // records in a full chunk
+    uint32_t num_columns;
+    int64_t start_ns;                   // steady clock at the start of the recording
+    int64_t start_wall_ns;              // system clock at the same moment, ns since 1970
+    uint8_t reserved[24];
+};
+static_assert(sizeof(RecFileHeader) == 64, "RecFileHeader layout");
+
+struct RecChunkHeader {
+    uint32_t magic;                     // REC_CHUNK_MAGIC
+    uint32_t count;                     // records in this chunk
+    int64_t t_first_ns;                 // time of the first and last record
+    int64_t t_last_ns;
+    uint64_t reserved;
+};
+static_assert(sizeof(RecChunkHeader) == 32, "RecChunkHeader layout");
+
+enum RecColumn {
+    REC_T,
+    REC_POS_CMD,
+    REC_CART_POS,
+    REC_CART_VEL,
+    REC_PEND_POS,
+    REC_PEND_VEL,
+    REC_FORCE_CMD,
+    REC_MODE,
+    REC_NUM_COLUMNS
+};
+
+const int REC_NUM_VALUES = REC_MODE - REC_POS_CMD;  // double columns
+
+// Offset of a column from the start of its chunk header
+inline size_t rec_column_offset(RecColumn col, uint32_t count) { return sizeof(RecChunkHeader) + sizeof(double) * count * col; };
+// Size of a chunk including its header
+inline size_t rec_chunk_bytes(uint32_t count) { return rec_column_offset(REC_MODE, count) + ((count + 7u) & ~7u); };
+
+
+// ================================================================================
+// One data file record
+// ================================================================================
+struct RecRecord {
+    int64_t t_ns;                       // steady clock
+    double value[REC_NUM_VALUES];       // pos_cmd, cart_pos, cart_vel, pend_pos, pend_vel, force_cmd
+    uint8_t mode;                       // SysMode
+};
+
+// Record of the controller status
+RecRecord rec_record(const SysStatus& status);
+// Record time of a timestamp, ns of the steady clock, and back
+int64_t rec_time_ns(const InvTimestamp& t);
+InvTimestamp rec_timestamp(int64_t t_ns);
+
+
+// ================================================================================
+// Data recorder
+// the control thread copies records into a lock-free ring, a writer thread transposes them
+// into column chunks and appends them to the file; record() never formats, locks or does I/O
+// ================================================================================
+class DataRecorder
+{
+public: // constructors
+    // create the file; if it can not be created the error is reported and the records are discarded
+    explicit DataRecorder(const std::string& file_name, const IpcThreadConfig& cfg = IpcThreadConfig());    // cfg applies to the writer thread
+    DataRecorder(const DataRecorder&) = delete;
+    ~DataRecorder();                    // write the records still queued and close the file
+
+public: // methods
+    bool is_open(void) const { return m_thread.joinable(); };  // recording to the file
+    bool record(const SysStatus& status);       // queue a record, false if the ring is full and the record was dropped
+    bool record(const RecRecord& rec);
+    void record_wait(const RecRecord& rec);     // queue a record, waiting for room; for callers that are not real time
+    unsigned long long get_dropped(void) const { return m_dropped.load(std::memory_order_relaxed); };
+    unsigned long long get_written(void) const { return m_written.load(std::memory_order_relaxed); };
+
+public: // constants
+    static const size_t RING_LEN = 4096;        // 40 s of records at 100 Hz
+    static const size_t BATCH_LEN = 256;        // records taken from the ring per wakeup
+
+private: // methods
+    void writer_thread(void);
+    void write_chunk(void);             // write the buffered records as one chunk
+
+private: // data
+    IpcSpscQueue<RecRecord, RING_LEN> m_ring;
+    std::ofstream m_file;
+    bool m_write_failed;                // reported once
+    // chunk being built by the writer thread, one array per column
+    uint32_t m_count;
+    std::vector<int64_t> m_t;
+    std::vector<double> m_value[REC_NUM_VALUES];
+    std::vector<uint8_t> m_mode;
+    std::atomic<unsigned long long> m_dropped{ 0 };
+    std::atomic<unsigned long long> m_written{ 0 };
+    std::thread m_thread;
+};
+
+
+// ================================================================================
+// CSV export
+// writes the file as the CSV data file of doc/InterfaceDefinitions.txt,
+// Time in seconds since the first record; false if the file can not be read
+// ================================================================================
+bool rec_export_csv(const std::string& file_name, std::ostream& out);
+
+} // namespace inv_example
+
+#endif // __RECORDER_H__
@@ -0,0 +1,140 @@
+// Real-time configuration implementation
+
+#include <cstring>
+#include <cstdlib>
+#include <iomanip>
+#include "RtConfig.h"
+
+namespace inv_example {
+// ================================================================================
+// System threads
+// ================================================================================
+const char* sys_thread_name(SysThread thread)
+{
+    switch (thread) {
+    case SysThread::CONTROL:    return "control";
+    case SysThread::COMMS_RX:   return "rx";
+    case SysThread::COMMS_TX:   return "tx";
+    case SysThread::TIMER:      return "timer";
+    case SysThread::LOGGER:     return "logger";
+    default:                    return "unknown";
+    }
+}
+
+
+// ================================================================================
+// Real-time options
+// ================================================================================
+// parse a decimal number at p, false if there are no digits
+static bool parse_int(const char*& p, long& value)
+{
+    char* end;
+    value = std::strtol(p, &end, 10);
+    if (end == p) return false;
+    p = end;
+    return true;
+}
+
+// a list of CPUs and ranges, e.g. 2 or 0-1,4
+static bool parse_cpus(const char* p, uint64_t& cpus)
+{
+    cpus = 0;
+    for (;;) {
+        long first, last;
+        if (!parse_int(p, first)) return false;
+        last = first;
+        if (*p == '-' && !parse_int(++p, last)) return false;
+        if (first < 0 || last < first || last > 63) return false;
+        for (long cpu = first; cpu <= last; ++cpu) cpus |= static_cast<uint64_t>(1) << cpu;
+        if (*p == '\0') return true;
+        if (*p++ != ',') return false;
+    }
+}
+
+bool SysRtConfig::parse_thread(const std::string& spec)
+{
+    size_t eq = spec.find('=');
+    if (eq == std::string::npos) return false;
+    std::string name = spec.substr(0, eq);
+    int thread = 0;
+    while (thread < SYS_NUM_THREADS && name != sys_thread_name(static_cast<SysThread>(thread))) ++thread;
+    if (thread == SYS_NUM_THREADS) return false;
+
+    const char* p = spec.c_str() + eq + 1;
+    long priority;
+    uint64_t cpus = 0;
+    if (!parse_int(p, priority) || priority < 0 || priority > 99) return false;
+    if (*p == '@') {
+        if (!parse_cpus(p + 1, cpus)) return false;
+    }
+    else if (*p != '\0') {
+        return false;
+    }
+    threads[thread].priority = static_cast<int>(priority);
+    threads[thread].cpus = cpus;
+    return true;
+}
+
+void SysRtConfig::set_lock_memory(void)
+{
+    lock_memory = true;
+    for (auto& t : threads) t.stack_prefault = SYS_STACK_PREFAULT;
+}
+
+
+// ================================================================================
+// Real-time self-check
+// ================================================================================
+static unsigned long long faults(const IpcUsage& u) { return u.minor_faults + u.major_faults; }
+
+bool SysRtCheck::on_tick(void)
+{
+    if (m_tick > RT_CHECK_WARMUP + RT_CHECK_TICKS) return false;    // done
+
+    IpcUsage thread{}, process{};
+    bool counted = ipc_get_thread_usage(thread);
+    counted = ipc_get_process_usage(process) && counted;
+    int cpu = ipc_current_cpu();
+
+    if (m_tick == RT_CHECK_WARMUP) {
+        m_thread_start = thread;
+        m_process_start = process;
+    }
+    else if (m_tick > RT_CHECK_WARMUP) {
+        unsigned long long n = faults(thread) - faults(m_thread_last);
+        if (n > m_report.faults_max) m_report.faults_max = n;
+        if (cpu != m_cpu) ++m_report.migrations;
+    }
+    m_thread_last = thread;
+    m_cpu = cpu;
+
+    if (m_tick++ < RT_CHECK_WARMUP + RT_CHECK_TICKS) return false;
+    const double ticks = RT_CHECK_TICKS;
+    m_report.counted = counted;
+    m_report.ticks = RT_CHECK_TICKS;
+    m_report.faults_per_tick = (faults(thread) - faults(m_thread_start)) / ticks;
+    m_report.invol_switches_per_tick = (thread.invol_switches - m_thread_start.invol_switches) / ticks;
+    m_report.vol_switches_per_tick = (thread.vol_switches - m_thread_start.vol_switches) / ticks;
+    m_report.process_faults_per_tick = (faults(process) - faults(m_process_start)) / ticks;
+    return true;
+}
+
+void SysRtCheck::print(std::ostream& os) const
+{
+    const SysRtCheckReport& r = m_report;
+    os << "Real-time check, " << r.ticks << " ticks after " << RT_CHECK_WARMUP << " warmup ticks" << std::endl;
+    if (!r.counted) {
+        os << "  page faults and context switches are not counted on this platform, CPU migrations " << r.migrations << std::endl;
+        return;
+    }
+    std::ios::fmtflags flags = os.flags();
+    os << std::fixed << std::setprecision(2)
+        << "  control thread  faults/tick " << r.faults_per_tick << " (max " << r.faults_max << ")"
+        << ", preempted/tick " << r.invol_switches_per_tick
+        << ", waits/tick " << r.vol_switches_per_tick
+        << ", CPU migrations " << r.migrations << std::endl
+        << "  process         faults/tick " << r.process_faults_per_tick << std::endl;
+    os.flags(flags);
+}
+
+} // namespace inv_example
@@ -0,0 +1,88 @@
+// Real-time configuration definitions
+// scheduling options of the system threads, memory locking, and the startup self-check
+
+#ifndef __RTCONFIG_H__
+#define __RTCONFIG_H__
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <iostream>
+#include "Ipc.h"
+
+namespace inv_example {
+// ================================================================================
+// System threads
+// ================================================================================
+enum class SysThread : int {
+    CONTROL,                // main loop: control ticks, sensor messages and the data recorder input
+    COMMS_RX,               // receive path: parser, sensor messages to the main loop
+    COMMS_TX,               // transmit path: commands to the cart interface
+    TIMER,                  // timer service: control tick and keepalive messages
+    LOGGER,                 // log file and data file writers
+};
+const int SYS_NUM_THREADS = 5;
+
+const char* sys_thread_name(SysThread thread);     // name used on the command line
+
+
+// ================================================================================
+// Real-time options
+// set from the command line before the system starts, see main() in InvExample.cpp
+// ================================================================================
+const size_t SYS_STACK_PREFAULT = 256 * 1024;      // stack touched by each system thread when memory is locked
+
+struct SysRtConfig {
+    IpcThreadConfig threads[SYS_NUM_THREADS];
+    bool lock_memory = false;                       // lock the process in RAM before the threads start
+
+    const IpcThreadConfig& get(SysThread thread) const { return threads[static_cast<int>(thread)]; };
+    bool parse_thread(const std::string& spec);    // <thread>=<priority>[@<cpus>], e.g. control=80@2 or logger=0@0-1,4; false if malformed
+    void set_lock_memory(void);                     // lock memory and prefault the stack of every system thread
+};
+
+
+// ================================================================================
+// Real-time self-check
+// counts the page faults, context switches and CPU migrations of the control thread, and the page
+// faults of the whole process, over the first control ticks; the first RT_CHECK_WARMUP ticks fault in
+// the code and data of the control path and are left out
+// ================================================================================
+const unsigned int RT_CHECK_WARMUP = 10;
+const unsigned int RT_CHECK_TICKS = 100;           // 1 s at 100 Hz
+
+struct SysRtCheckReport {
+    bool counted;                       // false if the platform does not count faults and switches
+    unsigned int ticks;                 // ticks counted after the warmup
+    double faults_per_tick;             // control thread, minor and major
+    unsigned long long faults_max;      // most control thread faults in one tick
+    double invol_switches_per_tick;     // control thread preempted
+    double vol_switches_per_tick;       // control thread waiting for messages, normally one or two per tick
+    unsigned long long migrations;      // ticks on a different CPU from the tick before
+    double process_faults_per_tick;     // every thread of the process
+
+    bool is_clean(void) const { return faults_max == 0 && invol_switches_per_tick == 0.0 && migrations == 0; };
+};
+
+class SysRtCheck
+{
+public: // constructors
+    SysRtCheck() : m_tick(0), m_cpu(-1), m_report{} {};
+
+public: // methods
+    bool on_tick(void);                 // call on the control thread at each tick, true on the tick that completes the check
+    const SysRtCheckReport& get_report(void) const { return m_report; };
+    void print(std::ostream& os) const;
+
+private: // data
+    unsigned int m_tick;                // ticks seen
+    IpcUsage m_thread_start;            // control thread at the end of the warmup
+    IpcUsage m_process_start;
+    IpcUsage m_thread_last;             // control thread at the previous tick
+    int m_cpu;                          // CPU of the previous tick
+    SysRtCheckReport m_report;
+};
+
+} // namespace inv_example
+
+#endif // __RTCONFIG_H__
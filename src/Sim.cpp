@@ -0,0 +1,169 @@
+// Closed-loop simulation implementation
+
+#include <iostream>
+#include <cmath>
+#include <memory>
+#include "Sim.h"
+
+using namespace std;
+
+namespace inv_example {
+// ================================================================================
+// Closed-loop simulation
+// ================================================================================
+// start the periodic messages of the main loop on the virtual clock
+InvPendSim::InvPendSim(const InvPendModel::States& x0, const PlantDesign* design)
+    : m_plant(design ? InvPendModel(x0, design->a, design->b) : InvPendModel(x0)),
+    m_ctl([this](const CommPacketBase& packet) { on_cart_packet(packet); }),
+    m_force(0.0),
+    m_tick_ns(design ? llround(design->ts * 1e9) : TICK_NS),
+    m_stats{ 0, 0, 0.0, 0.0, 0.0 },
+    m_recorder(nullptr),
+    m_capture(nullptr)
+{
+    if (design) {
+        m_ctl.set_gains(design->k, design->nbar);
+        m_plant.set_gains(design->k, design->nbar);
+    }
+    m_sched.post(m_tick_ns, IpcMsg(IpcMsgId::MSG_TICK), m_tick_ns);
+    m_sched.post(KEEPALIVE_NS, IpcMsg(IpcMsgId::MSG_KEEPALIVE), KEEPALIVE_NS);
+}
+
+// simulate duration_s as fast as possible
+// statistics are for this call only, the simulation can be continued by calling run again
+SimStats InvPendSim::run(double duration_s)
+{
+    m_stats = SimStats{ 0, 0, 0.0, 0.0, 0.0 };
+    int64_t start_ns = m_sched.now_ns();
+    auto t0 = chrono::steady_clock::now();
+    m_sched.run_until(start_ns + llround(duration_s * 1e9), [this](const IpcMsg& msg) { return handle(msg); });
+    auto t1 = chrono::steady_clock::now();
+
+    m_stats.sim_s = (m_sched.now_ns() - start_ns) / 1e9;
+    m_stats.wall_s = chrono::duration<double>(t1 - t0).count();
+    m_stats.speedup = m_stats.wall_s > 0.0 ? m_stats.sim_s / m_stats.wall_s : 0.0;
+    return m_stats;
+}
+
+// one message from the virtual clock
+bool InvPendSim::handle(const IpcMsg& msg)
+{
+    if (msg.GetId() == IpcMsgId::MSG_EXIT) return false;
+    if (msg.GetId() == IpcMsgId::MSG_TICK) {
+        plant_tick();               // sensor data for this tick arrive before the controller runs
+        ++m_stats.ticks;
+    }
+    m_ctl.on_msg(msg, m_sched.now());
+    if (msg.GetId() == IpcMsgId::MSG_TICK && m_recorder) {
+        m_recorder->record_wait(rec_record(m_ctl.get_status()));   // not real time, never drop a record
+    }
+    return true;
+}
+
+// advance the plant with the last force command and send its sensor packets
+void InvPendSim::plant_tick(void)
+{
+    m_plant.on_tick_100hz(m_force);
+    InvPendModel::States x = m_plant.get_states();
+    send_sensor(CommLink::CART, CartDataPacket(x.cart_pos, x.cart_vel));
+    send_sensor(CommLink::PEND, PendDataPacket(x.pend_pos * RAD_TO_DEG, x.pend_vel));
+}
+
+// pass a sensor packet through the parser to the controller as the receive path would
+void InvPendSim::send_sensor(CommLink link, const CommPacketBase& packet)
+{
+    InvCommParser& parser = m_parser[static_cast<int>(link)];
+    if (m_capture) m_capture->capture_wait(link, packet.get_raw(), packet.get_len(), m_sched.now());
+    parser.next(packet.get_raw(), packet.get_len(), m_sched.now());
+    CommFrame frame;
+    while (parser.get_next_packet(frame)) {
+        ++m_stats.frames;
+        m_ctl.on_msg(make_frame_msg(frame), frame.toa);
+    }
+}
+
+// packet from the controller to the cart
+void InvPendSim::on_cart_packet(const CommPacketBase& packet)
+{
+    if (packet.get_id() == PacketId::FORCE_CMD) {
+        m_force = CartForceCmdPacket(packet.get_raw(), packet.get_len(), m_sched.now()).get_force();
+    }
+}
+
+
+// ================================================================================
+// Regression run
+// every 10 s: move to +0.2 m, arrive, move to -0.2 m, arrive
+// the sensor packets can be captured for replay through the main loop
+// ================================================================================
+const char SIM_DATA_FILE_NAME[] = "InvExample.sim.rec";     // every tick, see RecExport for CSV
+
+int sim_entry_point(double duration_s, const char* capture_file, const PlantDesign* design)
+{
+    const int64_t S = 1000000000;
+    InvPendSim sim(InvPendModel::States{ 0.0, 0.0, 0.0, 0.0 }, design);
+    DataRecorder recorder(SIM_DATA_FILE_NAME);
+    sim.set_recorder(&recorder);
+    std::unique_ptr<CommCapture> capture;
+    if (capture_file) {
+        capture.reset(new CommCapture(capture_file));
+        sim.set_capture(capture.get());
+    }
+    SimScheduler& sched = sim.get_scheduler();
+    int64_t end_ns = llround(duration_s * 1e9);
+    for (int64_t t = S; t < end_ns; t += 10 * S) {
+        sched.post(t, make_move_cmd(0.2));
+        sched.post(t + 4 * S, IpcMsg(IpcMsgId::MSG_ARRIVED));
+        sched.post(t + 5 * S, make_move_cmd(-0.2));
+        sched.post(t + 9 * S, IpcMsg(IpcMsgId::MSG_ARRIVED));
+    }
+
+    SimStats stats = sim.run(duration_s);
+    InvPendModel::States x = sim.get_plant_states();
+    cout << "Control rate " << (design ? 1.0 / design->ts : 1e9 / InvPendSim::TICK_NS) << " Hz" << endl;
+    cout << "Simulated " << stats.sim_s << " s in " << stats.wall_s << " s, " << stats.speedup << "x real time" << endl;
+    cout << "Ticks " << stats.ticks << ", frames " << stats.frames << ", " << stats.wall_s * 1e9 / max(stats.ticks, 1ULL) << " ns/tick" << endl;
+    cout << "Cart pos " << x.cart_pos << " m, pend pos " << x.pend_pos << " rad" << endl;
+    sim.set_recorder(nullptr);
+    cout << "Recorded " << stats.ticks << " ticks to " << SIM_DATA_FILE_NAME << endl;
+    return 0;
+}
+
+
+// ================================================================================
+// Settling self-check
+// ================================================================================
+const int SETTLE_CHECK_RATES[] = { 200, 1000 };    // Hz
+const double SETTLE_CHECK_STEP = 0.2;   // m
+const double SETTLE_CHECK_S = 5.0;
+const double SETTLE_CHECK_POS_TOL = 0.002;         // m, 1 % of the step
+const double SETTLE_CHECK_PEND_TOL = 0.001;        // rad
+
+bool sim_settle_check(std::ostream& os)
+{
+    bool ok = true;
+    for (int rate : SETTLE_CHECK_RATES) {
+        os << "Closed loop at " << rate << " Hz, " << SETTLE_CHECK_STEP << " m step after " << SETTLE_CHECK_S << " s: ";
+        try {
+            const PlantDesign& design = PlantCache::instance().get(PEND_PHYS_DEFAULT, 1.0 / rate);
+            InvPendSim sim(InvPendModel::States{ 0.0, 0.0, 0.0, 0.0 }, &design);
+            sim.get_scheduler().post(0, make_move_cmd(SETTLE_CHECK_STEP));
+            SimStats stats = sim.run(SETTLE_CHECK_S);
+            InvPendModel::States x = sim.get_plant_states();
+            double pos_err = std::fabs(x.cart_pos - SETTLE_CHECK_STEP);
+            double pend_err = std::fabs(x.pend_pos);
+            bool rate_ok = pos_err <= SETTLE_CHECK_POS_TOL && pend_err <= SETTLE_CHECK_PEND_TOL
+                && stats.ticks == static_cast<unsigned long long>(SETTLE_CHECK_S * rate);
+            os << stats.ticks << " ticks, cart position error " << pos_err << " m, pend pos " << x.pend_pos << " rad"
+                << (rate_ok ? ", ok" : ", FAILED") << std::endl;
+            ok = ok && rate_ok;
+        }
+        catch (const InvError& e) {
+            os << "design FAILED, " << e << std::endl;
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+} // namespace inv_example
@@ -0,0 +1,160 @@
+// Closed-loop simulation definitions
+
+#ifndef __SIM_H__
+#define __SIM_H__
+
+#include <cstdint>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include "Comms.h"
+#include "Messages.h"
+#include "Model.h"
+#include "Plant.h"
+#include "Controller.h"
+#include "Recorder.h"
+#include "Capture.h"
+#include "Timestamp.h"
+
+namespace inv_example {
+// ================================================================================
+// Virtual clock scheduler
+// timed messages in simulated time; the clock jumps to the next message instead of sleeping
+// ================================================================================
+class SimScheduler
+{
+public: // constructors
+    SimScheduler(void) : m_now_ns(0), m_seq(0) {};
+
+public: // methods
+    int64_t now_ns(void) const { return m_now_ns; };
+    InvTimestamp now(void) const {              // simulated time as a timestamp, zero at the start of the simulation
+        return InvTimestamp::from_ns(m_now_ns);
+    };
+
+    // deliver msg at t_ns, and every period_ns after that if period_ns is not 0
+    void post(int64_t t_ns, IpcMsg msg, int64_t period_ns = 0)
+    {
+        m_heap.push_back(Event{ t_ns, m_seq++, period_ns, std::move(msg) });
+        std::push_heap(m_heap.begin(), m_heap.end(), Later());
+    };
+
+    // hand each message due up to end_ns to handle(const IpcMsg&) in time order, messages due at the same time in posting order
+    // stops early when handle returns false, returns false if it stopped early
+    template <typename F>
+    bool run_until(int64_t end_ns, F handle)
+    {
+        while (!m_heap.empty() && m_heap.front().t_ns <= end_ns) {
+            std::pop_heap(m_heap.begin(), m_heap.end(), Later());
+            Event& ev = m_heap.back();
+            m_now_ns = ev.t_ns;
+            bool more = true;
+            if (ev.period_ns > 0) {
+                IpcMsg msg = ev.msg;            // the periodic event stays queued
+                ev.t_ns += ev.period_ns;
+                ev.seq = m_seq++;
+                std::push_heap(m_heap.begin(), m_heap.end(), Later());
+                more = handle(msg);             // handle may post new messages
+            }
+            else {
+                IpcMsg msg = std::move(ev.msg);
+                m_heap.pop_back();
+                more = handle(msg);
+            }
+            if (!more) return false;
+        }
+        m_now_ns = std::max(m_now_ns, end_ns);
+        return true;
+    };
+
+private: // types
+    struct Event {
+        int64_t t_ns;
+        uint64_t seq;                           // posting order, breaks ties between equal times
+        int64_t period_ns;
+        IpcMsg msg;
+    };
+    struct Later {
+        bool operator()(const Event& a, const Event& b) const { return a.t_ns != b.t_ns ? a.t_ns > b.t_ns : a.seq > b.seq; };
+    };
+
+private: // data
+    int64_t m_now_ns;
+    uint64_t m_seq;
+    std::vector<Event> m_heap;                  // min-heap on (t_ns, seq)
+};
+
+
+// ================================================================================
+// Simulation run statistics
+// ================================================================================
+struct SimStats {
+    unsigned long long ticks;           // control ticks simulated
+    unsigned long long frames;          // sensor frames through the parser
+    double sim_s;                       // simulated time
+    double wall_s;                      // time taken
+    double speedup;                     // simulated time / time taken
+};
+
+
+// ================================================================================
+// Closed-loop simulation
+// the plant model sends its sensor packets through the comm parser to the system controller,
+// the controller's force command drives the plant on the next tick; all on the virtual clock
+// ================================================================================
+class InvPendSim
+{
+public: // constructors
+    // the Model.h plant and controller at 100 Hz, or a plant design at its own sample period
+    InvPendSim(const InvPendModel::States& x0 = InvPendModel::States{ 0.0, 0.0, 0.0, 0.0 }, const PlantDesign* design = nullptr);
+
+public: // methods
+    SimScheduler& get_scheduler(void) { return m_sched; };     // post scenario messages, e.g. move commands
+    const SysController& get_controller(void) const { return m_ctl; };
+    InvPendModel::States get_plant_states(void) const { return m_plant.get_states(); };
+    SimStats run(double duration_s);    // simulate duration_s as fast as possible, or until MSG_EXIT
+    void set_recorder(DataRecorder* recorder) { m_recorder = recorder; };  // record every tick, nullptr to stop
+    void set_capture(CommCapture* capture) { m_capture = capture; };       // capture the sensor packets, nullptr to stop
+
+public: // constants
+    static const int64_t TICK_NS = 10000000;           // 100 Hz control tick of the Model.h plant
+    static const int64_t KEEPALIVE_NS = 500000000;     // main loop keepalive timer period
+
+private: // methods
+    bool handle(const IpcMsg& msg);
+    void plant_tick(void);                          // advance the plant and send its sensor packets
+    void send_sensor(CommLink link, const CommPacketBase& packet);  // pass a sensor packet through the parser to the controller
+    void on_cart_packet(const CommPacketBase& packet);  // packet from the controller to the cart
+
+private: // data
+    SimScheduler m_sched;
+    InvPendModel m_plant;
+    SysController m_ctl;
+    InvCommParser m_parser[COMM_NUM_LINKS];
+    double m_force;                     // force command applied to the plant
+    int64_t m_tick_ns;                  // control tick period
+    SimStats m_stats;
+    DataRecorder* m_recorder;           // not owned
+    CommCapture* m_capture;             // not owned
+};
+
+
+// ================================================================================
+// Regression run
+// repeated moves of the cart for duration_s of simulated time,
+// with the Model.h plant and controller at 100 Hz or a plant design at its own sample period,
+// every tick recorded to InvExample.sim.rec
+// ================================================================================
+int sim_entry_point(double duration_s, const char* capture_file = nullptr, const PlantDesign* design = nullptr);
+
+
+// ================================================================================
+// Settling self-check
+// a 0.2 m step of the closed loop at 200 Hz and 1 kHz, with designs from the plant cache;
+// prints the cart position error and pendulum angle after 5 s, false if either has not settled
+// ================================================================================
+bool sim_settle_check(std::ostream& os);
+
+} // namespace inv_example
+
+#endif // __SIM_H__
@@ -0,0 +1,164 @@
+// Controller gain sweep implementation
+
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <iomanip>
+#include "Sweep.h"
+#include "Fleet.h"
+
+namespace inv_example {
+const int N = MODEL_NUM_STATES;         // states
+const int SWEEP_NUM_AXES = 5 + 1 + MODEL_NUM_STATES;   // plant parameters, Nbar, K
+
+// ================================================================================
+// Sweep definition
+// ================================================================================
+SweepSpec default_sweep_spec(void)
+{
+    const PendPhysParams& p = PEND_PHYS_DEFAULT;
+    SweepSpec spec;
+    spec.M = SweepRange{ p.M, p.M, 1 };
+    spec.m = SweepRange{ p.m, p.m, 1 };
+    spec.b = SweepRange{ p.b, p.b, 1 };
+    spec.I = SweepRange{ p.I, p.I, 1 };
+    spec.l = SweepRange{ p.l, p.l, 1 };
+    spec.nbar = SweepRange{ CTL_NBAR, CTL_NBAR, 1 };
+    for (int i = 0; i < N; ++i) spec.k[i] = SweepRange{ CTL_K[i], CTL_K[i], 1 };
+    spec.ts = 0.01;
+    spec.step_pos = 0.2;
+    spec.duration_s = 5.0;
+    spec.settle_band = 0.02;
+    return spec;
+}
+
+
+// ================================================================================
+// Sweep engine
+// ================================================================================
+// the axes of the candidate index, the last one changes fastest
+// the plant parameters come first so neighbouring candidates share a discretised plant
+static void sweep_axes(const SweepSpec& spec, const SweepRange* (&axes)[SWEEP_NUM_AXES])
+{
+    const SweepRange* list[SWEEP_NUM_AXES] = { &spec.M, &spec.m, &spec.b, &spec.I, &spec.l, &spec.nbar, &spec.k[0], &spec.k[1], &spec.k[2], &spec.k[3] };
+    std::copy(std::begin(list), std::end(list), axes);
+}
+
+SweepEngine::SweepEngine(unsigned int num_threads)
+    : m_pool(num_threads)
+{
+}
+
+// number of candidates
+size_t SweepEngine::count(const SweepSpec& spec)
+{
+    const SweepRange* axes[SWEEP_NUM_AXES];
+    sweep_axes(spec, axes);
+    size_t n = 1;
+    for (auto axis : axes) n *= std::max(axis->steps, 1u);
+    return n;
+}
+
+// evaluate every candidate
+void SweepEngine::run(const SweepSpec& spec, std::vector<SweepResult>& results)
+{
+    results.resize(count(spec));
+    SweepResult* out = results.data();
+    auto work = [&spec, out](size_t begin, size_t end) { evaluate(spec, begin, end, out); };
+    m_pool.run(results.size(), GRAIN, work);
+}
+
+// evaluate candidates [begin, end)
+// the closed-loop step responses from rest, u = Nbar·r - K·x, x' = Ad·x + Bd·u as in IpModel3.py,
+// run for the whole chunk at once on a fleet with the candidates as its plants
+void SweepEngine::evaluate(const SweepSpec& spec, size_t begin, size_t end, SweepResult* results)
+{
+    const SweepRange* axes[SWEEP_NUM_AXES];
+    sweep_axes(spec, axes);
+    const double nan = std::numeric_limits<double>::quiet_NaN();
+    const double r = spec.step_pos;
+    const double band = std::fabs(spec.settle_band * r);
+    const long num_steps = std::lround(spec.duration_s / spec.ts) + 1;
+
+    PendPhysParams plant_phys = {};     // plant of the last candidate
+    bool have_plant = false;
+    InvPendFleet fleet(end - begin);
+    InvPendFleet::PlantParams params;
+
+    for (size_t index = begin; index < end; ++index) {
+        // candidate parameters from the index
+        double v[SWEEP_NUM_AXES];
+        size_t rest = index;
+        for (int i = SWEEP_NUM_AXES - 1; i >= 0; --i) {
+            unsigned int steps = std::max(axes[i]->steps, 1u);
+            v[i] = axes[i]->value(static_cast<unsigned int>(rest % steps));
+            rest /= steps;
+        }
+        SweepResult& res = results[index];
+        res.phys = PendPhysParams{ v[0], v[1], v[2], v[3], v[4] };
+        res.nbar = v[5];
+        for (int i = 0; i < N; ++i) res.k[i] = v[6 + i];
+
+        // discretise only when the plant changes
+        const PendPhysParams& p = res.phys;
+        if (!have_plant || p.M != plant_phys.M || p.m != plant_phys.m || p.b != plant_phys.b || p.I != plant_phys.I || p.l != plant_phys.l) {
+            double ac[N][N], bc[N];
+            plant_continuous(p, ac, bc);
+            plant_discretise(ac, bc, spec.ts, params.a, params.b);
+            plant_phys = p;
+            have_plant = true;
+        }
+
+        // closed-loop stability
+        double acl[N][N];
+        for (int i = 0; i < N; ++i) {
+            for (int j = 0; j < N; ++j) acl[i][j] = params.a[i][j] - params.b[i] * res.k[j];
+        }
+        res.spectral_radius = plant_spectral_radius(acl);
+        plant_loop_margins(params.a, params.b, res.k, res.margins);
+
+        for (int i = 0; i < N; ++i) params.k[i] = res.k[i];
+        params.nbar = res.nbar;
+        fleet.set_params(index - begin, params);
+    }
+
+    // step responses, a diverged candidate keeps stepping but is no longer followed
+    const size_t n = end - begin;
+    std::vector<double> peak(n, 0.0);   // largest cart position in the direction of the step, fraction of the step
+    std::vector<long> last_out(n, -1);  // last sample outside the band
+    std::vector<char> diverged(n, 0);
+    fleet.set_pos_cmd_all(r);
+    for (long k = 0; k < num_steps; ++k) {
+        for (size_t i = 0; i < n; ++i) {
+            const double y = fleet.get_cart_pos(i);
+            if (diverged[i]) continue;
+            if (!(std::fabs(y) < 1e6)) {
+                diverged[i] = 1;
+                continue;
+            }
+            peak[i] = std::max(peak[i], y / r);
+            if (std::fabs(y - r) > band) last_out[i] = k;
+        }
+        if (k + 1 < num_steps) fleet.step();
+    }
+    for (size_t i = 0; i < n; ++i) {
+        SweepResult& res = results[begin + i];
+        res.overshoot = diverged[i] ? nan : std::max(peak[i] - 1.0, 0.0);
+        res.settling_s = (diverged[i] || last_out[i] == num_steps - 1) ? nan : (last_out[i] + 1) * spec.ts;
+    }
+}
+
+// one line per candidate
+void SweepEngine::write_csv(std::ostream& os, const std::vector<SweepResult>& results)
+{
+    os << "M,m,b,I,l,Nbar,K1,K2,K3,K4,SettlingTime,Overshoot,SpectralRadius,GainMarginUp,GainMarginDown,PhaseMargin\n";
+    os << std::setprecision(8);
+    for (auto& r : results) {
+        os << r.phys.M << ',' << r.phys.m << ',' << r.phys.b << ',' << r.phys.I << ',' << r.phys.l << ',' << r.nbar;
+        for (double k : r.k) os << ',' << k;
+        os << ',' << r.settling_s << ',' << r.overshoot << ',' << r.spectral_radius << ','
+            << r.margins.gain_up_db << ',' << r.margins.gain_down_db << ',' << r.margins.phase_deg << '\n';
+    }
+}
+
+} // namespace inv_example
@@ -0,0 +1,81 @@
+// Controller gain sweep definitions
+
+#ifndef __SWEEP_H__
+#define __SWEEP_H__
+
+#include <cstddef>
+#include <vector>
+#include <iostream>
+#include "Model.h"
+#include "Plant.h"
+#include "Ipc.h"
+
+namespace inv_example {
+// ================================================================================
+// Sweep definition
+// every combination of the parameter ranges is one candidate
+// ================================================================================
+struct SweepRange {
+    double first;
+    double last;
+    unsigned int steps;                 // values evenly spaced from first to last, 1 = first only
+    double value(unsigned int i) const { return steps > 1 ? first + (last - first) * i / (steps - 1) : first; };
+};
+
+struct SweepSpec {
+    SweepRange M, m, b, I, l;           // physical parameters
+    SweepRange nbar;
+    SweepRange k[MODEL_NUM_STATES];     // feedback gains
+    double ts;                          // sample period, s
+    double step_pos;                    // cart position step, m
+    double duration_s;                  // length of each step response, s
+    double settle_band;                 // settled within this fraction of the step
+};
+
+// a single candidate: the gains in Model.h and the plant in doc/IpModel.m, the step response of IpModel3.py
+SweepSpec default_sweep_spec(void);
+
+
+// ================================================================================
+// Result of one candidate
+// ================================================================================
+struct SweepResult {
+    PendPhysParams phys;
+    double nbar;
+    double k[MODEL_NUM_STATES];
+    double settling_s;                  // time after which the cart stays within the band, NaN if it never settles
+    double overshoot;                   // peak beyond the step as a fraction of the step, NaN if the response diverges
+    double spectral_radius;             // of the closed-loop matrix A - B·K, below 1 when stable
+    LoopMargins margins;                // gain and phase margins of the loop broken at the actuator
+};
+
+
+// ================================================================================
+// Sweep engine
+// evaluates the candidates of a sweep on a worker pool; each chunk of candidates is one fleet,
+// stepped together, so a run allocates the result table and a fleet per chunk
+// ================================================================================
+class SweepEngine
+{
+public: // constructors
+    explicit SweepEngine(unsigned int num_threads = 0);    // 0 = one thread per CPU
+
+public: // methods
+    static size_t count(const SweepSpec& spec);         // number of candidates
+    void run(const SweepSpec& spec, std::vector<SweepResult>& results);    // results in candidate order
+    static void write_csv(std::ostream& os, const std::vector<SweepResult>& results);
+    unsigned int get_threads(void) const { return m_pool.size(); };
+
+public: // constants
+    static const size_t GRAIN = 64;     // candidates per chunk handed to a worker
+
+private: // methods
+    static void evaluate(const SweepSpec& spec, size_t begin, size_t end, SweepResult* results);
+
+private: // data
+    IpcWorkerPool m_pool;
+};
+
+} // namespace inv_example
+
+#endif // __SWEEP_H__
@@ -1,7 +1,10 @@
 // System-wide definitions
 
 #include "Error.h"
+#include "ErrorLimit.h"
+#include "Latency.h"
 #include "Ipc.h"
+#include "RtConfig.h"
 
 #ifndef __SYSTEM_H__
 #define __SYSTEM_H__
@@ -17,6 +20,17 @@ enum class SysMode {
     FAILED
 };
 
+inline const char* sys_mode_name(SysMode mode)
+{
+    switch (mode) {
+    case SysMode::LOCKED:   return "LOCKED";
+    case SysMode::MOVING:   return "MOVING";
+    case SysMode::HOLDING:  return "HOLDING";
+    case SysMode::FAILED:   return "FAILED";
+    default:                return "UNKNOWN";
+    }
+}
+
 
 // ================================================================================
 // Error Fault Codes
@@ -27,9 +41,26 @@ const InvErrorCode SYSERR_CART_FORCE_MSG_PARSE              = 1001;
 const InvErrorCode SYSERR_CART_DATA_MSG_PARSE               = 1002;
 const InvErrorCode SYSERR_CART_POLL_MSG_PARSE               = 1003;
 const InvErrorCode SYSERR_CART_KEEPALIVE_MSG_PARSE          = 1004;
+const InvErrorCode SYSERR_CART_LOCK_MSG_PARSE               = 1005;
 const InvErrorCode SYSERR_PEND_DATA_MSG_PARSE               = 1011;
+const InvErrorCode SYSERR_TX_OPEN_FAILED                    = 1021;
+const InvErrorCode SYSERR_TX_DROPPED                        = 1022;
+const InvErrorCode SYSERR_TX_WRITE_FAILED                   = 1023;
+// model errors
+const InvErrorCode SYSERR_PLANT_DESIGN_FAILED               = 2001;
+// data recorder and capture errors
+const InvErrorCode SYSERR_RECORDER_OPEN_FAILED              = 3001;
+const InvErrorCode SYSERR_RECORDER_WRITE_FAILED             = 3002;
+const InvErrorCode SYSERR_RECORDER_BAD_FILE                 = 3003;
+const InvErrorCode SYSERR_CAPTURE_OPEN_FAILED               = 3011;
+const InvErrorCode SYSERR_CAPTURE_WRITE_FAILED              = 3012;
+const InvErrorCode SYSERR_CAPTURE_BAD_FILE                  = 3013;
 // system resource allocation errors
 const InvErrorCode SYSERR_RESOURCE_ALLOCATION_FAILED        = 5000;
+const InvErrorCode SYSERR_THREAD_CONFIG_FAILED              = 5001;
+const InvErrorCode SYSERR_FILE_MAP_FAILED                   = 5002;
+const InvErrorCode SYSERR_MEMORY_LOCK_FAILED                = 5003;
+const InvErrorCode SYSERR_RT_CHECK_FAILED                   = 5004;
 
 
 // ================================================================================
@@ -38,10 +69,31 @@ const InvErrorCode SYSERR_RESOURCE_ALLOCATION_FAILED        = 5000;
 extern InvErrorTable g_sys_err_table;
 
 
+// ================================================================================
+// Global error rate limiter
+// reported and held back errors of each code, see InvErrorLimiter::get_counts
+// ================================================================================
+extern InvErrorLimiter g_sys_err_limit;
+
+
+// ================================================================================
+// Global sensor to actuator latency histograms
+// percentiles of each stage, see InvLatencyHistogram::get_summary
+// ================================================================================
+extern InvLatencyStages g_sys_latency;
+
+
+// ================================================================================
+// Global real-time options
+// thread scheduling and memory locking, set from the command line before the system starts
+// ================================================================================
+extern SysRtConfig g_sys_rt_config;
+
+
 // ================================================================================
 // Report a system error
 // ================================================================================
-void enqueue_error(InvError& err);
+void enqueue_error(const InvError& err);
 
 
 } // namespace inv_example
@@ -1,36 +1,176 @@
 // Timestamp implementation
 
 #include <chrono>
-#include <sstream>
-#include <iomanip>
+#include <thread>
 #include <ctime>
-#include "timestamp.h"
+#include <cstring>
+#include "Timestamp.h"
+
+#if defined(TIMESTAMP_CLOCK_TSC) && !defined(_MSC_VER)
+#include <cpuid.h>
+#endif
 
 namespace inv_example {
 
 // ================================================================================
-// Timestamp implementation for Windows
+// Fast clock
 // ================================================================================
+std::atomic<uint32_t> InvFastClock::m_seq{ 0 };
+std::atomic<uint64_t> InvFastClock::m_base_tsc{ 0 };
+std::atomic<int64_t> InvFastClock::m_base_ns{ 0 };
+std::atomic<double> InvFastClock::m_ns_per_tick{ 0.0 };
+
+#ifdef TIMESTAMP_CLOCK_TSC
+// true if the TSC runs at a constant rate in every power state (CPUID 8000_0007h EDX bit 8)
+static bool has_invariant_tsc(void)
+{
+    unsigned int regs[4] = {};
+#if defined(_MSC_VER)
+    int r[4];
+    __cpuid(r, 0x80000000);
+    if (static_cast<unsigned int>(r[0]) < 0x80000007) return false;
+    __cpuid(r, 0x80000007);
+    regs[3] = static_cast<unsigned int>(r[3]);
+#else
+    if (!__get_cpuid(0x80000007, &regs[0], &regs[1], &regs[2], &regs[3])) return false;
+#endif
+    return (regs[3] & (1u << 8)) != 0;
+}
+
+// a TSC reading and the steady clock at the same moment,
+// taken from the tightest of a few TSC brackets around the steady clock read
+static void sample_clocks(uint64_t& tsc, int64_t& ns)
+{
+    uint64_t best = UINT64_MAX;
+    tsc = 0;
+    ns = 0;
+    for (int i = 0; i < 5; ++i) {
+        uint64_t t0 = __rdtsc();
+        int64_t n = inv_steady_ns();
+        uint64_t t1 = __rdtsc();
+        if (t1 - t0 < best) {
+            best = t1 - t0;
+            tsc = t0 + (t1 - t0) / 2;
+            ns = n;
+        }
+    }
+}
+
+// publish a new scale, readers retry while the sequence is odd
+static void publish(std::atomic<uint32_t>& seq, std::atomic<uint64_t>& base_tsc, std::atomic<int64_t>& base_ns,
+    std::atomic<double>& ns_per_tick, uint64_t tsc, int64_t ns, double rate)
+{
+    uint32_t s = seq.load(std::memory_order_relaxed);
+    seq.store(s + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    base_tsc.store(tsc, std::memory_order_relaxed);
+    base_ns.store(ns, std::memory_order_relaxed);
+    ns_per_tick.store(rate, std::memory_order_relaxed);
+    seq.store(s + 2, std::memory_order_release);
+}
+#endif
+
+// measure the TSC rate against the steady clock over ms
+bool InvFastClock::calibrate(unsigned int ms)
+{
+#ifdef TIMESTAMP_CLOCK_TSC
+    if (!has_invariant_tsc()) return false;
+    uint64_t tsc0, tsc1;
+    int64_t ns0, ns1;
+    sample_clocks(tsc0, ns0);
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+    sample_clocks(tsc1, ns1);
+    if (tsc1 <= tsc0 || ns1 <= ns0) return false;
+    publish(m_seq, m_base_tsc, m_base_ns, m_ns_per_tick, tsc1, ns1, static_cast<double>(ns1 - ns0) / static_cast<double>(tsc1 - tsc0));
+    return true;
+#else
+    (void)ms;
+    return false;
+#endif
+}
+
+// move the anchor to now, and take the rate over the whole time since the last anchor
+// the fast clock steps by the drift since then, normally well under a microsecond
+void InvFastClock::resync(void)
+{
+#ifdef TIMESTAMP_CLOCK_TSC
+    if (!is_tsc()) return;
+    uint64_t tsc;
+    int64_t ns;
+    sample_clocks(tsc, ns);
+    uint64_t base_tsc = m_base_tsc.load(std::memory_order_relaxed);
+    int64_t base_ns = m_base_ns.load(std::memory_order_relaxed);
+    double rate = m_ns_per_tick.load(std::memory_order_relaxed);
+    if (ns - base_ns >= 100000000 && tsc > base_tsc) {    // shorter intervals would only add noise to the rate
+        rate = static_cast<double>(ns - base_ns) / static_cast<double>(tsc - base_tsc);
+    }
+    publish(m_seq, m_base_tsc, m_base_ns, m_ns_per_tick, tsc, ns, rate);
+#endif
+}
+
+
+// ================================================================================
+// Timestamp
+// ================================================================================
+// system clock - steady clock, measured on first use
+int64_t InvTimestamp::to_wall_ns(void) const
+{
+    static const int64_t offset_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count() - inv_steady_ns();
+    return m_ns + offset_ns;
+}
+
 // ========================================
 // formatted output as a short string HH:MM:SS.ffff
+// the HH:MM:SS of the last second formatted is kept per thread
 // ========================================
-std::string InvTimestamp::to_string(void) const
+size_t InvTimestamp::format(char* buf, size_t len) const
 {
-    std::stringstream outstr;   // return value
+    struct SecondText {
+        int64_t sec;
+        char hms[9];
+    };
+    static thread_local SecondText cache{ -1, {} };
 
-    // get the fractional part of seconds
-    double t_sec = std::chrono::duration<double, std::ratio<1, 1>>(m_t.time_since_epoch()).count();     // time in sec since epoch
-    int t_frac = static_cast<int>((t_sec - floor(t_sec))*10000.0);      // number of 0.1 msec since last second
+    int64_t wall_ns = to_wall_ns();
+    int64_t sec = wall_ns / 1000000000;
+    int frac = static_cast<int>((wall_ns % 1000000000) / 100000);      // number of 0.1 msec since last second
+    if (wall_ns < 0) {
+        sec = 0;
+        frac = 0;
+    }
+    if (sec != cache.sec) {
+        std::time_t t = static_cast<std::time_t>(sec);
+        std::tm tm_local;
+#if defined(_WIN32)
+        localtime_s(&tm_local, &t);     // time in local time zone
+#else
+        localtime_r(&t, &tm_local);
+#endif
+        std::strftime(cache.hms, sizeof(cache.hms), "%H:%M:%S", &tm_local);
+        cache.sec = sec;
+    }
 
-    // use a std function to print hours:minutes:seconds in local time zone
-    auto tnow = std::chrono::steady_clock::to_time_t(m_t);
-    tm tmnow;
-    localtime_s(&tmnow, &tnow);   // time in local time zone
-    char str1[9];
-    std::strftime(str1, sizeof(str1), "%H:%M:%S", &tmnow);
+    char text[14];
+    std::memcpy(text, cache.hms, 8);
+    text[8] = '.';
+    text[9] = static_cast<char>('0' + frac / 1000);
+    text[10] = static_cast<char>('0' + frac / 100 % 10);
+    text[11] = static_cast<char>('0' + frac / 10 % 10);
+    text[12] = static_cast<char>('0' + frac % 10);
+    text[13] = '\0';
+    if (len == 0) return 0;
+    size_t n = len - 1 < 13 ? len - 1 : 13;
+    std::memcpy(buf, text, n);
+    buf[n] = '\0';
+    return n;
+}
 
-    outstr << str1 << "." << std::setw(4) << std::setfill('0') << t_frac;
-    return outstr.str();
+std::string InvTimestamp::to_string(void) const
+{
+    char text[14];
+    size_t n = format(text, sizeof(text));
+    return std::string(text, n);
 }
 
 } // namespace inv_example
@@ -38,4 +178,9 @@ std::string InvTimestamp::to_string(void) const
 // ========================================
 // output formatted timestamp to a stream
 // ========================================
-std::ostream& operator<<(std::ostream& os, const inv_example::InvTimestamp& timestamp) { os << timestamp.to_string(); return os; };
+std::ostream& operator<<(std::ostream& os, const inv_example::InvTimestamp& timestamp)
+{
+    char text[14];
+    os.write(text, timestamp.format(text, sizeof(text)));
+    return os;
+}
@@ -4,30 +4,108 @@
 #define __TIMESTAMP_H__
 
 #include <iostream>
+#include <string>
 #include <chrono>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#define TIMESTAMP_CLOCK_TSC
+#endif
 
 namespace inv_example {
 
 // ================================================================================
-// Implement timestamps using the std time library
-// In windows the resolution is 15.6 msec
+// Steady clock in ns
+// ================================================================================
+inline int64_t inv_steady_ns(void)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+// ================================================================================
+// Fast clock for time of arrival stamps
+// the CPU time stamp counter scaled to the steady clock, so its stamps can be compared
+// with every other timestamp; the steady clock is used until calibrate() succeeds, or
+// where there is no invariant TSC. resync() follows slow drift of the steady clock
+// ================================================================================
+class InvFastClock
+{
+public: // methods
+    static bool calibrate(unsigned int ms = 10);   // measure the TSC rate, false if the steady clock is kept
+    static void resync(void);           // re-anchor to the steady clock and refine the rate, once a second or so; one thread
+    static bool is_tsc(void) { return m_seq.load(std::memory_order_acquire) != 0; };
+    static int64_t now_ns(void);        // a few ns with the TSC
+
+private: // data
+    // seqlock: odd while the writer changes the scale, 0 before calibration
+    static std::atomic<uint32_t> m_seq;
+    static std::atomic<uint64_t> m_base_tsc;
+    static std::atomic<int64_t> m_base_ns;
+    static std::atomic<double> m_ns_per_tick;
+};
+
+inline int64_t InvFastClock::now_ns(void)
+{
+#ifdef TIMESTAMP_CLOCK_TSC
+    for (;;) {
+        uint32_t seq = m_seq.load(std::memory_order_acquire);
+        if (seq == 0) break;            // not calibrated
+        uint64_t tsc = __rdtsc();
+        uint64_t base_tsc = m_base_tsc.load(std::memory_order_relaxed);
+        int64_t base_ns = m_base_ns.load(std::memory_order_relaxed);
+        double ns_per_tick = m_ns_per_tick.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if ((seq & 1) == 0 && m_seq.load(std::memory_order_relaxed) == seq) {
+            return base_ns + static_cast<int64_t>(static_cast<double>(static_cast<int64_t>(tsc - base_tsc)) * ns_per_tick);
+        }
+    }
+#endif
+    return inv_steady_ns();
+}
+
+
+// ================================================================================
+// Timestamp
+// integer ns of the steady clock; the wall clock offset is measured once,
+// and the local time text is made once a second and reused
 // ================================================================================
 class InvTimestamp
 {
 public: // constructors
     // Create a new timestamp with the current time
-    InvTimestamp() : m_t(std::chrono::steady_clock::now()) {};
+    InvTimestamp() : m_ns(inv_steady_ns()) {};
+    // Create a timestamp at a given time, e.g. a simulated time
+    explicit InvTimestamp(std::chrono::steady_clock::time_point t)
+        : m_ns(std::chrono::duration_cast<std::chrono::nanoseconds>(t.time_since_epoch()).count()) {};
+    static InvTimestamp from_ns(int64_t ns) { InvTimestamp t(ns, 0); return t; };  // at ns of the steady clock
+    static InvTimestamp fast(void) { return from_ns(InvFastClock::now_ns()); };      // now from the fast clock, for time of arrival
 
 public: // methods
     // formatted output
     std::string to_string(void) const;             // Short string HH:MM:SS.ssss in local time zone
-    std::chrono::steady_clock::duration to_duration(const InvTimestamp& t0) const { return m_t - t0.m_t; }; // difference as a duration
+    size_t format(char* buf, size_t len) const;    // the same without allocating, returns the length written
+    std::chrono::nanoseconds to_duration(const InvTimestamp& t0) const { return std::chrono::nanoseconds(m_ns - t0.m_ns); }; // difference as a duration
+    int64_t to_ns(void) const { return m_ns; };    // ns of the steady clock
+    int64_t to_wall_ns(void) const;                 // ns since 1970 of the system clock
 
     // operators
-    double operator-(const InvTimestamp &t0) { return std::chrono::duration<double, std::ratio<1, 1>>(to_duration(t0)).count(); }; // difference in seconds
+    double operator-(const InvTimestamp &t0) const { return (m_ns - t0.m_ns) * 1e-9; };  // difference in seconds
+    bool operator<(const InvTimestamp& t) const { return m_ns < t.m_ns; };
+    bool operator==(const InvTimestamp& t) const { return m_ns == t.m_ns; };
+
+private: // constructors
+    InvTimestamp(int64_t ns, int) : m_ns(ns) {};
 
 private: // data
-    std::chrono::steady_clock::time_point m_t;      // timestamp stored in the std library type
+    int64_t m_ns;           // ns of the steady clock
 };
 
 
@@ -38,4 +116,4 @@ private: // data
 // ========================================
 std::ostream& operator<<(std::ostream& os, const inv_example::InvTimestamp& timestamp);
 
-#endif // __TIMESTAMP_H__
\ No newline at end of file
+#endif // __TIMESTAMP_H__
@@ -0,0 +1,93 @@
+// Packet transmitter implementation
+
+#include <cstring>
+#include "Transmit.h"
+#include "System.h"
+#include "Error.h"
+
+namespace inv_example {
+// ================================================================================
+// Packet transmitter
+// ================================================================================
+// open the device and start the transmit thread
+CommTransmitter::CommTransmitter(CommLink link, const std::string& device, const IpcThreadConfig& cfg)
+    : m_link(link)
+{
+    if (device.empty() || !m_device.open(device)) {
+        enqueue_error(NewInvError(SYSERR_TX_OPEN_FAILED));
+        return;                         // not sending, packets are reported as dropped
+    }
+    m_buf.reserve(BATCH_LEN * CommPacketBase::m_MAX_LEN);
+
+    bool ok;
+    m_thread = ipc_start_thread(cfg, ok, [this] { transmit_thread(); });
+    if (!ok) enqueue_error(NewInvError(SYSERR_THREAD_CONFIG_FAILED));
+}
+
+// queue the end marker behind the last packet and wait for the transmit thread
+CommTransmitter::~CommTransmitter()
+{
+    if (!is_open()) return;
+    Entry end;
+    end.len = 0;
+    while (!m_ring.Send(end)) std::this_thread::yield();
+    m_thread.join();
+}
+
+// queue a packet
+// called from the control thread, copies the packet into the ring and returns
+bool CommTransmitter::send(const CommPacketBase& packet)
+{
+    if (!is_open()) {
+        drop();
+        return false;
+    }
+    Entry entry;
+    entry.len = static_cast<uint8_t>(packet.get_len());
+    std::memcpy(entry.bytes, packet.get_raw(), entry.len);
+    if (m_ring.Send(entry)) return true;
+    drop();
+    return false;
+}
+
+// count and report a packet that was not sent
+// the rate limiter keeps a stream of them from flooding the log
+void CommTransmitter::drop(void)
+{
+    m_dropped.fetch_add(1, std::memory_order_relaxed);
+    enqueue_error(NewInvError(SYSERR_TX_DROPPED));
+}
+
+// Transmit thread
+// writes each batch taken from the ring with one call to the device
+void CommTransmitter::transmit_thread(void)
+{
+    std::vector<Entry> batch;
+    batch.reserve(BATCH_LEN);
+    bool run = true;
+    while (run) {
+        batch.clear();
+        m_buf.clear();
+        m_ring.WaitBatch(batch, BATCH_LEN);
+        size_t n = 0;                   // packets in the batch
+        for (auto& entry : batch) {
+            if (entry.len == 0) {
+                run = false;
+                break;
+            }
+            m_buf.insert(m_buf.end(), entry.bytes, entry.bytes + entry.len);
+            ++n;
+        }
+        if (n == 0) continue;
+        if (m_device.write(m_buf.data(), m_buf.size())) {
+            m_sent.fetch_add(n, std::memory_order_relaxed);
+        }
+        else {
+            m_dropped.fetch_add(n, std::memory_order_relaxed);
+            enqueue_error(NewInvError(SYSERR_TX_WRITE_FAILED));
+        }
+    }
+    m_device.close();
+}
+
+} // namespace inv_example
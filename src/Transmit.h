@@ -0,0 +1,63 @@
+// Packet transmitter definitions
+
+#ifndef __TRANSMIT_H__
+#define __TRANSMIT_H__
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include "Ipc.h"
+#include "Comms.h"
+
+namespace inv_example {
+// ================================================================================
+// Packet transmitter
+// the control thread copies each packet into a lock-free ring, a transmit thread writes it to the
+// device of the link, e.g. the serial port of the cart interface set up with stty;
+// send() never locks or does I/O, a packet that can not be sent is reported, never dropped silently
+// ================================================================================
+class CommTransmitter
+{
+public: // constructors
+    // open the device; if it can not be opened the error is reported, and so is every packet sent to it
+    CommTransmitter(CommLink link, const std::string& device, const IpcThreadConfig& cfg = IpcThreadConfig());    // cfg applies to the transmit thread
+    CommTransmitter(const CommTransmitter&) = delete;
+    ~CommTransmitter();                 // write the packets still queued and close the device
+
+public: // methods
+    bool is_open(void) const { return m_thread.joinable(); };
+    bool send(const CommPacketBase& packet);    // queue a packet, false if it was dropped and reported
+    CommLink get_link(void) const { return m_link; };
+    unsigned long long get_sent(void) const { return m_sent.load(std::memory_order_relaxed); };
+    unsigned long long get_dropped(void) const { return m_dropped.load(std::memory_order_relaxed); };
+
+public: // constants
+    static const size_t RING_LEN = 256;         // 2.5 s of force commands at 100 Hz
+    static const size_t BATCH_LEN = 32;         // packets written per wakeup
+
+private: // types
+    struct Entry {
+        uint8_t len;                    // 0 stops the transmit thread
+        uint8_t bytes[CommPacketBase::m_MAX_LEN];
+    };
+
+private: // methods
+    void transmit_thread(void);
+    void drop(void);                    // count and report a packet that was not sent
+
+private: // data
+    CommLink m_link;
+    IpcSpscQueue<Entry, RING_LEN> m_ring;
+    IpcFile m_device;
+    std::vector<char> m_buf;            // a batch of packets, written with one call
+    std::atomic<unsigned long long> m_sent{ 0 };
+    std::atomic<unsigned long long> m_dropped{ 0 };
+    std::thread m_thread;
+};
+
+} // namespace inv_example
+
+#endif // __TRANSMIT_H__
@@ -1,12 +1,103 @@
 // Windows implementation of interprocess communication functions
 
+#define NOMINMAX
 #include <windows.h>
+#include <malloc.h>
 
 #include "System.h"
 #include "Ipc.h"
 #include "Error.h"
 
 namespace inv_example {
+// ========================================
+// Address wait and wake
+// requires Windows 8 or later
+// ========================================
+void ipc_wait_on_address(std::atomic<uint32_t>& addr, uint32_t expected)
+{
+    WaitOnAddress(&addr, &expected, sizeof(expected), INFINITE);
+}
+
+void ipc_wake_one(std::atomic<uint32_t>& addr)
+{
+    WakeByAddressSingle(&addr);
+}
+
+
+// ========================================
+// Apply scheduling options to a thread
+// returns false if the process is not allowed to change them;
+// any real-time priority maps to the time-critical level of the process priority class
+// ========================================
+static bool apply_thread_config(HANDLE t, const IpcThreadConfig& cfg)
+{
+    bool ok = true;
+    ok = SetThreadPriority(t, cfg.priority > 0 ? THREAD_PRIORITY_TIME_CRITICAL : THREAD_PRIORITY_NORMAL) != 0 && ok;
+
+    DWORD_PTR process_cpus, system_cpus;
+    if (GetProcessAffinityMask(GetCurrentProcess(), &process_cpus, &system_cpus)) {
+        DWORD_PTR cpus = cfg.cpus == 0 ? process_cpus : static_cast<DWORD_PTR>(cfg.cpus) & process_cpus;
+        ok = cpus != 0 && SetThreadAffinityMask(t, cpus) != 0 && ok;
+    }
+    else {
+        ok = false;
+    }
+    return ok;
+}
+
+// touch the pages of the next bytes of stack below the caller
+static __declspec(noinline) void prefault_stack(size_t bytes)
+{
+    volatile uint8_t* p = static_cast<volatile uint8_t*>(_alloca(bytes));
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    for (size_t i = 0; i < bytes; i += info.dwPageSize) p[i] = 0;
+}
+
+bool ipc_set_thread_config(std::thread& t, const IpcThreadConfig& cfg)
+{
+    return apply_thread_config(t.native_handle(), cfg);
+}
+
+bool ipc_set_this_thread_config(const IpcThreadConfig& cfg)
+{
+    if (cfg.stack_prefault > 0) prefault_stack(cfg.stack_prefault);
+    return apply_thread_config(GetCurrentThread(), cfg);
+}
+
+
+// ========================================
+// Memory locking
+// Windows can only lock given ranges within the working set, so the process is not locked
+// ========================================
+bool ipc_lock_memory(void)
+{
+    return false;
+}
+
+
+// ========================================
+// Resource usage counters
+// Windows does not count page faults or context switches per thread
+// ========================================
+bool ipc_get_thread_usage(IpcUsage& usage)
+{
+    usage = IpcUsage{};
+    return false;
+}
+
+bool ipc_get_process_usage(IpcUsage& usage)
+{
+    usage = IpcUsage{};
+    return false;
+}
+
+int ipc_current_cpu(void)
+{
+    return static_cast<int>(GetCurrentProcessorNumber());
+}
+
+
 // ========================================
 // High-resolution timer
 // Calls a callback function at a periodic rate
@@ -18,7 +109,8 @@ extern "C" void CALLBACK win_timer_callback(UINT uTimerID, UINT uMsg, DWORD_PTR
 }
 
 // Create and start a timer with the given period and callback function
-IpcHighResTimer::IpcHighResTimer(unsigned int period_ms, IpcHighResTimerCallback proc)
+// the callback runs on a thread owned by windows, so the thread configuration is not used
+IpcHighResTimer::IpcHighResTimer(unsigned int period_ms, IpcHighResTimerCallback proc, IpcThreadConfig cfg)
 {
     TIMECAPS tc;
     MMRESULT mr = timeGetDevCaps(&tc, sizeof(TIMECAPS));
@@ -33,6 +125,9 @@ IpcHighResTimer::IpcHighResTimer(unsigned int period_ms, IpcHighResTimerCallback
     }
 
     m_proc = proc;
+    m_period_ns = static_cast<int64_t>(period_ms) * 1000000;
+    m_next_ns = ipc_clock_ns() + m_period_ns;
+    m_last_ns = 0;
     m_timerid = timeSetEvent(period_ms, 0, win_timer_callback, reinterpret_cast<DWORD_PTR>(this), TIME_PERIODIC);
     if (m_timerid == NULL) {
         throw NewInvError(SYSERR_RESOURCE_ALLOCATION_FAILED);
@@ -45,4 +140,87 @@ IpcHighResTimer::~IpcHighResTimer()
     timeKillEvent(m_timerid);
 }
 
+// ========================================
+// Read-only memory-mapped file
+// ========================================
+IpcMappedFile::IpcMappedFile(const std::string& file_name)
+    : m_data(nullptr), m_size(0), m_file(INVALID_HANDLE_VALUE), m_map(nullptr)
+{
+    m_file = CreateFileA(file_name.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr,
+        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    LARGE_INTEGER size;
+    if (m_file == INVALID_HANDLE_VALUE || !GetFileSizeEx(m_file, &size)) {
+        if (m_file != INVALID_HANDLE_VALUE) CloseHandle(m_file);
+        throw NewInvError(SYSERR_FILE_MAP_FAILED);
+    }
+    m_size = static_cast<size_t>(size.QuadPart);
+    if (m_size > 0) {
+        m_map = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        void* p = m_map ? MapViewOfFile(m_map, FILE_MAP_READ, 0, 0, 0) : nullptr;
+        if (p == nullptr) {
+            if (m_map) CloseHandle(m_map);
+            CloseHandle(m_file);
+            throw NewInvError(SYSERR_FILE_MAP_FAILED);
+        }
+        m_data = static_cast<const uint8_t*>(p);
+    }
+}
+
+IpcMappedFile::~IpcMappedFile()
+{
+    if (m_data) UnmapViewOfFile(m_data);
+    if (m_map) CloseHandle(m_map);
+    CloseHandle(m_file);
+}
+
+
+// ========================================
+// Append-only file
+// ========================================
+IpcFile::IpcFile()
+    : m_size(0), m_handle(INVALID_HANDLE_VALUE)
+{
+}
+
+bool IpcFile::open(const std::string& file_name)
+{
+    close();
+    m_handle = CreateFileA(file_name.c_str(), FILE_APPEND_DATA, FILE_SHARE_READ, nullptr,
+        OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (m_handle == INVALID_HANDLE_VALUE) return false;
+    LARGE_INTEGER size;
+    m_size = GetFileSizeEx(m_handle, &size) ? static_cast<uint64_t>(size.QuadPart) : 0;
+    return true;
+}
+
+void IpcFile::close(void)
+{
+    if (m_handle != INVALID_HANDLE_VALUE) CloseHandle(m_handle);
+    m_handle = INVALID_HANDLE_VALUE;
+    m_size = 0;
+}
+
+bool IpcFile::is_open(void) const
+{
+    return m_handle != INVALID_HANDLE_VALUE;
+}
+
+bool IpcFile::write(const char* data, size_t len)
+{
+    while (len > 0 && m_handle != INVALID_HANDLE_VALUE) {
+        DWORD n = 0;
+        DWORD chunk = static_cast<DWORD>(std::min<size_t>(len, 1u << 30));
+        if (!WriteFile(m_handle, data, chunk, &n, nullptr) || n == 0) return false;
+        data += n;
+        len -= n;
+        m_size += n;
+    }
+    return len == 0;
+}
+
+bool IpcFile::sync(void)
+{
+    return m_handle != INVALID_HANDLE_VALUE && FlushFileBuffers(m_handle) != 0;
+}
+
 } // namespace inv_example
@@ -0,0 +1,37 @@
+// Capture export tool
+// usage: CapExport file.cap cart|pend [out.csv]
+// writes the cart or pendulum data frames of a packet capture as CSV, to standard output if no output file is given
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include "Capture.h"
+
+using namespace std;
+using namespace inv_example;
+
+int main(int argc, char* argv[])
+{
+    string packet = argc >= 3 ? argv[2] : "";
+    if (argc < 3 || argc > 4 || (packet != "cart" && packet != "pend")) {
+        cerr << "usage: CapExport file.cap cart|pend [out.csv]" << endl;
+        return 1;
+    }
+    const PacketId id = packet == "cart" ? PacketId::CART_DATA : PacketId::PEND_DATA;
+
+    ofstream file;
+    if (argc == 4) {
+        file.open(argv[3]);
+        if (!file) {
+            cerr << "Unable to create " << argv[3] << endl;
+            return 1;
+        }
+    }
+    ostream& out = argc == 4 ? file : cout;
+
+    if (!cap_export_csv(argv[1], id, out)) {
+        cerr << "Unable to read " << argv[1] << " as a capture file" << endl;
+        return 1;
+    }
+    return out ? 0 : 1;
+}
@@ -0,0 +1,36 @@
+// Data file export tool
+// usage: RecExport file.rec [out.csv]
+// writes the binary data file of the data recorder as the CSV data file of doc/InterfaceDefinitions.txt,
+// to standard output if no output file is given
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include "Recorder.h"
+
+using namespace std;
+using namespace inv_example;
+
+int main(int argc, char* argv[])
+{
+    if (argc < 2 || argc > 3) {
+        cerr << "usage: RecExport file.rec [out.csv]" << endl;
+        return 1;
+    }
+
+    ofstream file;
+    if (argc == 3) {
+        file.open(argv[2]);
+        if (!file) {
+            cerr << "Unable to create " << argv[2] << endl;
+            return 1;
+        }
+    }
+    ostream& out = argc == 3 ? file : cout;
+
+    if (!rec_export_csv(argv[1], out)) {
+        cerr << "Unable to read " << argv[1] << " as a data file" << endl;
+        return 1;
+    }
+    return out ? 0 : 1;
+}
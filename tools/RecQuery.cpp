@@ -0,0 +1,93 @@
+// Data file query tool
+// usage: RecQuery [--from s] [--to s] [--column name] file.rec ...
+// prints the min/max/RMS of PendPos and ForceCmd for each mode segment of each file,
+// or with --column the time and value of one column; times are seconds since the first record
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <cmath>
+#include <limits>
+#include "Reader.h"
+#include "System.h"
+
+using namespace std;
+using namespace inv_example;
+
+static const char* COLUMN_NAMES[] = { "Time", "PosCmd", "CartPos", "CartVel", "PendPos", "PendVel", "ForceCmd" };
+
+static int usage(void)
+{
+    cerr << "usage: RecQuery [--from s] [--to s] [--column name] file.rec ..." << endl;
+    cerr << "       name = PosCmd, CartPos, CartVel, PendPos, PendVel or ForceCmd" << endl;
+    return 1;
+}
+
+static void print_stats(const DataReader& reader, const RecRange& r)
+{
+    const int64_t t0 = reader.t_first_ns();
+    cout << "Start,End,Mode,Records,PendPosMin,PendPosMax,PendPosRms,ForceCmdMin,ForceCmdMax,ForceCmdRms\n";
+    for (const auto& s : rec_segment_stats(reader, r)) {
+        cout << fixed << setprecision(2) << (s.t_begin_ns - t0) / 1e9 << ',' << (s.t_end_ns - t0) / 1e9 << ','
+            << sys_mode_name(s.mode) << ',' << s.count << setprecision(6)
+            << ',' << s.pend_pos.min << ',' << s.pend_pos.max << ',' << s.pend_pos.rms
+            << ',' << s.force_cmd.min << ',' << s.force_cmd.max << ',' << s.force_cmd.rms << '\n';
+    }
+}
+
+static void print_column(const DataReader& reader, const RecRange& r, RecColumn col)
+{
+    const int64_t t0 = reader.t_first_ns();
+    cout << "Time," << COLUMN_NAMES[col] << '\n';
+    reader.for_each(col, r, [t0](int64_t t_ns, double v) {
+        cout << fixed << setprecision(2) << (t_ns - t0) / 1e9 << ',' << setprecision(6) << v << '\n';
+    });
+}
+
+int main(int argc, char* argv[])
+{
+    double from_s = 0.0;
+    double to_s = numeric_limits<double>::infinity();
+    int column = -1;
+    vector<string> files;
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if ((arg == "--from" || arg == "--to" || arg == "--column") && i + 1 < argc) {
+            string value = argv[++i];
+            if (arg == "--from") from_s = stod(value);
+            else if (arg == "--to") to_s = stod(value);
+            else {
+                for (int c = REC_POS_CMD; c < REC_MODE; ++c) {
+                    if (value == COLUMN_NAMES[c]) column = c;
+                }
+                if (column < 0) return usage();
+            }
+        }
+        else if (arg.compare(0, 2, "--") == 0) {
+            return usage();
+        }
+        else {
+            files.push_back(arg);
+        }
+    }
+    if (files.empty()) return usage();
+
+    int result = 0;
+    for (const auto& file : files) {
+        try {
+            DataReader reader(file);
+            const int64_t t0 = reader.t_first_ns();
+            RecRange r = reader.range(t0 + llround(from_s * 1e9),
+                isinf(to_s) ? numeric_limits<int64_t>::max() : t0 + llround(to_s * 1e9));
+            if (files.size() > 1) cout << "# " << file << '\n';
+            if (column < 0) print_stats(reader, r);
+            else print_column(reader, r, static_cast<RecColumn>(column));
+        }
+        catch (const InvError&) {
+            cerr << "Unable to read " << file << " as a data file" << endl;
+            result = 1;
+        }
+    }
+    return result;
+}
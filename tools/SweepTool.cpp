@@ -0,0 +1,112 @@
+// Controller gain sweep tool
+// usage: SweepTool [--M r] [--m r] [--b r] [--I r] [--l r] [--nbar r] [--k1 r] .. [--k4 r]
+//                  [--ts s] [--step m] [--duration s] [--band f] [--threads n] [--out file.csv]
+// a range r is first:last:steps or a single value; parameters not given keep the values in Model.h and doc/IpModel.m
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <cmath>
+#include <chrono>
+#include "Sweep.h"
+
+using namespace std;
+using namespace inv_example;
+
+// ================================================================================
+// Command line
+// ================================================================================
+static bool parse_range(const string& text, SweepRange& range)
+{
+    size_t c1 = text.find(':');
+    if (c1 == string::npos) {
+        range.first = range.last = stod(text);
+        range.steps = 1;
+        return true;
+    }
+    size_t c2 = text.find(':', c1 + 1);
+    if (c2 == string::npos) return false;
+    range.first = stod(text.substr(0, c1));
+    range.last = stod(text.substr(c1 + 1, c2 - c1 - 1));
+    range.steps = static_cast<unsigned int>(stoul(text.substr(c2 + 1)));
+    return range.steps > 0;
+}
+
+static int usage(void)
+{
+    cerr << "usage: SweepTool [--M r] [--m r] [--b r] [--I r] [--l r] [--nbar r] [--k1 r] .. [--k4 r]" << endl;
+    cerr << "                 [--ts s] [--step m] [--duration s] [--band f] [--threads n] [--out file.csv]" << endl;
+    cerr << "       r = first:last:steps or a single value" << endl;
+    return 1;
+}
+
+
+// ================================================================================
+// Run a sweep and report the best stable candidate
+// ================================================================================
+int main(int argc, char* argv[])
+{
+    SweepSpec spec = default_sweep_spec();
+    unsigned int threads = 0;
+    string out_name;
+
+    try {
+        for (int i = 1; i + 1 < argc; i += 2) {
+            string opt = argv[i];
+            string arg = argv[i + 1];
+            SweepRange* range = nullptr;
+            if (opt == "--M") range = &spec.M;
+            else if (opt == "--m") range = &spec.m;
+            else if (opt == "--b") range = &spec.b;
+            else if (opt == "--I") range = &spec.I;
+            else if (opt == "--l") range = &spec.l;
+            else if (opt == "--nbar") range = &spec.nbar;
+            else if (opt.size() == 4 && opt.compare(0, 3, "--k") == 0 && opt[3] >= '1' && opt[3] <= '4') range = &spec.k[opt[3] - '1'];
+            else if (opt == "--ts") spec.ts = stod(arg);
+            else if (opt == "--step") spec.step_pos = stod(arg);
+            else if (opt == "--duration") spec.duration_s = stod(arg);
+            else if (opt == "--band") spec.settle_band = stod(arg);
+            else if (opt == "--threads") threads = static_cast<unsigned int>(stoul(arg));
+            else if (opt == "--out") out_name = arg;
+            else return usage();
+            if (range != nullptr && !parse_range(arg, *range)) return usage();
+        }
+        if (argc % 2 == 0) return usage();
+    }
+    catch (const exception&) {
+        return usage();
+    }
+
+    SweepEngine engine(threads);
+    vector<SweepResult> results;
+    auto t0 = chrono::steady_clock::now();
+    engine.run(spec, results);
+    double dt = chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+
+    if (out_name.empty()) {
+        SweepEngine::write_csv(cout, results);
+    }
+    else {
+        ofstream out(out_name);
+        if (!out) {
+            cerr << "Unable to open " << out_name << endl;
+            return 1;
+        }
+        SweepEngine::write_csv(out, results);
+    }
+
+    // fastest settling stable candidate
+    const SweepResult* best = nullptr;
+    for (auto& r : results) {
+        if (r.spectral_radius < 1.0 && !std::isnan(r.settling_s) && (best == nullptr || r.settling_s < best->settling_s)) best = &r;
+    }
+    cerr << results.size() << " candidates in " << dt << " s on " << engine.get_threads() << " threads, "
+        << results.size() / dt << " candidates/s" << endl;
+    if (best != nullptr) {
+        cerr << "Best: K = " << best->k[0] << " " << best->k[1] << " " << best->k[2] << " " << best->k[3] << ", Nbar = " << best->nbar
+            << ", settling " << best->settling_s << " s, overshoot " << best->overshoot * 100.0 << " %"
+            << ", gain margin +" << best->margins.gain_up_db << "/-" << best->margins.gain_down_db << " dB, phase margin "
+            << best->margins.phase_deg << " deg" << endl;
+    }
+    return 0;
+}